@@ -0,0 +1,46 @@
+// sort benchmark, numbers and strings without comparator are sorted by threads above 65536 elements
+// uses now() because clock() sums up processor time of all threads
+
+let seed = 1;
+function random() {
+    seed = seed * 16807 % 2147483647; // park-miller, product is exact in double
+    return seed;
+}
+// 3 letter syllables, so that each random string only needs 2 concatenations
+let letters = split("a,b,c,d,e,f,g,h,i,j,k,l,m,n,o,p,q,r,s,t,u,v,w,x,y,z", ",");
+let syllables = [];
+for (let x of letters) {
+    for (let y of letters) {
+        for (let z of letters) {
+            push(syllables, x + y + z);
+        }
+    }
+}
+function random_string() {
+    let n = length(syllables);
+    return syllables[random() % n] + syllables[random() % n] + syllables[random() % n];
+}
+
+for (let size of [1000000, 10000000]) {
+    let numbers = [];
+    for (let i = 0; i < size; i++) {
+        push(numbers, random() / 2147483647);
+    }
+    let start_time = now();
+    sort(numbers);
+    print(size, "numbers", now() - start_time, "secs");
+    numbers = null;
+    gc();
+    let strings = [];
+    for (let i = 0; i < size; i++) {
+        push(strings, random_string());
+        if (i % 1000000 == 0) {
+            gc(); // intermediate strings of concatenation
+        }
+    }
+    start_time = now();
+    sort(strings);
+    print(size, "strings", now() - start_time, "secs");
+    strings = null;
+    gc();
+}
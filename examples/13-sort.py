@@ -0,0 +1,13 @@
+import random
+import string
+import time
+
+for length in [1000000, 10000000]:
+    numbers = [random.random() for i in range(length)]
+    start_time = time.time()
+    numbers.sort()
+    print(length, "numbers", time.time() - start_time, "secs")
+    strings = ["".join(random.choices(string.ascii_lowercase, k=8)) for i in range(length)]
+    start_time = time.time()
+    strings.sort()
+    print(length, "strings", time.time() - start_time, "secs")
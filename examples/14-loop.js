@@ -0,0 +1,42 @@
+settimeout(function() { console.log("timeout 30"); }, 30);
+settimeout(function() { console.log("timeout 10"); }, 10);
+settimeout(function() { console.log("timeout 10 again"); }, 10);
+let cancelled = settimeout(function() { console.log("never"); }, 20);
+cleartimer(cancelled);
+let ticks = 0;
+let interval = setinterval(function() {
+    ticks += 1;
+    console.log("tick", ticks);
+    if (ticks == 3) {
+        cleartimer(interval);
+    }
+}, 5);
+let p = pipe();
+watch(p[0], function(fd) {
+    let s = fdread(fd);
+    if (s == null) {
+        console.log("pipe closed");
+        fdclose(fd);
+    } else {
+        console.log("pipe got", s, length(s));
+    }
+});
+settimeout(function() { fdwrite(p[1], "hello"); }, 15);
+settimeout(function() { fdclose(p[1]); }, 25);
+let sp = socketpair();
+watch(sp[1], function(fd) {
+    let s = fdread(fd);
+    if (s == null) {
+        fdclose(fd);
+    } else {
+        fdwrite(fd, "echo " + s);
+    }
+});
+watch(sp[0], function(fd) {
+    console.log(fdread(fd));
+    unwatch(fd);
+    fdclose(fd);
+});
+fdwrite(sp[0], "ping");
+console.log(fdread(p[0]) == "");
+console.log("main done");
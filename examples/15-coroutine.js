@@ -0,0 +1,47 @@
+function range(n) {
+    return coroutine(function() {
+        for (let i = 0; i < n; i += 1) {
+            yield(i);
+        }
+    });
+}
+
+function filter_even(src) {
+    return coroutine(function() {
+        for (let x of src) {
+            if (x % 2 == 0) {
+                yield(x);
+            }
+        }
+    });
+}
+
+function square(src) {
+    return coroutine(function() {
+        for (let x of src) {
+            yield(x * x);
+        }
+    });
+}
+
+// nothing is materialized, each stage is resumed by next one
+let total = 0;
+for (let x of square(filter_even(range(1000)))) {
+    total += x;
+}
+console.log(total);
+
+// values go both ways, and yield works in any depth of script calls
+let echo = coroutine(function(first) {
+    function inner(value) {
+        return yield(value);
+    }
+    let value = first;
+    while (value != null) {
+        value = inner("echo " + value);
+    }
+    return "bye";
+});
+console.log(resume(echo, "hello"), status(echo));
+console.log(resume(echo, "world"), status(echo));
+console.log(resume(echo, null), status(echo));
@@ -0,0 +1,12 @@
+// runs in worker, see 16-worker.js
+onmessage(parent, function(records) {
+    if (records == null) {
+        console.log("worker done");
+    } else {
+        let total = 0;
+        for (let r of records) {
+            total += r.price * r.quantity;
+        }
+        post(parent, { count: length(records), total: total });
+    }
+});
@@ -0,0 +1,32 @@
+let nworkers = 4;
+let workers = [];
+for (let i = 0; i < nworkers; i += 1) {
+    push(workers, spawn("16-worker-sum.js"));
+}
+let records = [];
+for (let i = 0; i < 100000; i += 1) {
+    push(records, { price: i % 100, quantity: i % 7 });
+}
+let chunk = 1000;
+let nchunks = 0;
+for (let i = 0; i < length(records); i += chunk) {
+    post(workers[nchunks % nworkers], slice(records, i, i + chunk));
+    nchunks += 1;
+}
+// every worker replies in order
+let count = 0;
+let total = 0;
+for (let i = 0; i < nchunks; i += 1) {
+    let reply = receive(workers[i % nworkers]);
+    count += reply.count;
+    total += reply.total;
+}
+let expected = 0;
+for (let r of records) {
+    expected += r.price * r.quantity;
+}
+console.log(count, total, expected);
+for (let w of workers) {
+    hangup(w);
+    console.log("worker exited", receive(w));
+}
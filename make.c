@@ -12,7 +12,7 @@ You should have received a copy of the GNU General Public License along with thi
 #include "../banana-nomake/src/make.h"
 
 #if os == posix
-    #define ex_libs "-lm -lreadline -lncurses -ltinfo"
+    #define ex_libs "-lm -lreadline -lncurses -ltinfo -lpthread"
 #else
     #define ex_libs ""
 #endif
@@ -33,15 +33,21 @@ void build() {
     if (mtime(o("js-std")) < mtime(c("js-std"), h("js-std"), h("js-vm"), h("js-data"), h("js-common"))) {
         cc_lib(o("js-std"), c("js-std"));
     }
-    if (mtime(o("js")) < mtime(c("js"), h("js-std"), h("js-syntax"), h("js-vm"), h("js-data"), h("js-common"))) {
+    if (mtime(o("js-loop")) < mtime(c("js-loop"), h("js-loop"), h("js-vm"), h("js-data"), h("js-common"))) {
+        cc_lib(o("js-loop"), c("js-loop"));
+    }
+    if (mtime(o("js-worker")) < mtime(c("js-worker"), h("js-worker"), h("js-loop"), h("js-std"), h("js-syntax"), h("js-vm"), h("js-data"), h("js-common"))) {
+        cc_lib(o("js-worker"), c("js-worker"));
+    }
+    if (mtime(o("js")) < mtime(c("js"), h("js-worker"), h("js-loop"), h("js-std"), h("js-syntax"), h("js-vm"), h("js-data"), h("js-common"))) {
         cc_exe(o("js"), c("js"));
     }
     await();
-    if (mtime(l("js")) < mtime(o("js-common"), o("js-data"), o("js-vm"), o("js-syntax"), o("js-std"))) {
+    if (mtime(l("js")) < mtime(o("js-common"), o("js-data"), o("js-vm"), o("js-syntax"), o("js-std"), o("js-loop"), o("js-worker"))) {
         if (shared) {
-            ld_lib(d("js"), o("js-common") " " o("js-data") " " o("js-vm") " " o("js-syntax") " " o("js-std"));
+            ld_lib(d("js"), o("js-common") " " o("js-data") " " o("js-vm") " " o("js-syntax") " " o("js-std") " " o("js-loop") " " o("js-worker"));
         } else {
-            ld_lib(l("js"), o("js-common") " " o("js-data") " " o("js-vm") " " o("js-syntax") " " o("js-std"));
+            ld_lib(l("js"), o("js-common") " " o("js-data") " " o("js-vm") " " o("js-syntax") " " o("js-std") " " o("js-loop") " " o("js-worker"));
         }
     }
     await();
@@ -11,6 +11,16 @@ You should have received a copy of the GNU General Public License along with thi
 #include <ctype.h>
 #include <float.h>
 #include <math.h>
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <pthread.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 #include "js-common.h"
 
 void print_hex(void *base, size_t length) {
@@ -138,6 +148,581 @@ int string_natural_compare_sz(const char *x, const char *y) {
     return lx > ly ? 1 : -1;
 }
 
+size_t virtual_page_size() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (size_t)info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+void *virtual_reserve(size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    void *base = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return base == MAP_FAILED ? NULL : base;
+#endif
+}
+
+bool virtual_commit(void *base, size_t size) {
+#ifdef _WIN32
+    return VirtualAlloc(base, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+    return mprotect(base, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void virtual_release(void *base, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, size);
+#endif
+}
+
+char *file_map(const char *fname, size_t *length) {
+    size_t page = virtual_page_size();
+#ifdef _WIN32
+    // view can't be followed by reserved page, so exact multiple of page size is not supported
+    HANDLE file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return NULL;
+    }
+    LARGE_INTEGER size;
+    char *base = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 && size.QuadPart % page != 0) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            base = (char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); // view keeps it
+        }
+    }
+    CloseHandle(file);
+    if (base) {
+        *length = (size_t)size.QuadPart;
+    }
+    return base;
+#else
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    // reserve one more page, rest of last page and whole reserved page are zero
+    size_t size = (size_t)st.st_size;
+    char *base = mmap(NULL, size / page * page + page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    if (mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, size / page * page + page);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    *length = size;
+    return base;
+#endif
+}
+
+void file_unmap(char *base, size_t length) {
+#ifdef _WIN32
+    (void)length;
+    UnmapViewOfFile(base);
+#else
+    size_t page = virtual_page_size();
+    munmap(base, length / page * page + page);
+#endif
+}
+
+FILE *file_open_regular(const char *fname) {
+    FILE *fp = fopen(fname, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+#ifndef _WIN32
+    // fopen() succeeds on directories
+    struct stat st;
+    int error = fstat(fileno(fp), &st) != 0 ? errno : S_ISREG(st.st_mode) ? 0
+                                                   : S_ISDIR(st.st_mode) ? EISDIR
+                                                                         : EINVAL;
+    if (error != 0) {
+        fclose(fp);
+        errno = error;
+        return NULL;
+    }
+#endif
+    return fp;
+}
+
+struct _thread {
+    void *(*function)(void *);
+    void *argument;
+    void *result;
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+#ifdef _WIN32
+static DWORD WINAPI _thread_entry(LPVOID argument) {
+    struct _thread *thread = (struct _thread *)argument;
+    thread->result = thread->function(thread->argument);
+    return 0;
+}
+#endif
+
+size_t thread_processors() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (size_t)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t)n : 1;
+#endif
+}
+
+void *thread_start(void *(*function)(void *), void *argument) {
+    struct _thread *thread = alloc(struct _thread, 1);
+    thread->function = function;
+    thread->argument = argument;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, _thread_entry, thread, 0, NULL);
+    if (thread->handle == NULL) {
+#else
+    if (pthread_create(&(thread->handle), NULL, function, argument) != 0) {
+#endif
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void *thread_join(void *handle) {
+    struct _thread *thread = (struct _thread *)handle;
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, &(thread->result));
+#endif
+    void *result = thread->result;
+    free(thread);
+    return result;
+}
+
+void thread_detach(void *handle) {
+    struct _thread *thread = (struct _thread *)handle;
+#ifdef _WIN32
+    // _thread_entry still writes result, so leak it, it is tiny
+    CloseHandle(thread->handle);
+#else
+    pthread_detach(thread->handle);
+    free(thread);
+#endif
+}
+
+void *mutex_new() {
+#ifdef _WIN32
+    SRWLOCK *mutex = alloc(SRWLOCK, 1);
+    InitializeSRWLock(mutex);
+#else
+    pthread_mutex_t *mutex = alloc(pthread_mutex_t, 1);
+    pthread_mutex_init(mutex, NULL);
+#endif
+    return mutex;
+}
+
+void mutex_free(void *mutex) {
+#ifndef _WIN32
+    pthread_mutex_destroy((pthread_mutex_t *)mutex);
+#endif
+    free(mutex);
+}
+
+void mutex_lock(void *mutex) {
+#ifdef _WIN32
+    AcquireSRWLockExclusive((SRWLOCK *)mutex);
+#else
+    pthread_mutex_lock((pthread_mutex_t *)mutex);
+#endif
+}
+
+void mutex_unlock(void *mutex) {
+#ifdef _WIN32
+    ReleaseSRWLockExclusive((SRWLOCK *)mutex);
+#else
+    pthread_mutex_unlock((pthread_mutex_t *)mutex);
+#endif
+}
+
+void *condition_new() {
+#ifdef _WIN32
+    CONDITION_VARIABLE *condition = alloc(CONDITION_VARIABLE, 1);
+    InitializeConditionVariable(condition);
+#else
+    pthread_cond_t *condition = alloc(pthread_cond_t, 1);
+    pthread_cond_init(condition, NULL);
+#endif
+    return condition;
+}
+
+void condition_free(void *condition) {
+#ifndef _WIN32
+    pthread_cond_destroy((pthread_cond_t *)condition);
+#endif
+    free(condition);
+}
+
+void condition_wait(void *condition, void *mutex) {
+#ifdef _WIN32
+    SleepConditionVariableSRW((CONDITION_VARIABLE *)condition, (SRWLOCK *)mutex, INFINITE, 0);
+#else
+    pthread_cond_wait((pthread_cond_t *)condition, (pthread_mutex_t *)mutex);
+#endif
+}
+
+void condition_broadcast(void *condition) {
+#ifdef _WIN32
+    WakeAllConditionVariable((CONDITION_VARIABLE *)condition);
+#else
+    pthread_cond_broadcast((pthread_cond_t *)condition);
+#endif
+}
+
+#ifdef _MSC_VER
+// interlocked functions are full barriers, stronger than required
+
+void *atomic_load_pointer(void *volatile *pointer) {
+    return InterlockedCompareExchangePointer(pointer, NULL, NULL);
+}
+
+void atomic_store_pointer(void *volatile *pointer, void *value) {
+    InterlockedExchangePointer(pointer, value);
+}
+
+long atomic_load_long(volatile long *pointer) {
+    return InterlockedCompareExchange(pointer, 0, 0);
+}
+
+void atomic_store_long(volatile long *pointer, long value) {
+    InterlockedExchange(pointer, value);
+}
+
+long atomic_add_long(volatile long *pointer, long value) {
+    return InterlockedAdd(pointer, value);
+}
+
+void atomic_fence() {
+    MemoryBarrier();
+}
+
+#else
+
+void *atomic_load_pointer(void *volatile *pointer) {
+    return __atomic_load_n(pointer, __ATOMIC_ACQUIRE);
+}
+
+void atomic_store_pointer(void *volatile *pointer, void *value) {
+    __atomic_store_n(pointer, value, __ATOMIC_RELEASE);
+}
+
+long atomic_load_long(volatile long *pointer) {
+    return __atomic_load_n(pointer, __ATOMIC_ACQUIRE);
+}
+
+void atomic_store_long(volatile long *pointer, long value) {
+    __atomic_store_n(pointer, value, __ATOMIC_RELEASE);
+}
+
+long atomic_add_long(volatile long *pointer, long value) {
+    return __atomic_add_fetch(pointer, value, __ATOMIC_SEQ_CST);
+}
+
+void atomic_fence() {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#endif
+
+// work stealing pool, every thread owns a deque, takes newest task from its bottom, and steals oldest task from top of others
+// tasks submitted from outside pool go to an extra shared deque, which is always stolen
+// locks are per deque, so threads rarely contend, only sleeping and lifecycle use pool lock
+// threads and deques are changed only while no one holds reference, and never while stopping, so holders and pool threads read them without lock
+
+struct _pool_task {
+    void (*function)(void *);
+    void *argument;
+    volatile long done;
+};
+
+struct _pool_deque {
+    void *mutex;
+    struct _pool_task **base;
+    size_t length;
+    size_t capacity;
+    size_t top; // tasks before top are already stolen
+};
+
+#ifdef _MSC_VER
+    #define _thread_local __declspec(thread)
+#else
+    #define _thread_local _Thread_local
+#endif
+
+static _thread_local long _pool_self = -1; // deque index of current pool thread
+#ifdef _WIN32
+static SRWLOCK _pool_mutex = SRWLOCK_INIT;
+static CONDITION_VARIABLE _pool_condition = CONDITION_VARIABLE_INIT;
+#else
+static pthread_mutex_t _pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _pool_condition = PTHREAD_COND_INITIALIZER;
+#endif
+
+static struct {
+    size_t size; // configured, 0 means default
+    long references;
+    volatile long count; // running threads, set after deques, so that 0 means not started
+    void **threads;
+    struct _pool_deque *deques; // count + 1, last one is for outside
+    volatile long pending; // tasks in deques
+    volatile long sleepers;
+    volatile long stopping; // threads are being joined by last release, acquire waits for it
+} _pool;
+
+static void _pool_deque_push(struct _pool_deque *deque, struct _pool_task *task) {
+    mutex_lock(deque->mutex);
+    if (deque->top > 0 && deque->length == deque->capacity) {
+        memmove(deque->base, deque->base + deque->top, (deque->length - deque->top) * sizeof(struct _pool_task *));
+        deque->length -= deque->top;
+        deque->top = 0;
+    }
+    buffer_push(deque->base, deque->length, deque->capacity, task);
+    mutex_unlock(deque->mutex);
+}
+
+static struct _pool_task *_pool_deque_take(struct _pool_deque *deque, bool steal) {
+    struct _pool_task *task = NULL;
+    mutex_lock(deque->mutex);
+    if (deque->top < deque->length) {
+        task = steal ? deque->base[deque->top++] : deque->base[--deque->length];
+        if (deque->top == deque->length) {
+            deque->top = deque->length = 0;
+        }
+    }
+    mutex_unlock(deque->mutex);
+    return task;
+}
+
+// own deque first, then steal from others starting from next one
+static struct _pool_task *_pool_take() {
+    if (atomic_load_long(&(_pool.pending)) == 0) {
+        return NULL;
+    }
+    size_t count = (size_t)atomic_load_long(&(_pool.count));
+    size_t num_deques = count + 1;
+    size_t start = _pool_self >= 0 ? (size_t)_pool_self : count;
+    struct _pool_task *task = _pool_self >= 0 ? _pool_deque_take(_pool.deques + start, false) : NULL;
+    for (size_t i = 1; task == NULL && i <= num_deques; i++) {
+        task = _pool_deque_take(_pool.deques + (start + i) % num_deques, true);
+    }
+    if (task) {
+        atomic_add_long(&(_pool.pending), -1);
+    }
+    return task;
+}
+
+static void _pool_wake() {
+    // pairs with fence in _pool_sleep(), either waker sees sleepers, or sleeper sees new state
+    atomic_fence();
+    if (atomic_load_long(&(_pool.sleepers)) > 0) {
+        mutex_lock(&_pool_mutex);
+        condition_broadcast(&_pool_condition);
+        mutex_unlock(&_pool_mutex);
+    }
+}
+
+static void _pool_run(struct _pool_task *task) {
+    task->function(task->argument);
+    atomic_store_long(&(task->done), 1);
+    _pool_wake();
+}
+
+// sleeps until there are pending tasks, or given task is done, or pool is stopping
+static void _pool_sleep(struct _pool_task *task) {
+    mutex_lock(&_pool_mutex);
+    atomic_add_long(&(_pool.sleepers), 1);
+    while (atomic_load_long(&(_pool.pending)) == 0 && !(task && atomic_load_long(&(task->done))) && !atomic_load_long(&(_pool.stopping))) {
+        condition_wait(&_pool_condition, &_pool_mutex);
+    }
+    atomic_add_long(&(_pool.sleepers), -1);
+    mutex_unlock(&_pool_mutex);
+}
+
+static void *_pool_main(void *argument) {
+    _pool_self = (long)(size_t)argument;
+    while (!atomic_load_long(&(_pool.stopping))) {
+        struct _pool_task *task = _pool_take();
+        if (task) {
+            _pool_run(task);
+        } else {
+            _pool_sleep(NULL);
+        }
+    }
+    return NULL;
+}
+
+void pool_configure(size_t size) {
+    _pool.size = size;
+}
+
+size_t pool_threads() {
+    size_t count = (size_t)atomic_load_long(&(_pool.count));
+    if (count > 0) {
+        return count;
+    } else if (_pool.size > 0) {
+        return _pool.size;
+    }
+    const char *env = getenv("JS_THREADS");
+    long size = env ? atol(env) : 0;
+    return size > 0 ? (size_t)size : thread_processors();
+}
+
+void pool_acquire() {
+    mutex_lock(&_pool_mutex);
+    // threads of last release are still being joined, rebuilding now would corrupt them
+    while (_pool.stopping) {
+        condition_wait(&_pool_condition, &_pool_mutex);
+    }
+    if (_pool.references++ == 0) {
+        size_t size = pool_threads();
+        _pool.deques = alloc(struct _pool_deque, size + 1);
+        for (size_t i = 0; i <= size; i++) {
+            _pool.deques[i].mutex = mutex_new();
+        }
+        _pool.threads = alloc(void *, size);
+        // set before threads start, they read it
+        atomic_store_long(&(_pool.count), (long)size);
+        for (size_t i = 0; i < size; i++) {
+            _pool.threads[i] = thread_start(_pool_main, (void *)i);
+            enforce(_pool.threads[i] != NULL);
+        }
+    }
+    mutex_unlock(&_pool_mutex);
+}
+
+void pool_release() {
+    mutex_lock(&_pool_mutex);
+    enforce(_pool.references > 0);
+    if (--_pool.references == 0) {
+        atomic_store_long(&(_pool.stopping), 1);
+        condition_broadcast(&_pool_condition);
+        // joined without lock, so that stopping threads can leave _pool_sleep(), pool is untouched meanwhile because acquire waits
+        mutex_unlock(&_pool_mutex);
+        size_t count = (size_t)_pool.count;
+        for (size_t i = 0; i < count; i++) {
+            thread_join(_pool.threads[i]);
+        }
+        mutex_lock(&_pool_mutex);
+        // all submitted tasks must have been joined by now
+        enforce(_pool.pending == 0);
+        atomic_store_long(&(_pool.count), 0);
+        for (size_t i = 0; i <= count; i++) {
+            buffer_free(_pool.deques[i].base, _pool.deques[i].length, _pool.deques[i].capacity);
+            mutex_free(_pool.deques[i].mutex);
+        }
+        free(_pool.deques);
+        free(_pool.threads);
+        _pool.deques = NULL;
+        _pool.threads = NULL;
+        atomic_store_long(&(_pool.stopping), 0);
+        // waiting acquires
+        condition_broadcast(&_pool_condition);
+    }
+    mutex_unlock(&_pool_mutex);
+}
+
+void *pool_submit(void (*function)(void *), void *argument) {
+    struct _pool_task *task = alloc(struct _pool_task, 1);
+    task->function = function;
+    task->argument = argument;
+    size_t count = (size_t)atomic_load_long(&(_pool.count));
+    if (count == 0) {
+        // not acquired, or configured with no threads
+        _pool_run(task);
+        return task;
+    }
+    _pool_deque_push(_pool.deques + (_pool_self >= 0 ? (size_t)_pool_self : count), task);
+    atomic_add_long(&(_pool.pending), 1);
+    _pool_wake();
+    return task;
+}
+
+void pool_join(void *handle) {
+    struct _pool_task *task = (struct _pool_task *)handle;
+    while (!atomic_load_long(&(task->done))) {
+        struct _pool_task *other = _pool_take();
+        if (other) {
+            _pool_run(other);
+        } else {
+            _pool_sleep(task);
+        }
+    }
+    free(task);
+}
+
+struct _pool_range {
+    void (*function)(size_t, size_t, void *);
+    void *argument;
+    size_t begin;
+    size_t end;
+};
+
+static void _pool_range_run(void *argument) {
+    struct _pool_range *range = (struct _pool_range *)argument;
+    range->function(range->begin, range->end, range->argument);
+}
+
+void pool_parallel_for(size_t begin, size_t end, size_t grain, void (*function)(size_t, size_t, void *), void *argument) {
+    if (end <= begin) {
+        return;
+    }
+    size_t length = end - begin;
+    grain = max(grain, 1);
+    // a few more pieces than threads, so that stealing can balance uneven ones
+    size_t count = min((length + grain - 1) / grain, ((size_t)atomic_load_long(&(_pool.count)) + 1) * 4);
+    if (count <= 1) {
+        function(begin, end, argument);
+        return;
+    }
+    struct _pool_range *ranges = alloc(struct _pool_range, count);
+    void **tasks = alloc(void *, count);
+    for (size_t i = 0; i < count; i++) {
+        ranges[i] = (struct _pool_range){function, argument, begin + length * i / count, begin + length * (i + 1) / count};
+    }
+    for (size_t i = 1; i < count; i++) {
+        tasks[i] = pool_submit(_pool_range_run, ranges + i);
+    }
+    _pool_range_run(ranges);
+    for (size_t i = 1; i < count; i++) {
+        pool_join(tasks[i]);
+    }
+    free(tasks);
+    free(ranges);
+}
+
 #ifdef DEBUG
 
 char *random_sz_static(size_t *plen) {
@@ -388,4 +973,47 @@ void test_natural_compare() {
     }
 }
 
+static void _test_pool_add(size_t begin, size_t end, void *argument) {
+    atomic_add_long((volatile long *)argument, (long)(end - begin));
+}
+
+// rounds of different threads overlap, so that last release and first acquire race
+static void *_test_pool_rounds(void *argument) {
+    (void)argument;
+    for (int round = 0; round < 40; round++) {
+        pool_acquire();
+        volatile long sum = 0;
+        pool_parallel_for(0, 10000, 100, _test_pool_add, (void *)&sum);
+        enforce(sum == 10000);
+        pool_release();
+    }
+    return NULL;
+}
+
+void test_pool() {
+    pool_configure(4);
+    // nested, threads are kept until last release
+    volatile long sum = 0;
+    pool_acquire();
+    pool_acquire();
+    pool_parallel_for(0, 1000, 10, _test_pool_add, (void *)&sum);
+    pool_release();
+    enforce(pool_threads() == 4 && _pool.count == 4);
+    pool_parallel_for(0, 1000, 10, _test_pool_add, (void *)&sum);
+    pool_release();
+    enforce(sum == 2000 && _pool.count == 0);
+    // concurrent
+    void *threads[6];
+    for (size_t i = 0; i < countof(threads); i++) {
+        threads[i] = thread_start(_test_pool_rounds, NULL);
+        enforce(threads[i] != NULL);
+    }
+    for (size_t i = 0; i < countof(threads); i++) {
+        thread_join(threads[i]);
+    }
+    enforce(_pool.references == 0 && _pool.count == 0 && _pool.deques == NULL);
+    pool_configure(0);
+    puts("pool ok");
+}
+
 #endif
\ No newline at end of file
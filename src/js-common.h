@@ -291,6 +291,32 @@ void qsort_r(void *, size_t, size_t, int (*)(const void *, const void *, void *)
         fclose(__fp); \
     } while (0)
 
+// same as read_binary_file() but never fatal, for files named at runtime, content is followed by zero, __arg_ok is false with errno set if failed
+#define try_read_file(__arg_fname, __arg_base, __arg_length, __arg_capacity, __arg_ok) \
+    do { \
+        enforce(sizeof(*(__arg_base)) == 1); \
+        (__arg_ok) = false; \
+        FILE *__fp = file_open_regular(__arg_fname); \
+        if (__fp == NULL) { \
+            break; \
+        } \
+        long __fsize = fseek(__fp, 0, SEEK_END) == 0 ? ftell(__fp) : -1; \
+        if (__fsize >= 0 && (uint64_t)__fsize >= ((typeof(__arg_capacity))-1 >> 1) - (__arg_length)) { /* capacity is pow of 2 */ \
+            errno = EFBIG; \
+        } else if (__fsize >= 0 && fseek(__fp, 0, SEEK_SET) == 0) { \
+            buffer_alloc(__arg_base, __arg_length, __arg_capacity, (__arg_length) + (typeof(__arg_length))__fsize + 1); \
+            (__arg_length) += (typeof(__arg_length))fread((__arg_base) + (__arg_length), 1, (size_t)__fsize, __fp); \
+            if (ferror(__fp)) { \
+                errno = EIO; \
+            } else { \
+                (__arg_ok) = true; \
+            } \
+        } \
+        int __error = errno; \
+        fclose(__fp); \
+        errno = __error; \
+    } while (0)
+
 #define write_file(__arg_fname, __arg_mode, __arg_base, __arg_length, __arg_capacity) \
     do { \
         FILE *__fp = fopen(__arg_fname, __arg_mode); \
@@ -301,20 +327,33 @@ void qsort_r(void *, size_t, size_t, int (*)(const void *, const void *, void *)
         fclose(__fp); \
     } while (0)
 
+// stdio's getc without locking, much faster than fgetc, don't share FILE between threads
+#ifdef _WIN32
+    #define getc_fast _getc_nolock
+#else
+    #define getc_fast getc_unlocked
+#endif
+
+// newline is not included, characters are collected into chunk before appended
 #define read_line(__arg_fp, __arg_base, __arg_length, __arg_capacity) \
     do { \
         /* __arg_base may not be NULL, js_string is always not NULL */ \
         enforce(__arg_length == 0); \
         /* __arg_capacity may not be 0 too */ \
+        char __chunk[256]; \
+        size_t __n = 0; \
         for (;;) { \
-            /* DON'T use __ch, 'warning C4700: uninitialized local variable '__ch' used' */ \
-            /* string_buffer_append_ch will be expanded '__ch = __ch' */ \
-            int __c = fgetc(__arg_fp); \
+            int __c = getc_fast(__arg_fp); \
             if (__c == EOF || __c == '\n') { \
                 break; \
             } \
-            string_buffer_append_ch(__arg_base, __arg_length, __arg_capacity, __c); \
+            __chunk[__n++] = (char)__c; \
+            if (__n == sizeof(__chunk)) { \
+                string_buffer_append(__arg_base, __arg_length, __arg_capacity, __chunk, __n); \
+                __n = 0; \
+            } \
         } \
+        string_buffer_append(__arg_base, __arg_length, __arg_capacity, __chunk, __n); \
     } while (0)
 
 #ifndef numargs
@@ -339,6 +378,46 @@ shared char *string_join_internal_sz(const char *, size_t, ...);
 #define string_join_sz(__arg_0, ...) string_join_internal_sz(__arg_0, numargs(__VA_ARGS__), ##__VA_ARGS__)
 #define string_concat_sz(...) string_join_sz("", ##__VA_ARGS__)
 shared int string_natural_compare_sz(const char *, const char *);
+// reserve address space first and commit pages on demand, so that content never moves while growing
+// uncommitted pages are inaccessible, leave last page uncommitted as guard page
+shared size_t virtual_page_size();
+shared void *virtual_reserve(size_t);
+shared bool virtual_commit(void *, size_t);
+shared void virtual_release(void *, size_t);
+// map whole file read only, content is always followed by zero, so that it is also c string, NULL if failed or empty
+shared char *file_map(const char *, size_t *);
+shared void file_unmap(char *, size_t);
+shared FILE *file_open_regular(const char *); // binary read only, NULL with errno set if failed or not regular file
+// native threads for pure c work, they must never touch vm of other threads
+shared size_t thread_processors();
+shared void *thread_start(void *(*)(void *), void *); // NULL if failed
+shared void *thread_join(void *); // returns thread function's result
+shared void thread_detach(void *); // result is discarded, handle is invalid after it
+shared void *mutex_new();
+shared void mutex_free(void *);
+shared void mutex_lock(void *);
+shared void mutex_unlock(void *);
+shared void *condition_new();
+shared void condition_free(void *);
+shared void condition_wait(void *, void *); // condition, locked mutex
+shared void condition_broadcast(void *);
+// atomics, loads are acquire, stores are release, add and fence are sequentially consistent
+shared void *atomic_load_pointer(void *volatile *);
+shared void atomic_store_pointer(void *volatile *, void *);
+shared long atomic_load_long(volatile long *);
+shared void atomic_store_long(volatile long *, long);
+shared long atomic_add_long(volatile long *, long); // returns new value
+shared void atomic_fence();
+// one work stealing thread pool for pure c work of whole process, tasks must never touch vm
+// threads are started by first acquire and stopped by last release, all submitted tasks must be joined before that, acquire meanwhile waits until stopped
+// submitting thread must hold a reference, or pool must not be started by anyone, with no threads tasks run in place when submitted
+shared void pool_configure(size_t); // threads of next start, 0 means default, which is JS_THREADS environment variable or number of processors
+shared size_t pool_threads();
+shared void pool_acquire();
+shared void pool_release();
+shared void *pool_submit(void (*)(void *), void *); // returns task for pool_join()
+shared void pool_join(void *); // runs other tasks while waiting, task is freed after it
+shared void pool_parallel_for(size_t, size_t, size_t, void (*)(size_t, size_t, void *), void *); // begin, end, grain, function(begin, end, argument), argument
 
 #ifdef DEBUG
 
@@ -356,6 +435,7 @@ shared void test_string_dupe();
 shared void test_read_file();
 shared void test_read_line();
 shared void test_natural_compare();
+shared void test_pool();
 
 #endif
 
@@ -8,6 +8,7 @@ This program is distributed in the hope that it will be useful, but WITHOUT ANY
 You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <math.h> // fmod, trunc, isfinite
 #include "js-data.h"
 
 #define X(name) #name,
@@ -23,9 +24,9 @@ void js_map_dump(struct js_kv_pair *base, size_t length, size_t capacity) {
     }
 }
 
-static size_t _first_hash(const char *string, uint16_t length, size_t mask) {
+static size_t _first_hash(const char *string, uint32_t length, size_t mask) {
     size_t hash = 0;
-    for (uint16_t i = 0; i < length; i++) {
+    for (uint32_t i = 0; i < length; i++) {
         hash = (hash + (hash << 4) + string[i]) & mask;
     }
     return hash;
@@ -37,7 +38,7 @@ static size_t _next_hash(size_t hash, size_t mask) {
     return (hash + (hash << 4) + 1) & mask;
 }
 
-static struct js_kv_pair *_find_empty(struct js_kv_pair *base, size_t capacity, const char *key, uint16_t key_length) {
+static struct js_kv_pair *_find_empty(struct js_kv_pair *base, size_t capacity, const char *key, uint32_t key_length) {
     size_t mask = capacity - 1;
     for (size_t repeat = 0, hash = _first_hash(key, key_length, mask); repeat < capacity; repeat++, hash = _next_hash(hash, mask)) {
         struct js_kv_pair *node = base + hash;
@@ -50,7 +51,7 @@ static struct js_kv_pair *_find_empty(struct js_kv_pair *base, size_t capacity,
 }
 
 // BUG: Stage 2 should also check rehash
-// void js_map_put(struct js_kv_pair **base, size_t *length, size_t *capacity, const char *key, uint16_t key_length, struct js_value value) {
+// void js_map_put(struct js_kv_pair **base, size_t *length, size_t *capacity, const char *key, uint32_t key_length, struct js_value value) {
 //     // js_map_dump(*base, *length, *capacity);
 //     // printf("key=%.*s, value=%s\n", key_length, key, _value_type_names[value.type]);
 //     bool next_stage = false;
@@ -155,7 +156,7 @@ static struct js_kv_pair *_find_empty(struct js_kv_pair *base, size_t capacity,
 // }
 
 // BUGFIX: always check rehash
-void js_map_put_internal(struct js_kv_pair **base, size_t *length, size_t *capacity, const char *key, uint16_t key_length, struct js_value value) {
+void js_map_put_internal(struct js_kv_pair **base, size_t *length, size_t *capacity, const char *key, uint32_t key_length, struct js_value value) {
     // js_map_dump(*base, *length, *capacity);
     // printf("key=%.*s, value=%s\n", key_length, key, _value_type_names[value.type]);
     bool next_stage = false;
@@ -260,11 +261,11 @@ check_rehash:
 }
 
 // void js_map_put_sz(struct js_kv_pair **base, size_t *length, size_t *capacity, const char *key, struct js_value value) {
-//     js_map_put(base, length, capacity, key, (uint16_t)strlen(key), value);
+//     js_map_put(base, length, capacity, key, (uint32_t)strlen(key), value);
 // }
 
 // v can be NULL
-struct js_value js_map_get(struct js_kv_pair *base, size_t length, size_t capacity, const char *key, uint16_t key_length) {
+struct js_value js_map_get(struct js_kv_pair *base, size_t length, size_t capacity, const char *key, uint32_t key_length) {
     size_t mask = capacity - 1;
     size_t hash;
     size_t repeat;
@@ -284,7 +285,7 @@ struct js_value js_map_get(struct js_kv_pair *base, size_t length, size_t capaci
 }
 
 struct js_value js_map_get_sz(struct js_kv_pair *base, size_t length, size_t capacity, const char *key) {
-    return js_map_get(base, length, capacity, key, (uint16_t)strlen(key));
+    return js_map_get(base, length, capacity, key, (uint32_t)strlen(key));
 }
 
 // void js_map_free_internal(struct js_kv_pair **base, size_t *length, size_t *capacity) {
@@ -331,6 +332,18 @@ struct js_value js_string_sz(struct js_heap *heap, const char *str) {
     return js_string(heap, str, strlen(str));
 }
 
+// zero copy, content must never be modified
+struct js_value js_mapped_string(struct js_heap *heap, char *base, size_t length) {
+    struct js_value ret = {.type = vt_string};
+    ret.managed = alloc(struct js_managed_value, 1);
+    ret.managed->type = vt_string;
+    ret.managed->string.base = base;
+    ret.managed->string.length = length;
+    ret.managed->string.capacity = SIZE_MAX;
+    buffer_push(heap->base, heap->length, heap->capacity, ret.managed);
+    return ret;
+}
+
 struct js_value js_string_f(struct js_heap *heap, const char *fmt, ...) {
     struct js_value ret = {.type = vt_string};
     ret.managed = alloc(struct js_managed_value, 1);
@@ -343,6 +356,143 @@ struct js_value js_string_f(struct js_heap *heap, const char *fmt, ...) {
     return ret;
 }
 
+// value tables are used by hashmap, hashset and sparse array, same hash and probe sequence as js_map
+// numbers hash bit pattern, strings hash content, others hash identity
+static size_t _value_first_hash(struct js_value *key, size_t mask) {
+    switch (key->type) {
+    case vt_scripture:
+    case vt_string:
+        return _first_hash(js_string_base(key), (uint32_t)js_string_length(key), mask);
+    case vt_number: {
+        // +0 -0 and all nans must be same key
+        double number = key->number == 0 ? 0 : isnan(key->number) ? NAN : key->number;
+        return _first_hash((const char *)&number, sizeof(number), mask);
+    }
+    case vt_boolean:
+        return key->boolean & mask;
+    case vt_c_function:
+        return _first_hash((const char *)&(key->c_function), sizeof(key->c_function), mask);
+    default:
+        return _first_hash((const char *)&(key->managed), sizeof(key->managed), mask);
+    }
+}
+
+// same rule as '==', except nan equals nan
+static bool _value_key_equal(struct js_value *lhs, struct js_value *rhs) {
+    if (js_is_string(lhs) && js_is_string(rhs)) {
+        return js_string_compare(lhs, rhs) == 0;
+    } else if (lhs->type != rhs->type) {
+        return false;
+    }
+    switch (lhs->type) {
+    case vt_number:
+        return lhs->number == rhs->number || (isnan(lhs->number) && isnan(rhs->number));
+    case vt_boolean:
+        return lhs->boolean == rhs->boolean;
+    case vt_c_function:
+        return lhs->c_function == rhs->c_function;
+    default:
+        return lhs->managed == rhs->managed;
+    }
+}
+
+// empty slot has key vt_undefined, deleted slot keeps key and has value vt_undefined, just like js_map
+static void _value_table_put(struct js_value_table *table, struct js_value key, struct js_value value) {
+    if (key.type == vt_undefined || key.type == vt_null) {
+        return;
+    }
+    if (value.type == vt_null) {
+        value = (struct js_value){0};
+    }
+    if (table->capacity == 0) {
+        if (value.type == vt_undefined) {
+            return;
+        }
+        buffer_alloc(table->base, table->length, table->capacity, 2);
+    }
+    size_t mask = table->capacity - 1;
+    struct js_value_pair *recorded = NULL; // first deleted slot
+    struct js_value_pair *node = NULL;
+    for (size_t repeat = 0, hash = _value_first_hash(&key, mask); repeat < table->capacity; repeat++, hash = _next_hash(hash, mask)) {
+        node = table->base + hash;
+        if (node->key.type == vt_undefined) {
+            break;
+        } else if (_value_key_equal(&(node->key), &key)) {
+            if (node->value.type != vt_undefined && value.type == vt_undefined) {
+                table->length--;
+            } else if (node->value.type == vt_undefined && value.type != vt_undefined) {
+                table->length++;
+            }
+            node->value = value;
+            goto check_rehash;
+        } else if (node->value.type == vt_undefined && recorded == NULL) {
+            recorded = node;
+        }
+        node = NULL;
+    }
+    if (value.type == vt_undefined) {
+        return;
+    }
+    if (recorded) {
+        node = recorded;
+    }
+    enforce(node != NULL);
+    node->key = key;
+    node->value = value;
+    table->length++;
+check_rehash:
+    size_t reqcap = table->length << 1;
+    if (table->capacity < reqcap) {
+        struct js_value_pair *newbase = NULL;
+        size_t newlen = 0;
+        size_t newcap = 0;
+        buffer_alloc(newbase, newlen, newcap, reqcap);
+        mask = newcap - 1;
+        buffer_for_each(table->base, table->capacity, _, i, v, {
+            (void)i;
+            if (v->key.type != vt_undefined && v->value.type != vt_undefined) {
+                size_t hash = _value_first_hash(&(v->key), mask);
+                while (newbase[hash].key.type != vt_undefined) {
+                    hash = _next_hash(hash, mask);
+                }
+                newbase[hash] = *v;
+                newlen++;
+            }
+        });
+        free(table->base);
+        table->base = newbase;
+        table->length = newlen;
+        table->capacity = newcap;
+    }
+}
+
+// returns vt_undefined if not found
+static struct js_value _value_table_get(struct js_value_table *table, struct js_value key) {
+    if (table->capacity == 0) {
+        return (struct js_value){0};
+    }
+    size_t mask = table->capacity - 1;
+    for (size_t repeat = 0, hash = _value_first_hash(&key, mask); repeat < table->capacity; repeat++, hash = _next_hash(hash, mask)) {
+        struct js_value_pair *node = table->base + hash;
+        if (node->key.type == vt_undefined) {
+            break;
+        } else if (_value_key_equal(&(node->key), &key)) {
+            return node->value;
+        }
+    }
+    return (struct js_value){0};
+}
+
+static void _value_table_mark(struct js_value_table *table) {
+    buffer_for_each(table->base, table->capacity, _, i, v, {
+        (void)i;
+        if (v->value.type != vt_undefined) {
+            js_mark(&(v->key));
+            js_mark(&(v->value));
+        }
+    });
+}
+
 struct js_value js_array(struct js_heap *heap) {
     struct js_value ret = {.type = vt_array};
     ret.managed = alloc(struct js_managed_value, 1);
@@ -351,29 +501,510 @@ struct js_value js_array(struct js_heap *heap) {
     return ret;
 }
 
+// dense storage may have free slots before base for O(1) front removal and insertion
+// real allocation starts at base - head, capacity counts from base
+static size_t _array_element_size(struct js_managed_value *managed) {
+    return managed->array.kind == ak_number ? sizeof(double) : sizeof(struct js_value);
+}
+
+static char *_array_storage(struct js_managed_value *managed) {
+    return managed->array.base ? (char *)managed->array.base - managed->array.head * _array_element_size(managed) : NULL;
+}
+
+static void _array_storage_free(struct js_managed_value *managed) {
+    free(_array_storage(managed));
+    managed->array.base = NULL;
+    managed->array.length = 0;
+    managed->array.capacity = 0;
+    managed->array.head = 0;
+}
+
+// same growing rule as buffer_alloc, newly allocated space is zero filled
+static void _array_reserve(struct js_managed_value *managed, size_t required) {
+    if (required <= managed->array.capacity) {
+        return;
+    }
+    size_t size = _array_element_size(managed);
+    char *storage = _array_storage(managed);
+    size_t total = managed->array.head + managed->array.capacity;
+    if (managed->array.head >= managed->array.length && total >= required) {
+        // front space is large enough, move back instead of growing
+        memmove(storage, managed->array.base, managed->array.length * size);
+        memset(storage + managed->array.length * size, 0, (total - managed->array.length) * size);
+        managed->array.base = (struct js_value *)storage;
+        managed->array.capacity = total;
+        managed->array.head = 0;
+        return;
+    }
+    size_t newcap = managed->array.capacity == 0 ? 1 : managed->array.capacity;
+    while (newcap < required) {
+        newcap <<= 1;
+        enforce(newcap > 0);
+    }
+    storage = (char *)realloc(storage, (managed->array.head + newcap) * size);
+    enforce(storage != NULL);
+    memset(storage + total * size, 0, (newcap - managed->array.capacity) * size);
+    managed->array.base = (struct js_value *)(storage + managed->array.head * size);
+    managed->array.capacity = newcap;
+}
+
+// make sure at least 'required' free slots before base, amortized by reserving as many as length
+static void _array_reserve_front(struct js_managed_value *managed, size_t required) {
+    if (required <= managed->array.head) {
+        return;
+    }
+    size_t size = _array_element_size(managed);
+    size_t head = max(required, managed->array.length);
+    size_t capacity = max(managed->array.length, 1);
+    char *storage = alloc(char, (head + capacity) * size);
+    if (managed->array.length > 0) {
+        memcpy(storage + head * size, managed->array.base, managed->array.length * size);
+    }
+    free(_array_storage(managed));
+    managed->array.base = (struct js_value *)(storage + head * size);
+    managed->array.capacity = capacity;
+    managed->array.head = head;
+}
+
+// shared base is copied only before first write, either side, length may be different due to pop() or shift()
+// sparse arrays are never shared
+static void _array_unshare(struct js_managed_value *managed) {
+    if (managed->array.shares) {
+        if (*(managed->array.shares) > 1) {
+            (*(managed->array.shares))--;
+            size_t size = _array_element_size(managed);
+            void *base = NULL;
+            if (managed->array.length > 0) {
+                base = alloc(char, managed->array.length * size);
+                memcpy(base, managed->array.base, managed->array.length * size);
+            }
+            managed->array.base = base;
+            managed->array.capacity = managed->array.length;
+            managed->array.head = 0;
+        } else {
+            free(managed->array.shares);
+        }
+        managed->array.shares = NULL;
+    }
+}
+
+static void _array_free(struct js_managed_value *managed) {
+    if (managed->array.kind == ak_sparse) {
+        buffer_free(managed->array.sparse->base, managed->array.sparse->length, managed->array.sparse->capacity);
+        free(managed->array.sparse);
+        managed->array.sparse = NULL;
+        managed->array.length = 0;
+        managed->array.capacity = 0;
+    } else if (managed->array.shares) {
+        if (--(*(managed->array.shares)) == 0) {
+            free(managed->array.shares);
+            free(_array_storage(managed));
+        }
+        managed->array.shares = NULL;
+        managed->array.base = NULL;
+        managed->array.length = 0;
+        managed->array.capacity = 0;
+        managed->array.head = 0;
+    } else {
+        _array_storage_free(managed);
+    }
+    managed->array.kind = ak_number;
+}
+
+// first non-number element or hole, never turns back, except sparse array turns back to values
+static void _array_to_values(struct js_managed_value *managed) {
+    if (managed->array.kind == ak_value) {
+        return;
+    }
+    struct js_value *base = NULL;
+    size_t capacity = 0;
+    if (managed->array.kind == ak_sparse) {
+        struct js_value_table *sparse = managed->array.sparse;
+        buffer_alloc(base, managed->array.length, capacity, managed->array.length);
+        buffer_for_each(sparse->base, sparse->capacity, _, i, v, {
+            (void)i;
+            if (v->value.type != vt_undefined) {
+                base[(size_t)v->key.number] = v->value;
+            }
+        });
+        buffer_free(sparse->base, sparse->length, sparse->capacity);
+        free(sparse);
+    } else {
+        _array_unshare(managed);
+        if (managed->array.capacity > 0) {
+            buffer_alloc(base, managed->array.length, capacity, managed->array.capacity);
+            for (size_t i = 0; i < managed->array.length; i++) {
+                base[i] = js_number(managed->array.numbers[i]);
+            }
+        }
+        free(_array_storage(managed));
+    }
+    managed->array.base = base;
+    managed->array.capacity = capacity;
+    managed->array.head = 0;
+    managed->array.kind = ak_value;
+}
+
+// sparse when writing far beyond the end, and dense again when at least half filled
+#define _sparse_min_length 1024
+#define _sparse_fill_ratio 8
+
+static void _array_to_sparse(struct js_managed_value *managed) {
+    _array_to_values(managed);
+    struct js_value_table *sparse = alloc(struct js_value_table, 1);
+    js_list_for_each(managed->array.base, managed->array.length, _, i, v, {
+        _value_table_put(sparse, js_number((double)i), *v);
+    });
+    size_t length = managed->array.length;
+    _array_storage_free(managed);
+    managed->array.length = length;
+    managed->array.sparse = sparse;
+    managed->array.kind = ak_sparse;
+}
+
+static void _array_check_dense(struct js_managed_value *managed) {
+    if (managed->array.kind == ak_sparse && managed->array.sparse->length * 2 >= managed->array.length) {
+        _array_to_values(managed);
+    }
+}
+
+void js_array_unshare(struct js_value *container) {
+    _array_unshare(container->managed);
+    if (container->managed->array.kind == ak_sparse) {
+        _array_to_values(container->managed);
+    }
+}
+
 void js_array_push(struct js_value *container, struct js_value element) {
-    buffer_push(container->managed->array.base, container->managed->array.length, container->managed->array.capacity, element.type == vt_null ? (struct js_value){0} : element);
+    struct js_managed_value *managed = container->managed;
+    if (managed->array.kind == ak_sparse) {
+        _value_table_put(managed->array.sparse, js_number((double)managed->array.length), element);
+        managed->array.length++;
+        _array_check_dense(managed);
+        return;
+    }
+    _array_unshare(managed);
+    if (managed->array.kind == ak_number && element.type != vt_number) {
+        _array_to_values(managed);
+    }
+    _array_reserve(managed, managed->array.length + 1);
+    if (managed->array.kind == ak_number) {
+        managed->array.numbers[managed->array.length++] = element.number;
+    } else {
+        managed->array.base[managed->array.length++] = element.type == vt_null ? (struct js_value){0} : element;
+    }
 }
 
 void js_array_put(struct js_value *container, size_t index, struct js_value element) {
-    if (element.type == vt_null) { // special treat to prevent useless expand
-        if (index < container->managed->array.length) {
-            container->managed->array.base[index].type = 0;
-        } // else do nothing
+    struct js_managed_value *managed = container->managed;
+    if (element.type == vt_null && index >= managed->array.length) {
+        return; // special treat to prevent useless expand
+    }
+    if (managed->array.kind == ak_sparse) {
+        _value_table_put(managed->array.sparse, js_number((double)index), element);
+        if (index >= managed->array.length) {
+            managed->array.length = index + 1;
+        }
+        _array_check_dense(managed);
+        return;
+    }
+    _array_unshare(managed);
+    if (index >= _sparse_min_length && index > managed->array.length * _sparse_fill_ratio) {
+        _array_to_sparse(managed);
+        js_array_put(container, index, element);
+        return;
+    }
+    // numbers have no holes, so only overwrite or append
+    if (managed->array.kind == ak_number && (element.type != vt_number || index > managed->array.length)) {
+        _array_to_values(managed);
+    }
+    _array_reserve(managed, index + 1);
+    if (index >= managed->array.length) {
+        managed->array.length = index + 1;
+    }
+    if (managed->array.kind == ak_number) {
+        managed->array.numbers[index] = element.number;
     } else {
-        buffer_put(container->managed->array.base, container->managed->array.length, container->managed->array.capacity, index, element);
+        managed->array.base[index] = element.type == vt_null ? (struct js_value){0} : element;
     }
 }
 
 struct js_value js_array_get(struct js_value *container, size_t index) {
-    if (index < container->managed->array.length) {
-        struct js_value ret = container->managed->array.base[index];
+    struct js_managed_value *managed = container->managed;
+    if (index < managed->array.length) {
+        if (managed->array.kind == ak_number) {
+            return js_number(managed->array.numbers[index]);
+        } else if (managed->array.kind == ak_sparse) {
+            struct js_value ret = _value_table_get(managed->array.sparse, js_number((double)index));
+            return ret.type == 0 ? js_null() : ret;
+        }
+        struct js_value ret = managed->array.base[index];
         return ret.type == 0 ? js_null() : ret;
     } else {
         return js_null();
     }
 }
 
+size_t js_array_next(struct js_value *container, size_t index) {
+    struct js_managed_value *managed = container->managed;
+    if (managed->array.kind == ak_number) {
+        return min(index, managed->array.length);
+    } else if (managed->array.kind == ak_value) {
+        for (; index < managed->array.length && managed->array.base[index].type == 0; index++)
+            ;
+        return min(index, managed->array.length);
+    }
+    // probing one by one is cheap for small gaps, and scanning whole table bounds cost of large gaps
+    struct js_value_table *sparse = managed->array.sparse;
+    size_t probe_end = min(managed->array.length, index + sparse->capacity);
+    for (; index < probe_end; index++) {
+        if (_value_table_get(sparse, js_number((double)index)).type != 0) {
+            return index;
+        }
+    }
+    size_t ret = managed->array.length;
+    buffer_for_each(sparse->base, sparse->capacity, _, i, v, {
+        (void)i;
+        if (v->value.type != vt_undefined) {
+            size_t key = (size_t)v->key.number;
+            if (key >= index && key < ret) {
+                ret = key;
+            }
+        }
+    });
+    return ret;
+}
+
+void js_array_pop(struct js_value *container) {
+    struct js_managed_value *managed = container->managed;
+    if (managed->array.length == 0) {
+        return;
+    }
+    managed->array.length--;
+    if (managed->array.kind == ak_sparse) {
+        _value_table_put(managed->array.sparse, js_number((double)managed->array.length), js_null());
+        _array_check_dense(managed);
+    }
+}
+
+// renumber all keys, O(number of elements) instead of O(length)
+static void _sparse_splice(struct js_managed_value *managed, size_t start, size_t delete_count, struct js_value *items, size_t count) {
+    struct js_value_table *old = managed->array.sparse;
+    struct js_value_table *sparse = alloc(struct js_value_table, 1);
+    buffer_for_each(old->base, old->capacity, _, i, v, {
+        (void)i;
+        if (v->value.type != vt_undefined) {
+            size_t key = (size_t)v->key.number;
+            if (key >= start + delete_count) {
+                _value_table_put(sparse, js_number((double)(key - delete_count + count)), v->value);
+            } else if (key < start) {
+                _value_table_put(sparse, v->key, v->value);
+            }
+        }
+    });
+    for (size_t i = 0; i < count; i++) {
+        _value_table_put(sparse, js_number((double)(start + i)), items[i]);
+    }
+    buffer_free(old->base, old->length, old->capacity);
+    free(old);
+    managed->array.sparse = sparse;
+    managed->array.length = managed->array.length - delete_count + count;
+    _array_check_dense(managed);
+}
+
+// remove 'delete_count' elements from 'start' and insert 'count' items there, front operations are amortized O(1)
+// removed elements can be got by js_array_get() before
+void js_array_splice(struct js_value *container, size_t start, size_t delete_count, struct js_value *items, size_t count) {
+    struct js_managed_value *managed = container->managed;
+    start = min(start, managed->array.length);
+    delete_count = min(delete_count, managed->array.length - start);
+    if (managed->array.kind == ak_sparse) {
+        _sparse_splice(managed, start, delete_count, items, count);
+        return;
+    }
+    if (start == 0 && count <= delete_count) {
+        // just move base forward, shared storage is not modified
+        size_t forward = delete_count - count;
+        managed->array.base = (struct js_value *)((char *)managed->array.base + forward * _array_element_size(managed));
+        managed->array.head += forward;
+        managed->array.capacity -= forward;
+        managed->array.length -= forward;
+        delete_count = count;
+        if (count == 0) {
+            return;
+        }
+    }
+    _array_unshare(managed);
+    if (managed->array.kind == ak_number) {
+        for (size_t i = 0; i < count; i++) {
+            if (items[i].type != vt_number) {
+                _array_to_values(managed);
+                break;
+            }
+        }
+    }
+    size_t size = _array_element_size(managed);
+    size_t length = managed->array.length - delete_count + count;
+    if (start == 0 && count > delete_count) {
+        size_t backward = count - delete_count;
+        _array_reserve_front(managed, backward);
+        managed->array.base = (struct js_value *)((char *)managed->array.base - backward * size);
+        managed->array.head -= backward;
+        managed->array.capacity += backward;
+    } else if (count != delete_count) {
+        _array_reserve(managed, length);
+        char *base = (char *)managed->array.base;
+        memmove(base + (start + count) * size, base + (start + delete_count) * size, (managed->array.length - start - delete_count) * size);
+        if (length < managed->array.length) {
+            // vacated tail must be holes
+            memset(base + length * size, 0, (managed->array.length - length) * size);
+        }
+    }
+    managed->array.length = length;
+    for (size_t i = 0; i < count; i++) {
+        if (managed->array.kind == ak_number) {
+            managed->array.numbers[start + i] = items[i].number;
+        } else {
+            managed->array.base[start + i] = items[i].type == vt_null ? (struct js_value){0} : items[i];
+        }
+    }
+}
+
+// append all elements of source, holes are kept
+// if container is empty, source's base is shared instead of copied
+void js_array_spread(struct js_value *container, struct js_value *source) {
+    struct js_managed_value *dst = container->managed;
+    struct js_managed_value *src = source->managed;
+    if (src->array.length == 0) {
+        return;
+    }
+    if (src->array.kind == ak_sparse) {
+        size_t offset = dst->array.length;
+        size_t length = src->array.length; // read before put, dst may be src
+        for (size_t i = js_array_next(source, 0); i < length; i = js_array_next(source, i + 1)) {
+            js_array_put(container, offset + i, js_array_get(source, i));
+        }
+        // trailing holes
+        if (dst->array.length < offset + length) {
+            if (dst->array.kind != ak_sparse) {
+                _array_to_values(dst);
+                _array_reserve(dst, offset + length);
+            }
+            dst->array.length = offset + length;
+        }
+        return;
+    }
+    if (dst->array.length == 0 && dst != src) {
+        _array_free(dst);
+        if (src->array.shares == NULL) {
+            src->array.shares = alloc(size_t, 1);
+            *(src->array.shares) = 1;
+        }
+        (*(src->array.shares))++;
+        dst->array.base = src->array.base;
+        dst->array.length = src->array.length;
+        dst->array.capacity = src->array.capacity;
+        dst->array.head = src->array.head;
+        dst->array.shares = src->array.shares;
+        dst->array.kind = src->array.kind;
+        return;
+    }
+    if (dst->array.kind == ak_sparse) {
+        size_t offset = dst->array.length;
+        for (size_t i = 0; i < src->array.length; i++) {
+            js_array_put(container, offset + i, js_array_get(source, i));
+        }
+        dst->array.length = max(dst->array.length, offset + src->array.length);
+        return;
+    }
+    _array_unshare(dst);
+    size_t length = src->array.length; // read before alloc, dst may be src
+    if (dst->array.kind == ak_number && src->array.kind == ak_number) {
+        _array_reserve(dst, dst->array.length + length);
+        memcpy(dst->array.numbers + dst->array.length, src->array.numbers, length * sizeof(double));
+    } else {
+        _array_to_values(dst);
+        _array_reserve(dst, dst->array.length + length);
+        if (src->array.kind == ak_number) {
+            for (size_t i = 0; i < length; i++) {
+                dst->array.base[dst->array.length + i] = js_number(src->array.numbers[i]);
+            }
+        } else {
+            memcpy(dst->array.base + dst->array.length, src->array.base, length * sizeof(struct js_value));
+        }
+    }
+    dst->array.length += length;
+}
+
+struct js_value js_typed_array(struct js_heap *heap, enum js_typed_array_kind kind, size_t length) {
+    struct js_value ret = {.type = vt_typed_array};
+    ret.managed = alloc(struct js_managed_value, 1);
+    ret.managed->type = vt_typed_array;
+    ret.managed->typed_array.kind = kind;
+    ret.managed->typed_array.length = length;
+    // at least 1 element, same reason as string
+    ret.managed->typed_array.base = alloc(char, (length > 0 ? length : 1) * (kind == ta_float64 ? sizeof(double) : sizeof(int32_t)));
+    buffer_push(heap->base, heap->length, heap->capacity, ret.managed);
+    return ret;
+}
+
+// same wrap around as ecmascript ToInt32
+static int32_t _to_int32(double number) {
+    if (!isfinite(number)) {
+        return 0;
+    }
+    return (int32_t)(uint32_t)(uint64_t)(int64_t)fmod(trunc(number), 4294967296.0);
+}
+
+bool js_typed_array_put(struct js_value *container, size_t index, struct js_value element) {
+    struct js_managed_value *managed = container->managed;
+    if (index >= managed->typed_array.length || element.type != vt_number) {
+        return false;
+    }
+    if (managed->typed_array.kind == ta_float64) {
+        managed->typed_array.float64[index] = element.number;
+    } else {
+        managed->typed_array.int32[index] = _to_int32(element.number);
+    }
+    return true;
+}
+
+struct js_value js_typed_array_get(struct js_value *container, size_t index) {
+    struct js_managed_value *managed = container->managed;
+    if (index >= managed->typed_array.length) {
+        return js_null();
+    }
+    if (managed->typed_array.kind == ta_float64) {
+        return js_number(managed->typed_array.float64[index]);
+    } else {
+        return js_number((double)managed->typed_array.int32[index]);
+    }
+}
+
+struct js_value js_hashmap(struct js_heap *heap) {
+    struct js_value ret = {.type = vt_hashmap};
+    ret.managed = alloc(struct js_managed_value, 1);
+    ret.managed->type = vt_hashmap;
+    buffer_push(heap->base, heap->length, heap->capacity, ret.managed);
+    return ret;
+}
+
+struct js_value js_hashset(struct js_heap *heap) {
+    struct js_value ret = js_hashmap(heap);
+    ret.type = vt_hashset;
+    ret.managed->type = vt_hashset;
+    return ret;
+}
+
+void js_hashmap_put(struct js_value *container, struct js_value key, struct js_value value) {
+    _value_table_put(&(container->managed->hashmap), key, value);
+}
+
+struct js_value js_hashmap_get(struct js_value *container, struct js_value key) {
+    struct js_value ret = _value_table_get(&(container->managed->hashmap), key);
+    return ret.type == 0 ? js_null() : ret;
+}
+
 struct js_value js_object(struct js_heap *heap) {
     struct js_value ret = {.type = vt_object};
     ret.managed = alloc(struct js_managed_value, 1);
@@ -382,22 +1013,22 @@ struct js_value js_object(struct js_heap *heap) {
     return ret;
 }
 
-void js_object_put(struct js_value *container, const char *key, uint16_t key_length, struct js_value element) {
+void js_object_put(struct js_value *container, const char *key, uint32_t key_length, struct js_value element) {
     js_map_put(container->managed->object.base, container->managed->object.length, container->managed->object.capacity, key, key_length, element.type == vt_null ? (struct js_value){0} : element);
 }
 
 void js_object_put_sz(struct js_value *container, const char *key, struct js_value element) {
-    js_object_put(container, key, (uint16_t)strlen(key), element);
+    js_object_put(container, key, (uint32_t)strlen(key), element);
 }
 
-struct js_value js_object_get(struct js_value *container, const char *key, uint16_t key_length) {
+struct js_value js_object_get(struct js_value *container, const char *key, uint32_t key_length) {
     struct js_value ret;
     ret = js_map_get(container->managed->object.base, container->managed->object.length, container->managed->object.capacity, key, key_length);
     return ret.type == 0 ? js_null() : ret;
 }
 
 struct js_value js_object_get_sz(struct js_value *container, const char *key) {
-    return js_object_get(container, key, (uint16_t)strlen(key));
+    return js_object_get(container, key, (uint32_t)strlen(key));
 }
 
 struct js_value js_function(struct js_heap *heap, uint32_t ingress) {
@@ -430,11 +1061,18 @@ void js_mark(struct js_value *value) {
     // printf("\n");
     switch (value->type) {
     case vt_string:
+    case vt_typed_array: // payload never contains references
         value->managed->in_use = 1;
         break;
     case vt_array:
         if (!value->managed->in_use) {
             value->managed->in_use = 1;
+            if (value->managed->array.kind == ak_number) {
+                break; // nothing to scan
+            } else if (value->managed->array.kind == ak_sparse) {
+                _value_table_mark(value->managed->array.sparse);
+                break;
+            }
             buffer_for_each(value->managed->array.base, value->managed->array.length, _, i, v, {
                 // https://stackoverflow.com/questions/1486904/how-do-i-best-silence-a-warning-about-unused-variables
                 (void)i;
@@ -462,6 +1100,13 @@ void js_mark(struct js_value *value) {
             });
         }
         break;
+    case vt_hashmap:
+    case vt_hashset:
+        if (!value->managed->in_use) {
+            value->managed->in_use = 1;
+            _value_table_mark(&(value->managed->hashmap));
+        }
+        break;
     case vt_c_value:
         if (!value->managed->in_use) {
             value->managed->in_use = 1;
@@ -479,11 +1124,15 @@ void js_mark(struct js_value *value) {
 void _free_managed(struct js_managed_value *managed) {
     switch (managed->type) {
     case vt_string:
-        buffer_free(managed->string.base, managed->string.length, managed->string.capacity);
+        if (managed->string.capacity == SIZE_MAX) {
+            file_unmap(managed->string.base, managed->string.length);
+        } else {
+            buffer_free(managed->string.base, managed->string.length, managed->string.capacity);
+        }
         free(managed);
         break;
     case vt_array:
-        buffer_free(managed->array.base, managed->array.length, managed->array.capacity);
+        _array_free(managed);
         free(managed);
         break;
     case vt_object: {
@@ -503,6 +1152,15 @@ void _free_managed(struct js_managed_value *managed) {
         free(managed);
         break;
     }
+    case vt_typed_array:
+        free(managed->typed_array.base);
+        free(managed);
+        break;
+    case vt_hashmap:
+    case vt_hashset:
+        buffer_free(managed->hashmap.base, managed->hashmap.length, managed->hashmap.capacity);
+        free(managed);
+        break;
     default:
         fatal("Illegal managed type \"%u\"", managed->type);
         break;
@@ -534,11 +1192,19 @@ void js_managed_value_dump(struct js_managed_value *managed) { // also used by h
         break;
     case vt_array:
         printf("[");
-        js_list_for_each(managed->array.base, managed->array.length, _, i, v, {
-            printf("%zu:", i);
-            js_value_dump(v);
-            printf(",");
-        });
+        if (managed->array.kind == ak_number) {
+            for (size_t i = 0; i < managed->array.length; i++) {
+                printf("%zu:%lg,", i, managed->array.numbers[i]);
+            }
+        } else {
+            struct js_value array = {.type = vt_array, .managed = managed};
+            for (size_t i = js_array_next(&array, 0); i < managed->array.length; i = js_array_next(&array, i + 1)) {
+                struct js_value v = js_array_get(&array, i);
+                printf("%zu:", i);
+                js_value_dump(&v);
+                printf(",");
+            }
+        }
         printf("]");
         break;
     case vt_object:
@@ -562,6 +1228,27 @@ void js_managed_value_dump(struct js_managed_value *managed) { // also used by h
     case vt_c_value:
         printf("<c_value %p %p %p>", managed->c_value.data, managed->c_value.mark, managed->c_value.sweep);
         break;
+    case vt_typed_array:
+        printf("<%s [", managed->typed_array.kind == ta_float64 ? "float64" : "int32");
+        for (size_t i = 0; i < managed->typed_array.length; i++) {
+            printf("%zu:%lg,", i, js_typed_array_get(&(struct js_value){.type = vt_typed_array, .managed = managed}, i).number);
+        }
+        printf("]>");
+        break;
+    case vt_hashmap:
+    case vt_hashset:
+        printf("<%s {", managed->type == vt_hashmap ? "hashmap" : "hashset");
+        buffer_for_each(managed->hashmap.base, managed->hashmap.capacity, _, i, v, {
+            (void)i;
+            if (v->value.type != vt_undefined) {
+                js_value_dump(&(v->key));
+                printf(":");
+                js_value_dump(&(v->value));
+                printf(",");
+            }
+        });
+        printf("}>");
+        break;
     default:
         fatal("Unknown managed value type %d", managed->type);
     }
@@ -592,6 +1279,9 @@ void js_value_dump(struct js_value *value) {
     case vt_object:
     case vt_function:
     case vt_c_value:
+    case vt_typed_array:
+    case vt_hashmap:
+    case vt_hashset:
         js_managed_value_dump(value->managed);
         break;
     default:
@@ -619,11 +1309,18 @@ void js_value_print(struct js_value *value) {
         break;
     case vt_array:
         printf("[");
-        js_list_for_each(value->managed->array.base, value->managed->array.length, _, i, v, {
-            printf("%zu:", i);
-            js_value_print(v);
-            printf(",");
-        });
+        if (value->managed->array.kind == ak_number) {
+            for (size_t i = 0; i < value->managed->array.length; i++) {
+                printf("%zu:%lg,", i, value->managed->array.numbers[i]);
+            }
+        } else {
+            for (size_t i = js_array_next(value, 0); i < value->managed->array.length; i = js_array_next(value, i + 1)) {
+                struct js_value v = js_array_get(value, i);
+                printf("%zu:", i);
+                js_value_print(&v);
+                printf(",");
+            }
+        }
         printf("]");
         break;
     case vt_object:
@@ -644,6 +1341,29 @@ void js_value_print(struct js_value *value) {
     case vt_c_value:
         printf("<c_value>");
         break;
+    case vt_typed_array:
+        printf("[");
+        for (size_t i = 0; i < value->managed->typed_array.length; i++) {
+            printf("%zu:%lg,", i, js_typed_array_get(value, i).number);
+        }
+        printf("]");
+        break;
+    case vt_hashmap:
+    case vt_hashset:
+        printf("{");
+        buffer_for_each(value->managed->hashmap.base, value->managed->hashmap.capacity, _, i, v, {
+            (void)i;
+            if (v->value.type != vt_undefined) {
+                js_value_print(&(v->key));
+                if (value->type == vt_hashmap) {
+                    printf(":");
+                    js_value_print(&(v->value));
+                }
+                printf(",");
+            }
+        });
+        printf("}");
+        break;
     default:
         fatal("Unknown value type %d", value->type);
     }
@@ -680,7 +1400,9 @@ int js_string_compare(struct js_value *lhs, struct js_value *rhs) {
     size_t ll = js_string_length(lhs);
     char *pr = js_string_base(rhs);
     size_t lr = js_string_length(rhs);
-    return strncmp(pl, pr, max(ll, lr));
+    // DON'T use strncmp, content may contain zero, and shorter one may not be followed by zero
+    int ret = memcmp(pl, pr, min(ll, lr));
+    return ret != 0 ? ret : (ll < lr ? -1 : (ll > lr ? 1 : 0));
 }
 
 struct js_result js_add(struct js_heap *heap, struct js_value *lhs, struct js_value *rhs) {
@@ -696,6 +1418,216 @@ struct js_result js_add(struct js_heap *heap, struct js_value *lhs, struct js_va
     }
 }
 
+// structured clone format: one tag byte, then payload, sizes and numbers are native byte order because both ends are in same process
+enum _clone_tag { ct_null, ct_false, ct_true, ct_number, ct_string, ct_numbers, ct_array, ct_object, ct_float64, ct_int32, ct_hashmap, ct_hashset };
+
+// deeper nesting is most likely circular reference
+#define _clone_depth 1000
+
+struct _clone {
+    char *base;
+    size_t length;
+    size_t capacity;
+};
+
+#define _clone_write(__arg_clone, __arg_base, __arg_length) \
+    string_buffer_append((__arg_clone)->base, (__arg_clone)->length, (__arg_clone)->capacity, (const char *)(__arg_base), (__arg_length))
+
+static void _clone_write_tag(struct _clone *clone, enum _clone_tag tag) {
+    uint8_t byte = (uint8_t)tag;
+    _clone_write(clone, &byte, 1);
+}
+
+static void _clone_write_size(struct _clone *clone, size_t size) {
+    uint64_t u64 = size;
+    _clone_write(clone, &u64, sizeof(u64));
+}
+
+static void _clone_write_string(struct _clone *clone, const char *base, size_t length) {
+    _clone_write_size(clone, length);
+    _clone_write(clone, base, length);
+}
+
+static bool _clone_write_value(struct _clone *clone, struct js_value *value, size_t depth) {
+    if (depth > _clone_depth) {
+        return false;
+    }
+    struct js_managed_value *managed = value->managed;
+    switch (value->type) {
+    case vt_null:
+        _clone_write_tag(clone, ct_null);
+        return true;
+    case vt_boolean:
+        _clone_write_tag(clone, value->boolean ? ct_true : ct_false);
+        return true;
+    case vt_number:
+        _clone_write_tag(clone, ct_number);
+        _clone_write(clone, &(value->number), sizeof(double));
+        return true;
+    case vt_scripture:
+    case vt_string:
+        _clone_write_tag(clone, ct_string);
+        _clone_write_string(clone, js_string_base(value), js_string_length(value));
+        return true;
+    case vt_array:
+        if (managed->array.kind == ak_number) {
+            // packed numbers are copied in one piece
+            _clone_write_tag(clone, ct_numbers);
+            _clone_write_size(clone, managed->array.length);
+            _clone_write(clone, managed->array.numbers, managed->array.length * sizeof(double));
+            return true;
+        }
+        // holes become null
+        _clone_write_tag(clone, ct_array);
+        _clone_write_size(clone, managed->array.length);
+        for (size_t i = 0; i < managed->array.length; i++) {
+            struct js_value element = js_array_get(value, i);
+            if (!_clone_write_value(clone, &element, depth + 1)) {
+                return false;
+            }
+        }
+        return true;
+    case vt_object:
+        _clone_write_tag(clone, ct_object);
+        _clone_write_size(clone, managed->object.length);
+        js_map_for_each(managed->object.base, managed->object.length, managed->object.capacity, k, kl, v, {
+            _clone_write_string(clone, k, kl);
+            if (!_clone_write_value(clone, v, depth + 1)) {
+                return false;
+            }
+        });
+        return true;
+    case vt_typed_array:
+        _clone_write_tag(clone, managed->typed_array.kind == ta_float64 ? ct_float64 : ct_int32);
+        _clone_write_size(clone, managed->typed_array.length);
+        _clone_write(clone, managed->typed_array.base, managed->typed_array.length * (managed->typed_array.kind == ta_float64 ? sizeof(double) : sizeof(int32_t)));
+        return true;
+    case vt_hashmap:
+    case vt_hashset:
+        _clone_write_tag(clone, value->type == vt_hashmap ? ct_hashmap : ct_hashset);
+        _clone_write_size(clone, managed->hashmap.length);
+        buffer_for_each(managed->hashmap.base, managed->hashmap.capacity, _, i, v, {
+            (void)i;
+            if (v->key.type != vt_undefined && v->value.type != vt_undefined) {
+                if (!_clone_write_value(clone, &(v->key), depth + 1)) {
+                    return false;
+                }
+                if (value->type == vt_hashmap && !_clone_write_value(clone, &(v->value), depth + 1)) {
+                    return false;
+                }
+            }
+        });
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool js_serialize(struct js_value *value, char **base, size_t *length, size_t *capacity) {
+    struct _clone clone = {*base, *length, *capacity};
+    bool ret = _clone_write_value(&clone, value, 0);
+    *base = clone.base;
+    *length = clone.length;
+    *capacity = clone.capacity;
+    return ret;
+}
+
+struct _clone_reader {
+    const char *base;
+    size_t length;
+    size_t offset;
+};
+
+static void _clone_read(struct _clone_reader *reader, void *dst, size_t length) {
+    enforce(reader->offset + length <= reader->length);
+    memcpy(dst, reader->base + reader->offset, length);
+    reader->offset += length;
+}
+
+static size_t _clone_read_size(struct _clone_reader *reader) {
+    uint64_t u64;
+    _clone_read(reader, &u64, sizeof(u64));
+    return (size_t)u64;
+}
+
+static const char *_clone_read_string(struct _clone_reader *reader, size_t *length) {
+    *length = _clone_read_size(reader);
+    enforce(*length <= reader->length - reader->offset);
+    const char *ret = reader->base + reader->offset;
+    reader->offset += *length;
+    return ret;
+}
+
+static struct js_value _clone_read_value(struct js_heap *heap, struct _clone_reader *reader) {
+    uint8_t tag;
+    _clone_read(reader, &tag, 1);
+    struct js_value ret;
+    size_t length;
+    const char *s;
+    switch (tag) {
+    case ct_null:
+        return js_null();
+    case ct_false:
+    case ct_true:
+        return js_boolean(tag == ct_true);
+    case ct_number:
+        ret = js_number(0);
+        _clone_read(reader, &(ret.number), sizeof(double));
+        return ret;
+    case ct_string:
+        s = _clone_read_string(reader, &length);
+        return js_string(heap, s, length);
+    case ct_numbers:
+        length = _clone_read_size(reader);
+        ret = js_array(heap);
+        for (size_t i = 0; i < length; i++) {
+            double number;
+            _clone_read(reader, &number, sizeof(double));
+            js_array_push(&ret, js_number(number));
+        }
+        return ret;
+    case ct_array:
+        length = _clone_read_size(reader);
+        ret = js_array(heap);
+        for (size_t i = 0; i < length; i++) {
+            js_array_push(&ret, _clone_read_value(heap, reader));
+        }
+        return ret;
+    case ct_object:
+        length = _clone_read_size(reader);
+        ret = js_object(heap);
+        for (size_t i = 0; i < length; i++) {
+            size_t kl;
+            const char *k = _clone_read_string(reader, &kl);
+            js_object_put(&ret, k, (uint32_t)kl, _clone_read_value(heap, reader));
+        }
+        return ret;
+    case ct_float64:
+    case ct_int32:
+        length = _clone_read_size(reader);
+        ret = js_typed_array(heap, tag == ct_float64 ? ta_float64 : ta_int32, length);
+        _clone_read(reader, ret.managed->typed_array.base, length * (tag == ct_float64 ? sizeof(double) : sizeof(int32_t)));
+        return ret;
+    case ct_hashmap:
+    case ct_hashset:
+        length = _clone_read_size(reader);
+        ret = tag == ct_hashmap ? js_hashmap(heap) : js_hashset(heap);
+        for (size_t i = 0; i < length; i++) {
+            struct js_value key = _clone_read_value(heap, reader);
+            js_hashmap_put(&ret, key, tag == ct_hashmap ? _clone_read_value(heap, reader) : js_boolean(true));
+        }
+        return ret;
+    default:
+        fatal("Unknown structured clone tag %u", tag);
+        return js_null();
+    }
+}
+
+struct js_value js_deserialize(struct js_heap *heap, const char *base, size_t length) {
+    struct _clone_reader reader = {base, length, 0};
+    return _clone_read_value(heap, &reader);
+}
+
 #ifdef DEBUG
 
 void test_data_structure_size() {
@@ -811,17 +1743,32 @@ static struct js_value _random_js_value(struct js_heap *heap, enum js_value_type
         ret = js_function(heap, rand() % UINT32_MAX);
         for (i = 0; i < rand() % 10; i++) {
             struct js_value v = _random_js_value(heap, _random_js_value_type(), depth + 1);
-            size_t len = ret.managed->function.closure.length; // uint16_t -> size_t
+            size_t len = ret.managed->function.closure.length; // uint32_t -> size_t
             size_t cap = ret.managed->function.closure.capacity;
             js_map_put_sz(ret.managed->function.closure.base, len, cap, random_sz_static(NULL), v);
-            ret.managed->function.closure.length = (uint16_t)len; // size_t -> uint16_t
-            ret.managed->function.closure.capacity = (uint16_t)cap;
+            ret.managed->function.closure.length = (uint32_t)len; // size_t -> uint32_t
+            ret.managed->function.closure.capacity = (uint32_t)cap;
         }
         return ret;
     case vt_c_function:
         return (struct js_value){.type = vt_c_function, .c_function = (void *)(intptr_t)rand()};
     case vt_c_value:
         return js_c_value(heap, random_sz_dynamic(), NULL, free);
+    case vt_hashmap:
+    case vt_hashset:
+        ret = type == vt_hashmap ? js_hashmap(heap) : js_hashset(heap);
+        for (i = 0; i < rand() % 10; i++) {
+            struct js_value k = _random_js_value(heap, _random_js_value_type(), depth + 1);
+            struct js_value v = type == vt_hashmap ? _random_js_value(heap, _random_js_value_type(), depth + 1) : js_boolean(true);
+            js_hashmap_put(&ret, k, v);
+        }
+        return ret;
+    case vt_typed_array:
+        ret = js_typed_array(heap, rand() % 2 ? ta_float64 : ta_int32, rand() % 10);
+        for (size_t i = 0; i < ret.managed->typed_array.length; i++) {
+            js_typed_array_put(&ret, i, js_number(random_double()));
+        }
+        return ret;
     default:
         fatal("Unknown value type %u", type);
     }
@@ -864,7 +1811,7 @@ void test_js_value_bug() {
         "EFvi653FKJKm04nqvfux6YzKZhmukC7biyUhulH9eLPxZUX"};
     for (int i = 0; i < countof(bug_keys); i++) {
         const char *k = bug_keys[i];
-        size_t fh = _first_hash(k, (uint16_t)strlen(k), 0b01);
+        size_t fh = _first_hash(k, (uint32_t)strlen(k), 0b01);
         size_t nh = _next_hash(fh, 0b01);
         printf("%d. %s %zu %zu\n", i, k, fh, nh);
     }
@@ -26,7 +26,10 @@ You should have received a copy of the GNU General Public License along with thi
     X(vt_object) /* managed */ \
     X(vt_function) /* managed */ \
     X(vt_c_function) \
-    X(vt_c_value) /* managed */
+    X(vt_c_value) /* managed */ \
+    X(vt_typed_array) /* managed, fixed length dense numbers, no holes */ \
+    X(vt_hashmap) /* managed, key can be any non-null value */ \
+    X(vt_hashset) /* managed, same as vt_hashmap, values are always true */
 
 #define X(name) name,
 enum js_value_type { js_value_type_list };
@@ -34,6 +37,13 @@ enum js_value_type { js_value_type_list };
 
 struct js_managed_value;
 
+// array element kinds, new array starts as packed numbers without holes, and turns into tagged values on first non-number element or hole, never turns back
+// writing far beyond the end turns into sparse, which stores index-value pairs in hash table, and turns back into tagged values when half filled
+enum js_array_kind { ak_number, ak_value, ak_sparse };
+
+// typed array element types
+enum js_typed_array_kind { ta_float64, ta_int32 };
+
 #pragma pack(push, 1)
 struct js_value {
     uint8_t type;
@@ -54,18 +64,33 @@ struct js_value {
 struct js_kv_pair {
     struct {
         char *base;
-        uint16_t length; // different length with string, DON'T use one struct definition
-        uint16_t capacity;
+        uint32_t length; // different length with string, DON'T use one struct definition
+        uint32_t capacity;
     } key;
     struct js_value value;
 };
 #pragma pack(pop)
 
 #pragma pack(push, 1)
-struct js_variable_map { // for globals, locals, arguments, closure, use uint16_t instead of size_t
+struct js_value_pair {
+    struct js_value key;
+    struct js_value value;
+};
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+struct js_value_table { // for hashmap, hashset and sparse array
+    struct js_value_pair *base;
+    size_t length;
+    size_t capacity;
+};
+#pragma pack(pop)
+
+#pragma pack(push, 1)
+struct js_variable_map { // for globals, locals, arguments, closure, use uint32_t instead of size_t
     struct js_kv_pair *base;
-    uint16_t length;
-    uint16_t capacity;
+    uint32_t length;
+    uint32_t capacity;
 };
 #pragma pack(pop)
 
@@ -77,12 +102,19 @@ struct js_managed_value {
         struct {
             char *base;
             size_t length;
-            size_t capacity;
+            size_t capacity; // SIZE_MAX means base is read only mapped file, see js_mapped_string()
         } string;
         struct {
-            struct js_value *base;
+            union {
+                struct js_value *base; // ak_value
+                double *numbers; // ak_number
+                struct js_value_table *sparse; // ak_sparse, keys are numbers
+            };
             size_t length;
-            size_t capacity;
+            size_t capacity; // counts from base
+            size_t head; // free slots before base, for O(1) front operations
+            size_t *shares; // copy on write, if not NULL, base is shared by *shares arrays
+            uint8_t kind;
         } array;
         struct {
             struct js_kv_pair *base;
@@ -93,6 +125,16 @@ struct js_managed_value {
             uint32_t ingress; // Caution: egress is NOT fixed
             struct js_variable_map closure;
         } function;
+        struct {
+            union {
+                void *base;
+                double *float64;
+                int32_t *int32;
+            };
+            size_t length; // fixed after creation
+            uint8_t kind;
+        } typed_array;
+        struct js_value_table hashmap; // also hashset
         struct {
             void *data;
             void (*mark)(void *); // this function pointer can also be used to verify data type
@@ -143,19 +185,21 @@ struct js_result {
     })
 
 shared void js_map_dump(struct js_kv_pair *, size_t, size_t);
-shared void js_map_put_internal(struct js_kv_pair **, size_t *, size_t *, const char *, uint16_t, struct js_value);
+shared void js_map_put_internal(struct js_kv_pair **, size_t *, size_t *, const char *, uint32_t, struct js_value);
 // remove '*' prefix, and fit for any type of 'length' 'capacity'
 #define js_map_put(__arg_base, __arg_length, __arg_capacity, __arg_key, __arg_key_length, __arg_value) \
     do { \
         size_t __len = __arg_length; \
         size_t __cap = __arg_capacity; \
         js_map_put_internal(&(__arg_base), &__len, &__cap, __arg_key, __arg_key_length, __arg_value); \
+        /* narrower 'length' 'capacity' must not be silently truncated */ \
+        enforce((size_t)(typeof(__arg_capacity))__cap == __cap); \
         __arg_length = (typeof(__arg_length))__len; \
         __arg_capacity = (typeof(__arg_capacity))__cap; \
     } while (0)
 #define js_map_put_sz(__arg_base, __arg_length, __arg_capacity, __arg_key, __arg_value) \
-    js_map_put(__arg_base, __arg_length, __arg_capacity, __arg_key, (uint16_t)strlen(__arg_key), __arg_value)
-shared struct js_value js_map_get(struct js_kv_pair *, size_t, size_t, const char *, uint16_t);
+    js_map_put(__arg_base, __arg_length, __arg_capacity, __arg_key, (uint32_t)strlen(__arg_key), __arg_value)
+shared struct js_value js_map_get(struct js_kv_pair *, size_t, size_t, const char *, uint32_t);
 shared struct js_value js_map_get_sz(struct js_kv_pair *, size_t, size_t, const char *);
 // same as js_map_put
 #define js_map_free(__arg_base, __arg_length, __arg_capacity) \
@@ -176,14 +220,27 @@ shared struct js_value js_scripture_sz(const char *);
 shared struct js_value js_string(struct js_heap *, const char *, size_t);
 shared struct js_value js_string_sz(struct js_heap *, const char *);
 shared struct js_value js_string_f(struct js_heap *, const char *, ...);
+shared struct js_value js_mapped_string(struct js_heap *, char *, size_t); // from file_map(), unmapped by garbage collector
 shared struct js_value js_array(struct js_heap *);
 shared void js_array_push(struct js_value *, struct js_value);
 shared void js_array_put(struct js_value *, size_t, struct js_value);
 shared struct js_value js_array_get(struct js_value *, size_t);
+shared size_t js_array_next(struct js_value *, size_t); // index of first non-hole element since given index, or length
+shared void js_array_pop(struct js_value *); // remove last element, use js_array_get() before to get it
+shared void js_array_splice(struct js_value *, size_t, size_t, struct js_value *, size_t);
+shared void js_array_spread(struct js_value *, struct js_value *);
+shared void js_array_unshare(struct js_value *); // must be called before directly modifying array's base
+shared struct js_value js_typed_array(struct js_heap *, enum js_typed_array_kind, size_t); // zero filled
+shared bool js_typed_array_put(struct js_value *, size_t, struct js_value); // false if out of range or not number
+shared struct js_value js_typed_array_get(struct js_value *, size_t);
+shared struct js_value js_hashmap(struct js_heap *);
+shared struct js_value js_hashset(struct js_heap *);
+shared void js_hashmap_put(struct js_value *, struct js_value, struct js_value); // also hashset, put null means delete
+shared struct js_value js_hashmap_get(struct js_value *, struct js_value);
 shared struct js_value js_object(struct js_heap *);
-shared void js_object_put(struct js_value *, const char *, uint16_t, struct js_value);
+shared void js_object_put(struct js_value *, const char *, uint32_t, struct js_value);
 shared void js_object_put_sz(struct js_value *, const char *, struct js_value);
-shared struct js_value js_object_get(struct js_value *, const char *, uint16_t);
+shared struct js_value js_object_get(struct js_value *, const char *, uint32_t);
 shared struct js_value js_object_get_sz(struct js_value *, const char *);
 shared struct js_value js_function(struct js_heap *, uint32_t);
 shared bool js_is_function(struct js_value *);
@@ -209,6 +266,10 @@ shared int js_string_compare(struct js_value *, struct js_value *);
         } \
     } while (0)
 shared struct js_result js_add(struct js_heap *, struct js_value *, struct js_value *);
+// structured clone for passing values between vms, appends to buffer, holes of array become null
+// false if value contains function or c value, or nests too deep, which is most likely circular
+shared bool js_serialize(struct js_value *, char **, size_t *, size_t *);
+shared struct js_value js_deserialize(struct js_heap *, const char *, size_t); // input must come from js_serialize()
 
 #ifdef DEBUG
 
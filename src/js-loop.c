@@ -0,0 +1,451 @@
+/*
+Copyright 2024-2025 ShaJunXing <shajunxing@hotmail.com>
+
+This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <limits.h> // INT_MAX
+#include <math.h> // ceil
+#include <time.h>
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/socket.h>
+    #include <unistd.h>
+    #ifdef __linux__
+        #include <sys/epoll.h>
+    #endif
+#endif
+#include "js-loop.h"
+
+// loop state is kept in vm internals, so that callbacks are marked by garbage collector and script can't touch it
+#define _loop_internal "loop"
+#define _loop_events 64
+#define _loop_read_size 65536
+
+#define _throw_posix_error(__arg_vm) \
+    js_throw(js_string_sz(&(__arg_vm->heap), (const char *)strerror(errno)))
+
+#define _throw_unsupported() \
+    js_throw(js_scripture_sz("Watching file descriptors requires epoll"))
+
+struct _timer {
+    double deadline; // monotonic milliseconds
+    double interval; // 0 means timeout
+    double id;
+    struct js_value callback;
+};
+
+struct _watcher {
+    int fd;
+    struct js_value callback;
+};
+
+struct _loop {
+    struct _timer *timers; // binary heap, earliest first, same deadline in order of creation
+    size_t timers_length;
+    size_t timers_capacity;
+    double next_id;
+    struct _watcher *watchers;
+    size_t watchers_length;
+    size_t watchers_capacity;
+    int epoll; // -1 if not available
+};
+
+static void _loop_mark(void *data) {
+    struct _loop *loop = (struct _loop *)data;
+    for (size_t i = 0; i < loop->timers_length; i++) {
+        js_mark(&(loop->timers[i].callback));
+    }
+    for (size_t i = 0; i < loop->watchers_length; i++) {
+        js_mark(&(loop->watchers[i].callback));
+    }
+}
+
+static void _loop_sweep(void *data) {
+    struct _loop *loop = (struct _loop *)data;
+    buffer_free(loop->timers, loop->timers_length, loop->timers_capacity);
+    buffer_free(loop->watchers, loop->watchers_length, loop->watchers_capacity);
+#ifdef __linux__
+    close(loop->epoll);
+#endif
+    free(loop);
+}
+
+static struct _loop *_loop_of(struct js_vm *vm) {
+    struct js_value value = js_get_internal_sz(vm, _loop_internal);
+    return value.type == vt_c_value ? (struct _loop *)value.managed->c_value.data : NULL;
+}
+
+#define _loop_argument(__arg_vm, __arg_loop) \
+    struct _loop *__arg_loop = _loop_of(__arg_vm); \
+    if (__arg_loop == NULL) { \
+        js_throw(js_scripture_sz("Event loop is not declared")); \
+    }
+
+static double _monotonic_ms() {
+#ifdef _WIN32
+    return (double)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+#endif
+}
+
+static bool _timer_before(struct _timer *lhs, struct _timer *rhs) {
+    return lhs->deadline < rhs->deadline || (lhs->deadline == rhs->deadline && lhs->id < rhs->id);
+}
+
+static void _timer_swap(struct _loop *loop, size_t i, size_t j) {
+    struct _timer temp = loop->timers[i];
+    loop->timers[i] = loop->timers[j];
+    loop->timers[j] = temp;
+}
+
+static void _timer_sift_up(struct _loop *loop, size_t i) {
+    for (; i > 0 && _timer_before(loop->timers + i, loop->timers + (i - 1) / 2); i = (i - 1) / 2) {
+        _timer_swap(loop, i, (i - 1) / 2);
+    }
+}
+
+static void _timer_sift_down(struct _loop *loop, size_t i) {
+    for (;;) {
+        size_t least = i;
+        for (size_t child = i * 2 + 1; child <= i * 2 + 2 && child < loop->timers_length; child++) {
+            if (_timer_before(loop->timers + child, loop->timers + least)) {
+                least = child;
+            }
+        }
+        if (least == i) {
+            return;
+        }
+        _timer_swap(loop, i, least);
+        i = least;
+    }
+}
+
+static void _timer_push(struct _loop *loop, struct _timer timer) {
+    buffer_push(loop->timers, loop->timers_length, loop->timers_capacity, timer);
+    _timer_sift_up(loop, loop->timers_length - 1);
+}
+
+static void _timer_remove(struct _loop *loop, size_t i) {
+    loop->timers_length--;
+    if (i < loop->timers_length) {
+        loop->timers[i] = loop->timers[loop->timers_length];
+        _timer_sift_down(loop, i);
+        _timer_sift_up(loop, i);
+    }
+}
+
+static struct _watcher *_watcher_find(struct _loop *loop, int fd) {
+    for (size_t i = 0; i < loop->watchers_length; i++) {
+        if (loop->watchers[i].fd == fd) {
+            return loop->watchers + i;
+        }
+    }
+    return NULL;
+}
+
+static struct js_result _set_timer(struct js_vm *vm, bool repeat) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(js_is_function(argbase));
+    js_assert(argbase[1].type == vt_number);
+    _loop_argument(vm, loop);
+    double ms = max(argbase[1].number, 0);
+    struct _timer timer = {.deadline = _monotonic_ms() + ms, .id = ++loop->next_id, .callback = argbase[0]};
+    if (repeat) {
+        // or it will fire forever within one round
+        timer.interval = max(ms, 1);
+    }
+    _timer_push(loop, timer);
+    js_return(js_number(timer.id));
+}
+
+// cleartimer(id), both timeout and interval, unknown id is ignored
+struct js_result js_loop_cleartimer(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    js_assert(argbase->type == vt_number);
+    _loop_argument(vm, loop);
+    for (size_t i = 0; i < loop->timers_length; i++) {
+        if (loop->timers[i].id == argbase->number) {
+            _timer_remove(loop, i);
+            break;
+        }
+    }
+    js_return(js_null());
+}
+
+#define _one_fd_argument(__arg_vm, __arg_nargs, __arg_argbase, __arg_fd) \
+    uint32_t __arg_nargs = js_get_arguments_length(__arg_vm); \
+    struct js_value *__arg_argbase = js_get_arguments_base(__arg_vm); \
+    js_assert(__arg_nargs >= 1); \
+    js_assert(__arg_argbase->type == vt_number); \
+    int __arg_fd = (int)__arg_argbase->number
+
+static bool _unwatch(struct _loop *loop, int fd) {
+    struct _watcher *watcher = _watcher_find(loop, fd);
+    if (watcher == NULL) {
+        return true;
+    }
+    *watcher = loop->watchers[--loop->watchers_length];
+#ifdef __linux__
+    return epoll_ctl(loop->epoll, EPOLL_CTL_DEL, fd, NULL) == 0;
+#else
+    return true;
+#endif
+}
+
+// fdclose(fd), also unwatches it
+struct js_result js_loop_fdclose(struct js_vm *vm) {
+#ifdef _WIN32
+    _throw_unsupported();
+#else
+    _one_fd_argument(vm, nargs, argbase, fd);
+    js_assert(nargs == 1);
+    _loop_argument(vm, loop);
+    _unwatch(loop, fd);
+    if (close(fd) != 0) {
+        _throw_posix_error(vm);
+    }
+    js_return(js_null());
+#endif
+}
+
+// fdread(fd, [n]), returns string of at most n bytes, "" if nothing available yet, null at end
+struct js_result js_loop_fdread(struct js_vm *vm) {
+#ifdef _WIN32
+    _throw_unsupported();
+#else
+    _one_fd_argument(vm, nargs, argbase, fd);
+    js_assert(nargs == 1 || nargs == 2);
+    size_t size = _loop_read_size;
+    if (nargs == 2) {
+        js_assert(argbase[1].type == vt_number && argbase[1].number >= 1);
+        size = (size_t)argbase[1].number;
+    }
+    struct js_value ret = js_string(&(vm->heap), NULL, 0);
+    buffer_alloc(ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity, size + 1);
+    ssize_t n = read(fd, ret.managed->string.base, size);
+    if (n > 0) {
+        ret.managed->string.length = n;
+        js_return(ret);
+    } else if (n == 0) {
+        js_return(js_null());
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        js_return(ret);
+    } else {
+        _throw_posix_error(vm);
+    }
+#endif
+}
+
+// fdwrite(fd, str), returns number of bytes written, may be less than length if fd is non-blocking
+struct js_result js_loop_fdwrite(struct js_vm *vm) {
+#ifdef _WIN32
+    _throw_unsupported();
+#else
+    _one_fd_argument(vm, nargs, argbase, fd);
+    js_assert(nargs == 2);
+    js_assert(js_is_string(argbase + 1));
+    ssize_t n = write(fd, js_string_base(argbase + 1), js_string_length(argbase + 1));
+    if (n >= 0) {
+        js_return(js_number((double)n));
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        js_return(js_number(0));
+    } else {
+        _throw_posix_error(vm);
+    }
+#endif
+}
+
+#ifndef _WIN32
+static struct js_result _fd_pair(struct js_vm *vm, int fds[2]) {
+    struct js_value ret = js_array(&(vm->heap));
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        js_array_push(&ret, js_number(fds[i]));
+    }
+    js_return(ret);
+}
+#endif
+
+// pipe(), returns non-blocking [read end, write end]
+struct js_result js_loop_pipe(struct js_vm *vm) {
+#ifdef _WIN32
+    _throw_unsupported();
+#else
+    js_assert(js_get_arguments_length(vm) == 0);
+    int fds[2];
+    if (pipe(fds) != 0) {
+        _throw_posix_error(vm);
+    }
+    return _fd_pair(vm, fds);
+#endif
+}
+
+// setinterval(callback, ms), returns id
+struct js_result js_loop_setinterval(struct js_vm *vm) {
+    return _set_timer(vm, true);
+}
+
+// settimeout(callback, ms), returns id
+struct js_result js_loop_settimeout(struct js_vm *vm) {
+    return _set_timer(vm, false);
+}
+
+// socketpair(), returns two connected non-blocking unix stream sockets
+struct js_result js_loop_socketpair(struct js_vm *vm) {
+#ifdef _WIN32
+    _throw_unsupported();
+#else
+    js_assert(js_get_arguments_length(vm) == 0);
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        _throw_posix_error(vm);
+    }
+    return _fd_pair(vm, fds);
+#endif
+}
+
+// unwatch(fd)
+struct js_result js_loop_unwatch(struct js_vm *vm) {
+    _one_fd_argument(vm, nargs, argbase, fd);
+    js_assert(nargs == 1);
+    _loop_argument(vm, loop);
+    if (!_unwatch(loop, fd)) {
+        _throw_posix_error(vm);
+    }
+    js_return(js_null());
+}
+
+// watch(fd, callback), callback(fd) is called whenever fd is readable or closed by peer, until unwatched, watching again replaces callback
+struct js_result js_loop_watch(struct js_vm *vm) {
+#ifdef __linux__
+    _one_fd_argument(vm, nargs, argbase, fd);
+    js_assert(nargs == 2);
+    js_assert(js_is_function(argbase + 1));
+    _loop_argument(vm, loop);
+    struct _watcher *watcher = _watcher_find(loop, fd);
+    if (watcher) {
+        watcher->callback = argbase[1];
+    } else {
+        struct epoll_event event = {.events = EPOLLIN, .data.fd = fd};
+        if (epoll_ctl(loop->epoll, EPOLL_CTL_ADD, fd, &event) != 0) {
+            _throw_posix_error(vm);
+        }
+        buffer_push(loop->watchers, loop->watchers_length, loop->watchers_capacity, ((struct _watcher){.fd = fd, .callback = argbase[1]}));
+    }
+    js_return(js_null());
+#else
+    _throw_unsupported();
+#endif
+}
+
+// sleeps until timeout in milliseconds (-1 means infinite) or any watched fd is ready, then calls their callbacks
+static struct js_result _loop_wait(struct js_vm *vm, struct _loop *loop, int timeout) {
+#ifdef __linux__
+    struct epoll_event events[_loop_events];
+    int n = epoll_wait(loop->epoll, events, _loop_events, timeout);
+    if (n < 0 && errno != EINTR) {
+        _throw_posix_error(vm);
+    }
+    for (int i = 0; i < n; i++) {
+        // may be unwatched by previous callback
+        struct _watcher *watcher = _watcher_find(loop, events[i].data.fd);
+        if (watcher) {
+            struct js_result result = js_call(vm, watcher->callback, (struct js_value[]){js_number(watcher->fd)}, 1);
+            if (!result.success) {
+                return result;
+            }
+        }
+    }
+#else
+    // no watchers without epoll
+    #ifdef _WIN32
+    Sleep(timeout);
+    #else
+    struct timespec ts = {.tv_sec = timeout / 1000, .tv_nsec = timeout % 1000 * 1000000L};
+    nanosleep(&ts, NULL);
+    #endif
+#endif
+    js_return(js_null());
+}
+
+struct js_result js_loop_run(struct js_vm *vm) {
+    struct _loop *loop = _loop_of(vm);
+    if (loop == NULL) {
+        js_return(js_null()); // nothing can be pending
+    }
+    while (loop->timers_length > 0 || loop->watchers_length > 0) {
+        // timers rescheduled in this round won't fire until next round
+        double now = _monotonic_ms();
+        while (loop->timers_length > 0 && loop->timers[0].deadline <= now) {
+            struct _timer timer = loop->timers[0];
+            _timer_remove(loop, 0);
+            if (timer.interval > 0) {
+                // before calling, so that callback can clear it
+                struct _timer next = timer;
+                next.deadline = now + timer.interval;
+                _timer_push(loop, next);
+            }
+            struct js_result result = js_call(vm, timer.callback, NULL, 0);
+            if (!result.success) {
+                return result;
+            }
+        }
+        if (loop->timers_length == 0 && loop->watchers_length == 0) {
+            break;
+        }
+        int timeout = -1;
+        if (loop->timers_length > 0) {
+            double delay = ceil(max(loop->timers[0].deadline - _monotonic_ms(), 0));
+            timeout = delay < INT_MAX ? (int)delay : INT_MAX; // overflow of large delays, wait again after timeout
+        }
+        struct js_result result = _loop_wait(vm, loop, timeout);
+        if (!result.success) {
+            return result;
+        }
+    }
+    js_return(js_null());
+}
+
+#define _function_list \
+    X(cleartimer) \
+    X(fdclose) \
+    X(fdread) \
+    X(fdwrite) \
+    X(pipe) \
+    X(setinterval) \
+    X(settimeout) \
+    X(socketpair) \
+    X(unwatch) \
+    X(watch)
+
+void js_declare_loop_functions(struct js_vm *vm) {
+    struct _loop *loop = alloc(struct _loop, 1);
+#ifdef __linux__
+    loop->epoll = epoll_create1(EPOLL_CLOEXEC);
+    enforce(loop->epoll != -1);
+#else
+    loop->epoll = -1;
+#endif
+    js_put_internal_sz(vm, _loop_internal, js_c_value(&(vm->heap), loop, _loop_mark, _loop_sweep));
+#define X(name) js_declare_variable_sz(vm, #name, js_c_function(js_loop_##name));
+    do {
+        _function_list
+    } while (0);
+#undef X
+}
@@ -0,0 +1,29 @@
+/*
+Copyright 2024-2025 ShaJunXing <shajunxing@hotmail.com>
+
+This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef JS_LOOP_H
+#define JS_LOOP_H
+
+#include "js-vm.h"
+
+shared struct js_result js_loop_cleartimer(struct js_vm *);
+shared struct js_result js_loop_fdclose(struct js_vm *);
+shared struct js_result js_loop_fdread(struct js_vm *);
+shared struct js_result js_loop_fdwrite(struct js_vm *);
+shared struct js_result js_loop_pipe(struct js_vm *);
+shared struct js_result js_loop_setinterval(struct js_vm *);
+shared struct js_result js_loop_settimeout(struct js_vm *);
+shared struct js_result js_loop_socketpair(struct js_vm *);
+shared struct js_result js_loop_unwatch(struct js_vm *);
+shared struct js_result js_loop_watch(struct js_vm *);
+shared void js_declare_loop_functions(struct js_vm *);
+shared struct js_result js_loop_run(struct js_vm *); // until no timers and watchers left, uncaught error of callback stops it
+
+#endif
\ No newline at end of file
@@ -9,6 +9,7 @@ You should have received a copy of the GNU General Public License along with thi
 */
 
 #include <ctype.h>
+#include <math.h> // isfinite
 #include <time.h>
 #ifdef _WIN32
     #define WIN32_LEAN_AND_MEAN
@@ -37,11 +38,16 @@ static char *dirname(char *path) {
 }
 #else
     #include <dirent.h>
+    #include <fcntl.h> // AT_SYMLINK_NOFOLLOW
     #include <libgen.h>
     #include <readline/readline.h>
     #include <signal.h>
+    #ifdef __linux__
+        #include <sys/sendfile.h>
+    #endif
     #include <sys/stat.h> // mkdir
     #include <sys/wait.h>
+    #include <sys/syscall.h> // SYS_copy_file_range
     #include <unistd.h> // getcwd, chdir, rmdir, access
 static int _mkdir(const char *path) {
     return mkdir(path, 0777);
@@ -70,7 +76,7 @@ const char *js_std_pathsep = "/";
 
 #define _one_string_argument(__arg_vm, __arg_str, __arg_statement) \
     do { \
-        uint16_t __nargs = js_get_arguments_length(__arg_vm); \
+        uint32_t __nargs = js_get_arguments_length(__arg_vm); \
         struct js_value *__argbase = js_get_arguments_base(__arg_vm); \
         js_assert(__nargs == 1); \
         js_assert(js_is_string(__argbase)); \
@@ -80,7 +86,7 @@ const char *js_std_pathsep = "/";
 
 #define _two_string_arguments(__arg_vm, __arg_str_0, __arg_str_1, __arg_statement) \
     do { \
-        uint16_t __nargs = js_get_arguments_length(__arg_vm); \
+        uint32_t __nargs = js_get_arguments_length(__arg_vm); \
         struct js_value *__argbase = js_get_arguments_base(__arg_vm); \
         js_assert(__nargs == 2); \
         js_assert(js_is_string(__argbase)); \
@@ -90,101 +96,224 @@ const char *js_std_pathsep = "/";
         __arg_statement; \
     } while (0);
 
-struct js_result js_std_chdir(struct js_vm *vm) {
-    _one_string_argument(vm, path, {
-        _posix_zero_on_success(chdir(path));
-        _return_null();
-    });
+static bool _is_hash_container(struct js_value *value) {
+    return value->type == vt_hashmap || value->type == vt_hashset;
 }
 
-struct js_result js_std_clock(struct js_vm *vm) {
-    js_return(js_number(clock() * 1.0 / CLOCKS_PER_SEC));
+// same as '=='
+static bool _value_equal(struct js_value *lhs, struct js_value *rhs) {
+    if (memcmp(lhs, rhs, sizeof(struct js_value)) == 0) {
+        return true;
+    } else if (lhs->type == vt_number && rhs->type == vt_number) {
+        return lhs->number == rhs->number;
+    } else if (js_is_string(lhs) && js_is_string(rhs)) {
+        return js_string_compare(lhs, rhs) == 0;
+    } else {
+        return false;
+    }
 }
 
-struct js_result js_std_dirname(struct js_vm *vm) {
-    _one_string_argument(vm, path, {
-        js_return(js_string_sz(&(vm->heap), dirname(path)));
-    });
+// first 2 arguments are array and callback, callback(element, index) is called for each non-hole element with one reused frame, 'break' is allowed inside block, error is returned
+#define _array_for_each_call(__arg_vm, __arg_argbase, __arg_retained, __arg_index, __arg_elem, __arg_ret, __arg_block) \
+    do { \
+        struct js_prepared_call __prepared; \
+        struct js_result __result = js_call_prepare(__arg_vm, &__prepared, (__arg_argbase)[1], __arg_retained); \
+        if (!__result.success) { \
+            return __result; \
+        } \
+        for (size_t __arg_index = js_array_next(__arg_argbase, 0); __arg_index < (__arg_argbase)->managed->array.length; __arg_index = js_array_next(__arg_argbase, __arg_index + 1)) { \
+            struct js_value __args[2] = {js_array_get(__arg_argbase, __arg_index), js_number((double)__arg_index)}; \
+            struct js_value __arg_elem = __args[0]; \
+            __result = js_call_prepared(__arg_vm, &__prepared, __args, 2); \
+            if (!__result.success) { \
+                break; \
+            } \
+            struct js_value __arg_ret = __result.value; \
+            __arg_block; \
+        } \
+        js_call_release(__arg_vm, &__prepared); \
+        if (!__result.success) { \
+            return __result; \
+        } \
+    } while (0)
+
+// convert javascript style relative index to absolute
+static size_t _relative_index(struct js_value *value, size_t length, size_t default_value) {
+    if (value == NULL) {
+        return default_value;
+    }
+    double index = value->number < 0 ? max((double)length + value->number, 0) : min(value->number, (double)length);
+    return (size_t)index;
 }
 
-struct js_result js_std_endswith(struct js_vm *vm) {
-    _two_string_arguments(vm, lhs, rhs, js_return(js_boolean(string_ends_with_sz(lhs, rhs))));
+// add(set, ...values)
+struct js_result js_std_add(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs >= 1);
+    js_assert(argbase->type == vt_hashset);
+    for (uint32_t i = 1; i < nargs; i++) {
+        js_assert(argbase[i].type != vt_null);
+        js_hashmap_put(argbase, argbase[i], js_boolean(true));
+    }
+    _return_null();
 }
 
-struct js_result js_std_exists(struct js_vm *vm) {
-#ifdef _WIN32
-    _one_string_argument(vm, path, {
-        js_return(js_boolean(GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES ? true : false));
-    });
-#else
-    _one_string_argument(vm, path, {
-        js_return(js_boolean(access(path, F_OK) == 0 ? true : false));
-    });
-#endif
+// byte buffer is a c_value, a slice is a view which shares memory and keeps its owner alive
+struct _bytes {
+    uint8_t *base;
+    size_t length;
+    struct js_value owner; // vt_undefined if base is owned by itself
+};
+
+static void _bytes_mark(void *data) {
+    js_mark(&(((struct _bytes *)data)->owner));
 }
 
-struct js_result js_std_format(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
+static void _bytes_sweep(void *data) {
+    struct _bytes *bytes = (struct _bytes *)data;
+    if (bytes->owner.type == vt_undefined) {
+        free(bytes->base);
+    }
+    free(bytes);
+}
+
+// sweep function pointer verifies type
+static struct _bytes *_bytes_of(struct js_value *value) {
+    if (value->type == vt_c_value && value->managed->c_value.sweep == _bytes_sweep) {
+        return (struct _bytes *)value->managed->c_value.data;
+    } else {
+        return NULL;
+    }
+}
+
+// zero filled
+static struct js_value _bytes_new(struct js_heap *heap, size_t length) {
+    struct _bytes *bytes = alloc(struct _bytes, 1);
+    bytes->base = alloc(uint8_t, length > 0 ? length : 1);
+    bytes->length = length;
+    return js_c_value(heap, bytes, _bytes_mark, _bytes_sweep);
+}
+
+// element type such as "u8" "i16le" "u32be" "f64le", multi-byte types must have "le" or "be" suffix
+static bool _bytes_parse_type(const char *type, char *kind, size_t *size, bool *big_endian) {
+    *kind = type[0];
+    if (*kind != 'u' && *kind != 'i' && *kind != 'f') {
+        return false;
+    }
+    char *end;
+    unsigned long bits = strtoul(type + 1, &end, 10);
+    if (*kind == 'f' ? bits != 32 && bits != 64 : bits != 8 && bits != 16 && bits != 32 && bits != 64) {
+        return false;
+    }
+    *size = bits / 8;
+    *big_endian = false;
+    if (*size == 1) {
+        return *end == '\0';
+    } else if (strcmp(end, "le") == 0) {
+        return true;
+    } else if (strcmp(end, "be") == 0) {
+        *big_endian = true;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+#define _bytes_access_arguments(__arg_vm, __arg_nargs, __arg_bytes, __arg_p, __arg_kind, __arg_size, __arg_big_endian) \
+    js_assert(__arg_nargs >= 3); \
+    struct _bytes *__arg_bytes = _bytes_of(argbase); \
+    js_assert(__arg_bytes != NULL); \
+    js_assert(argbase[1].type == vt_number); \
+    js_assert(js_is_string(argbase + 2)); \
+    char __arg_kind; \
+    size_t __arg_size; \
+    bool __arg_big_endian; \
+    if (!_bytes_parse_type(js_string_base(argbase + 2), &__arg_kind, &__arg_size, &__arg_big_endian)) { \
+        js_throw(js_scripture_sz("Unknown bytes element type")); \
+    } \
+    if (argbase[1].number < 0 || argbase[1].number != (size_t)argbase[1].number || (size_t)argbase[1].number + __arg_size > __arg_bytes->length) { \
+        js_throw(js_scripture_sz("Bytes offset out of range")); \
+    } \
+    uint8_t *__arg_p = __arg_bytes->base + (size_t)argbase[1].number;
+
+struct js_result js_std_bytes(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
     struct js_value *argbase = js_get_arguments_base(vm);
-    js_assert(nargs > 0);
-    js_assert(js_is_string(argbase));
-    struct js_value ret = js_string(&(vm->heap), NULL, 0);
-    enum { _searching,
-        _expect_left_brace,
-        _matching } state = _searching;
-    char *vbase = NULL;
-    for (char *p = js_string_base(argbase); p < js_string_base(argbase) + js_string_length(argbase); p++) {
-        // log_debug("%d %c", state, *p);
-        switch (state) {
-        case _searching:
-            if (*p == '$') {
-                state = _expect_left_brace;
-            } else {
-                string_buffer_append_ch(
-                    ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity, *p);
-            }
-            break;
-        case _expect_left_brace:
-            js_assert(*p == '{');
-            vbase = p + 1;
-            state = _matching;
-            break;
-        case _matching:
-            if (*p == '}') {
-                uint16_t vlen = (uint16_t)(p - vbase);
-                struct js_value val;
-                if (isdigit(*vbase)) {
-                    uint16_t idx = *vbase - '0';
-                    for (char *p = vbase + 1; p < vbase + vlen; p++) {
-                        js_assert(isdigit(*p));
-                        idx = idx * 10 + (*p - '0');
-                    }
-                    val = js_get_argument(vm, idx + 1);
-                } else {
-                    struct js_result ret = js_get_variable(vm, vbase, vlen);
-                    if (!ret.success) {
-                        return ret;
-                    }
-                    val = ret.value;
-                }
-                js_assert(js_is_string(&val));
-                string_buffer_append(
-                    ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity,
-                    js_string_base(&val), js_string_length(&val));
-                state = _searching;
-            }
-            break;
-        default:
-            break;
-        }
+    js_assert(nargs == 1);
+    struct _bytes *src = _bytes_of(argbase);
+    struct js_value ret;
+    if (argbase->type == vt_number) {
+        js_assert(argbase->number >= 0 && argbase->number == (size_t)argbase->number);
+        ret = _bytes_new(&(vm->heap), (size_t)argbase->number);
+    } else if (js_is_string(argbase)) {
+        ret = _bytes_new(&(vm->heap), js_string_length(argbase));
+        memcpy(_bytes_of(&ret)->base, js_string_base(argbase), js_string_length(argbase));
+    } else if (src) {
+        ret = _bytes_new(&(vm->heap), src->length);
+        memcpy(_bytes_of(&ret)->base, src->base, src->length);
+    } else {
+        js_throw(js_scripture_sz("Require length, string or bytes"));
     }
-    js_assert(state == _searching); // test if correctly ended with '}'
     js_return(ret);
 }
 
-struct js_result js_std_fread(struct js_vm *vm) {
+// bytesget(buf, offset, type)
+struct js_result js_std_bytesget(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    _bytes_access_arguments(vm, nargs, bytes, p, kind, size, big_endian);
+    js_assert(nargs == 3);
+    uint64_t raw = 0;
+    for (size_t i = 0; i < size; i++) {
+        raw |= (uint64_t)p[big_endian ? size - 1 - i : i] << (8 * i);
+    }
+    if (kind == 'u') {
+        js_return(js_number((double)raw));
+    } else if (kind == 'i') {
+        // sign extend
+        js_return(js_number((double)((int64_t)(raw << (64 - 8 * size)) >> (64 - 8 * size))));
+    } else if (size == 4) {
+        uint32_t raw32 = (uint32_t)raw;
+        float f;
+        memcpy(&f, &raw32, sizeof(f));
+        js_return(js_number(f));
+    } else {
+        double d;
+        memcpy(&d, &raw, sizeof(d));
+        js_return(js_number(d));
+    }
+}
+
+// bytesput(buf, offset, type, value), integers wrap around
+struct js_result js_std_bytesput(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    _bytes_access_arguments(vm, nargs, bytes, p, kind, size, big_endian);
+    js_assert(nargs == 4);
+    js_assert(argbase[3].type == vt_number);
+    double number = argbase[3].number;
+    uint64_t raw;
+    if (kind != 'f') {
+        js_assert(isfinite(number));
+        raw = number < 0 ? (uint64_t)(int64_t)number : (uint64_t)number;
+    } else if (size == 4) {
+        float f = (float)number;
+        uint32_t raw32;
+        memcpy(&raw32, &f, sizeof(f));
+        raw = raw32;
+    } else {
+        memcpy(&raw, &number, sizeof(raw));
+    }
+    for (size_t i = 0; i < size; i++) {
+        p[big_endian ? size - 1 - i : i] = (uint8_t)(raw >> (8 * i));
+    }
+    _return_null();
+}
+
+struct js_result js_std_bytesread(struct js_vm *vm) {
     _one_string_argument(vm, fname, {
-        FILE *fp = fopen(fname, "r");
+        FILE *fp = fopen(fname, "rb");
         if (fp == NULL) {
             _throw_posix_error(vm);
         }
@@ -201,38 +330,60 @@ struct js_result js_std_fread(struct js_vm *vm) {
             fclose(fp);
             _throw_posix_error(vm);
         }
-        struct js_value ret = js_string(&(vm->heap), NULL, 0);
-        buffer_alloc(
-            ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity,
-            fsize + 1); // always +1 to make sure null terminated
-        size_t num_read = fread(ret.managed->string.base, 1, fsize, fp);
-        // log_debug("fsize=%ld num_read=%zu", fsize, num_read);
-        // if (feof(fp)) {
-        //     log_debug("eof");
-        // }
+        struct js_value ret = _bytes_new(&(vm->heap), fsize);
+        struct _bytes *bytes = _bytes_of(&ret);
+        bytes->length = fread(bytes->base, 1, fsize, fp);
         if (ferror(fp)) {
             fclose(fp);
             _throw_posix_error(vm);
         }
-        ret.managed->string.length = num_read;
         fclose(fp);
         js_return(ret);
     });
 }
 
-struct js_result js_std_fwrite(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
+// byteslice(buf, begin, end), same rule as javascript's subarray, no copy
+struct js_result js_std_byteslice(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2 || nargs == 3);
+    struct _bytes *src = _bytes_of(argbase);
+    js_assert(src != NULL);
+    js_assert(argbase[1].type == vt_number);
+    js_assert(nargs == 2 || argbase[2].type == vt_number);
+    double length = (double)src->length;
+    double begin = argbase[1].number < 0 ? max(length + argbase[1].number, 0) : min(argbase[1].number, length);
+    double end = nargs == 2 ? length : (argbase[2].number < 0 ? max(length + argbase[2].number, 0) : min(argbase[2].number, length));
+    struct _bytes *view = alloc(struct _bytes, 1);
+    view->base = src->base + (size_t)begin;
+    view->length = end > begin ? (size_t)end - (size_t)begin : 0;
+    view->owner = src->owner.type == vt_undefined ? *argbase : src->owner;
+    js_return(js_c_value(&(vm->heap), view, _bytes_mark, _bytes_sweep));
+}
+
+// decode as string, string is always null terminated so it's a copy
+struct js_result js_std_bytestring(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    struct _bytes *bytes = _bytes_of(argbase);
+    js_assert(bytes != NULL);
+    js_return(js_string(&(vm->heap), (const char *)bytes->base, bytes->length));
+}
+
+// byteswrite(buf, fname), same argument order as fwrite
+struct js_result js_std_byteswrite(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
     struct js_value *argbase = js_get_arguments_base(vm);
     js_assert(nargs == 2);
-    js_assert(js_is_string(argbase));
+    struct _bytes *bytes = _bytes_of(argbase);
+    js_assert(bytes != NULL);
     js_assert(js_is_string(argbase + 1));
-    char *str = js_string_base(argbase);
-    size_t slen = js_string_length(argbase);
-    char *fname = js_string_base(argbase + 1);
-    FILE *fp = fopen(fname, "w");
-    fwrite(str, 1, slen, fp);
-    // size_t num_written = fwrite(str, 1, slen, fp);
-    // log_debug("slen=%zu num_written=%zu", slen, num_written);
+    FILE *fp = fopen(js_string_base(argbase + 1), "wb");
+    if (fp == NULL) {
+        _throw_posix_error(vm);
+    }
+    fwrite(bytes->base, 1, bytes->length, fp);
     if (ferror(fp)) {
         fclose(fp);
         _throw_posix_error(vm);
@@ -241,330 +392,2309 @@ struct js_result js_std_fwrite(struct js_vm *vm) {
     _return_null();
 }
 
-struct js_result js_std_getcwd(struct js_vm *vm) {
-    char *cwd = getcwd(NULL, 0);
-    if (cwd) {
-        struct js_value ret = js_string_sz(&(vm->heap), (const char *)cwd);
-        free(cwd);
-        js_return(ret);
-    } else {
-        js_throw(js_string_sz(&(vm->heap), (const char *)strerror(errno)));
+struct js_result js_std_chdir(struct js_vm *vm) {
+    _one_string_argument(vm, path, {
+        _posix_zero_on_success(chdir(path));
+        _return_null();
+    });
+}
+
+struct js_result js_std_clock(struct js_vm *vm) {
+    js_return(js_number(clock() * 1.0 / CLOCKS_PER_SEC));
+}
+
+// file handle is a c_value, files opened by open() have large stdio buffer, so that reading and writing have few syscalls
+struct _file {
+    FILE *fp; // NULL if closed
+    char *buffer; // NULL if is standard stream, which is never closed
+};
+
+#define _file_buffer_size (1 << 20)
+
+static void _file_sweep(void *data) {
+    struct _file *file = (struct _file *)data;
+    if (file->fp && file->buffer) {
+        fclose(file->fp);
     }
+    free(file->buffer);
+    free(file);
 }
 
-struct js_result js_std_input(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
-    if (nargs > 1) {
-        js_throw(js_scripture_sz("Too many arguments"));
+static struct js_value _file_new(struct js_heap *heap, FILE *fp, char *buffer) {
+    struct _file *file = alloc(struct _file, 1);
+    file->fp = fp;
+    file->buffer = buffer;
+    return js_c_value(heap, file, NULL, _file_sweep);
+}
+
+// first argument must be opened file handle
+#define _file_argument(__arg_file) \
+    struct _file *__arg_file = argbase->type == vt_c_value && argbase->managed->c_value.sweep == _file_sweep ? (struct _file *)argbase->managed->c_value.data : NULL; \
+    js_assert(__arg_file != NULL); \
+    if (__arg_file->fp == NULL) { \
+        js_throw(js_scripture_sz("File is closed")); \
     }
-    if (nargs == 1) {
-        struct js_value *argbase = js_get_arguments_base(vm);
-        if (!js_is_string(argbase)) {
-            js_throw(js_scripture_sz("Prompt must be string"));
-        }
-        js_value_print(argbase);
+
+// close(file), standard streams are only flushed
+struct js_result js_std_close(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    _file_argument(file);
+    if (file->buffer == NULL) {
+        _posix_zero_on_success(fflush(file->fp));
+    } else {
+        int ret = fclose(file->fp);
+        file->fp = NULL;
+        _posix_zero_on_success(ret);
     }
-    struct js_value line = js_string(&(vm->heap), NULL, 0);
-    read_line(stdin, line.managed->string.base, line.managed->string.length, line.managed->string.capacity);
-    js_return(line);
+    _return_null();
 }
 
-struct js_result js_std_join(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
+// concat(...values), arrays are spread, others are appended
+struct js_result js_std_concat(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
     struct js_value *argbase = js_get_arguments_base(vm);
-    js_assert(nargs == 2);
-    js_assert(argbase->type == vt_array);
-    js_assert(js_is_string(argbase + 1));
-    struct js_value ret = js_string(&(vm->heap), NULL, 0);
-    for (size_t i = 0; i < argbase->managed->array.length; i++) {
-        // be careful of vt_undefined
-        struct js_value *elem = argbase->managed->array.base + i;
-        js_assert(js_is_string(elem));
-        if (i > 0) {
-            string_buffer_append(
-                ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity,
-                js_string_base(argbase + 1), js_string_length(argbase + 1));
+    struct js_value ret = js_array(&(vm->heap));
+    for (uint32_t i = 0; i < nargs; i++) {
+        if (argbase[i].type == vt_array) {
+            js_array_spread(&ret, argbase + i);
+        } else {
+            js_array_push(&ret, argbase[i]);
         }
-        string_buffer_append(
-            ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity,
-            js_string_base(elem), js_string_length(elem));
     }
     js_return(ret);
 }
 
-struct js_result js_std_length(struct js_vm *vm) {
-    if (js_get_arguments_length(vm) != 1) {
-        js_throw(js_scripture_sz("Require exactly one argument"));
+enum _entry_type { _entry_file, _entry_dir, _entry_link, _entry_other };
+
+static const char *_entry_type_names[] = {"file", "dir", "link", "other"};
+
+#ifdef _WIN32
+// rough mapping, only for error message
+static void _set_errno_from_last_error() {
+    DWORD error = GetLastError();
+    errno = error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND  ? ENOENT
+            : error == ERROR_FILE_EXISTS || error == ERROR_ALREADY_EXISTS ? EEXIST
+            : error == ERROR_NOT_SAME_DEVICE                              ? EXDEV
+                                                                          : EACCES;
+}
+#else
+    #define _copy_chunk (1 << 30) // for kernel
+    #define _copy_buffer_size (1 << 20) // for read/write fallback
+
+// continues from current offsets, so each method can take over where previous one gave up
+// nothing copied may also mean files like /proc/* which report zero size, so next method is tried
+static bool _copy_fd(int in, int out) {
+    ssize_t n;
+    size_t copied = 0;
+    #ifdef SYS_copy_file_range
+    // glibc wrapper requires _GNU_SOURCE, may be refused across file systems by old kernels or by some file systems
+    while ((n = syscall(SYS_copy_file_range, in, NULL, out, NULL, _copy_chunk, 0)) > 0) {
+        copied += n;
     }
-    struct js_value *argbase = js_get_arguments_base(vm);
-    if (argbase->type == vt_array) {
-        js_return(js_number((double)argbase->managed->array.length));
-    } else if (argbase->type == vt_object) {
-        js_return(js_number((double)argbase->managed->object.length));
-    } else if (js_is_string(argbase)) {
-        js_return(js_number((double)js_string_length(argbase)));
-    } else {
-        js_throw(js_scripture_sz("Only string, array and object have length"));
+    if (n == 0 && copied > 0) {
+        return true;
+    } else if (n < 0 && errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP && errno != EPERM) {
+        return false;
+    }
+    #endif
+    #ifdef __linux__
+    while ((n = sendfile(out, in, NULL, _copy_chunk)) > 0) {
+        copied += n;
+    }
+    if (n == 0 && copied > 0) {
+        return true;
+    } else if (n < 0 && errno != EINVAL && errno != ENOSYS) {
+        return false;
+    }
+    #endif
+    char *buffer = alloc(char, _copy_buffer_size);
+    while ((n = read(in, buffer, _copy_buffer_size)) > 0) {
+        for (ssize_t written = 0, w; written < n; written += w) {
+            if ((w = write(out, buffer + written, n - written)) < 0) {
+                free(buffer);
+                return false;
+            }
+        }
     }
+    free(buffer);
+    return n == 0;
 }
+#endif
 
-struct js_result js_std_listdir(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
-    struct js_value *argbase = js_get_arguments_base(vm);
-    js_assert(nargs == 2);
-    js_assert(js_is_string(argbase));
-    js_assert(js_is_function(argbase + 1));
-    char *dir = js_string_base(argbase);
-    // must be standardized for windows '*'
-    char *standardized_dir =
-        string_ends_with_sz(dir, js_std_pathsep) ? string_concat_sz(dir) : string_concat_sz(dir, js_std_pathsep);
-    bool isdir;
-    char *filename;
-    struct js_result result = {.success = true, .value = js_null()};
-    bool all_success = true;
+// data never passes through user space if possible, errno is set if failed
+static bool _copy_file(const char *src, const char *dst) {
 #ifdef _WIN32
-    char *pattern = string_concat_sz(standardized_dir, "*");
-    HANDLE sh;
-    WIN32_FIND_DATAA fd;
-    sh = FindFirstFileA(pattern, &fd);
-    if (sh != INVALID_HANDLE_VALUE) {
-        do {
-            isdir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
-            filename = fd.cFileName;
+    if (CopyFileA(src, dst, FALSE)) {
+        return true;
+    }
+    _set_errno_from_last_error();
+    return false;
 #else
-    // https://www.geeksforgeeks.org/c-program-list-files-sub-directories-directory/
-    struct dirent *de;
-    DIR *dr = opendir(standardized_dir);
-    if (dr != NULL) {
-        while ((de = readdir(dr)) != NULL) {
-            isdir = de->d_type == DT_DIR;
-            filename = de->d_name;
+    int in = open(src, O_RDONLY);
+    if (in == -1) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0 || (S_ISDIR(st.st_mode) && (errno = EISDIR))) {
+        close(in);
+        return false;
+    }
+    // truncated only after checking it is not source itself or its hard link, or content is lost
+    int out = open(dst, O_WRONLY | O_CREAT, st.st_mode & 07777);
+    if (out == -1) {
+        close(in);
+        return false;
+    }
+    struct stat out_st;
+    if (fstat(out, &out_st) != 0 || (out_st.st_dev == st.st_dev && out_st.st_ino == st.st_ino && (errno = EINVAL)) || ftruncate(out, 0) != 0) {
+        int error = errno;
+        close(in);
+        close(out);
+        errno = error;
+        return false;
+    }
+    bool success = _copy_fd(in, out);
+    int error = errno;
+    close(in);
+    if (close(out) != 0 && success) {
+        return false;
+    }
+    errno = error;
+    return success;
 #endif
-            // BEGIN BLOCK
-            // log_debug("isdir=%d standardized_dir=%s filename=%s", isdir, standardized_dir, filename);
-            // if (isdir) {
-            //     if (!string_equals_sz(filename, ".") && !string_equals_sz(filename, "..")) {
-            //         char *subdir = string_concat_sz(standardized_dir, filename, js_std_pathsep);
-            //         result = js_call(vm, argbase[1],
-            //             (struct js_value[]){js_string_sz(&(vm->heap), subdir), js_null(), js_null()}, 3);
-            //         free(subdir);
-            //     } else {
-            //         result = ((struct js_result){.success = true, .value = js_null()});
-            //     }
-            // } else {
-            //     char *ext = strrchr(filename, '.');
-            //     if (ext) {
-            //         size_t baselen = ext - filename;
-            //         char *base = (char *)calloc(baselen + 1, 1);
-            //         strncpy(base, filename, baselen);
-            //         result = js_call(vm, argbase[1],
-            //             (struct js_value[]){
-            //                 js_string_sz(&(vm->heap), standardized_dir),
-            //                 js_string_sz(&(vm->heap), base),
-            //                 js_string_sz(&(vm->heap), ext)},
-            //             3);
-            //         free(base);
-            //     } else {
-            //         result = js_call(vm, argbase[1],
-            //             (struct js_value[]){
-            //                 js_string_sz(&(vm->heap), standardized_dir),
-            //                 js_string_sz(&(vm->heap), filename),
-            //                 js_scripture_sz("")},
-            //             3);
-            //     }
-            // }
-            if (isdir && (string_equals_sz(filename, ".") || string_equals_sz(filename, ".."))) {
-                result = ((struct js_result){.success = true, .value = js_null()});
-            } else {
-                result = js_call(vm, argbase[1],
-                    (struct js_value[]){
-                        js_string_sz(&(vm->heap), filename),
-                        js_boolean(isdir)},
-                    2);
-            }
-            if (!result.success) {
-                all_success = false;
-                break;
-            }
-            // END BLOCK
+}
+
+// link itself instead of its target, on windows links are skipped since creating them requires privilege
+static bool _copy_link(const char *src, const char *dst) {
 #ifdef _WIN32
-        } while (FindNextFileA(sh, &fd) != 0);
-        FindClose(sh);
+    (void)src;
+    (void)dst;
+    return true;
+#else
+    struct stat st;
+    if (lstat(src, &st) != 0) {
+        return false;
     }
+    char *target = alloc(char, st.st_size + 1);
+    ssize_t length = readlink(src, target, st.st_size + 1);
+    bool success = length >= 0 && length <= st.st_size && symlink(target, dst) == 0;
+    free(target);
+    return success;
+#endif
+}
+
+struct _dir_entry {
+    char *name;
+    enum _entry_type type;
+};
+
+// excluding '.' and '..', links are not followed, on windows only directory links (including junctions) are links, errno is set if failed
+static bool _read_dir(const char *dir, struct _dir_entry **base, size_t *length, size_t *capacity) {
+#ifdef _WIN32
+    char *pattern = string_concat_sz(dir, js_std_pathsep, "*");
+    WIN32_FIND_DATAA fd;
+    HANDLE sh = FindFirstFileA(pattern, &fd);
     free(pattern);
+    if (sh == INVALID_HANDLE_VALUE) {
+        _set_errno_from_last_error();
+        return false;
+    }
+    do {
+        if (string_equals_sz(fd.cFileName, ".") || string_equals_sz(fd.cFileName, "..")) {
+            continue;
+        }
+        enum _entry_type type = !(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)       ? _entry_file
+                                : (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? _entry_link
+                                                                                       : _entry_dir;
+        struct _dir_entry entry = {.name = string_dupe_sz(fd.cFileName), .type = type};
+        buffer_push(*base, *length, *capacity, entry);
+    } while (FindNextFileA(sh, &fd));
+    FindClose(sh);
 #else
+    DIR *dr = opendir(dir);
+    if (dr == NULL) {
+        return false;
+    }
+    struct dirent *de;
+    while ((de = readdir(dr)) != NULL) {
+        if (string_equals_sz(de->d_name, ".") || string_equals_sz(de->d_name, "..")) {
+            continue;
         }
-        closedir(dr);
+        struct stat st;
+        if (fstatat(dirfd(dr), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            closedir(dr);
+            return false;
+        }
+        enum _entry_type type = S_ISREG(st.st_mode)   ? _entry_file
+                                : S_ISDIR(st.st_mode) ? _entry_dir
+                                : S_ISLNK(st.st_mode) ? _entry_link
+                                                      : _entry_other;
+        struct _dir_entry entry = {.name = string_dupe_sz(de->d_name), .type = type};
+        buffer_push(*base, *length, *capacity, entry);
     }
+    closedir(dr);
 #endif
-    free(standardized_dir);
-    if (all_success) {
-        _return_null();
-    } else {
-        return result;
+    return true;
+}
+
+// directory is listed at once before descending, so that open handles don't pile up in deep trees
+#define _for_each_dir_entry(__arg_dir, __arg_name, __arg_path, __arg_type, __arg_success, __arg_block) \
+    do { \
+        struct _dir_entry *__base = NULL; \
+        size_t __length = 0; \
+        size_t __capacity = 0; \
+        (__arg_success) = _read_dir(__arg_dir, &__base, &__length, &__capacity); \
+        for (size_t __i = 0; __i < __length; __i++) { \
+            if (__arg_success) { \
+                const char *__arg_name = __base[__i].name; \
+                char *__arg_path = string_concat_sz(__arg_dir, js_std_pathsep, __arg_name); \
+                enum _entry_type __arg_type = __base[__i].type; \
+                __arg_block; \
+                free(__arg_path); \
+            } \
+            free(__base[__i].name); \
+        } \
+        buffer_free(__base, __length, __capacity); \
+    } while (0)
+
+// pipes, sockets and devices are skipped
+static bool _copy_tree(const char *src, const char *dst) {
+    if (_mkdir(dst) != 0) {
+        return false;
     }
+    bool success;
+    _for_each_dir_entry(src, name, from, type, success, {
+        char *to = string_concat_sz(dst, js_std_pathsep, name);
+        if (type == _entry_file) {
+            success = _copy_file(from, to);
+        } else if (type == _entry_dir) {
+            success = _copy_tree(from, to);
+        } else if (type == _entry_link) {
+            success = _copy_link(from, to);
+        }
+        free(to);
+    });
+    return success;
 }
 
-struct js_result js_std_mkdir(struct js_vm *vm) {
-    _one_string_argument(vm, path, {
-        _posix_zero_on_success(_mkdir(path));
+static int _remove_link(const char *path) {
+#ifdef _WIN32
+    // directory link must be removed as directory, without following it
+    return rmdir(path);
+#else
+    return remove(path);
+#endif
+}
+
+static bool _remove_tree(const char *path) {
+    bool success;
+    _for_each_dir_entry(path, name, child, type, success, {
+        (void)name;
+        if (type == _entry_dir) {
+            success = _remove_tree(child);
+        } else if (type == _entry_link) {
+            success = _remove_link(child) == 0;
+        } else {
+            success = remove(child) == 0;
+        }
+    });
+    return success && rmdir(path) == 0;
+}
+
+// copy(src, dst), dst is file name, not directory
+struct js_result js_std_copy(struct js_vm *vm) {
+    _two_string_arguments(vm, src, dst, {
+        if (!_copy_file(src, dst)) {
+            _throw_posix_error(vm);
+        }
         _return_null();
     });
 }
 
-struct js_result js_std_natural_compare(struct js_vm *vm) {
-    _two_string_arguments(vm, lhs, rhs, {
-        js_return(js_number(string_natural_compare_sz(lhs, rhs)));
+// copytree(src, dst), dst must not exist, links are copied as links
+struct js_result js_std_copytree(struct js_vm *vm) {
+    _two_string_arguments(vm, src, dst, {
+        if (!_copy_tree(src, dst)) {
+            _throw_posix_error(vm);
+        }
+        _return_null();
     });
 }
 
-struct js_result js_std_pop(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
+// coroutine(fn), fn(value) runs at first resume(), 'for of' resumes it until it returns
+struct js_result js_std_coroutine(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
     struct js_value *argbase = js_get_arguments_base(vm);
     js_assert(nargs == 1);
-    js_assert(argbase->type == vt_array);
-    js_assert(argbase->managed->array.length > 0);
-    argbase->managed->array.length--;
-    js_return(argbase->managed->array.base[argbase->managed->array.length]);
+    js_assert(argbase->type == vt_function);
+    js_return(js_coroutine(vm, *argbase));
 }
 
-struct js_result js_std_print(struct js_vm *vm) {
-    for (uint16_t i = 0; i < js_get_arguments_length(vm); i++) {
-        js_value_print(js_get_arguments_base(vm) + i);
-        printf(" ");
-    }
-    printf("\n");
-    _return_null();
+struct js_result js_std_dirname(struct js_vm *vm) {
+    _one_string_argument(vm, path, {
+        js_return(js_string_sz(&(vm->heap), dirname(path)));
+    });
 }
 
-struct js_result js_std_push(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
+struct js_result js_std_endswith(struct js_vm *vm) {
+    _two_string_arguments(vm, lhs, rhs, js_return(js_boolean(string_ends_with_sz(lhs, rhs))));
+}
+
+struct js_result js_std_erase(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
     struct js_value *argbase = js_get_arguments_base(vm);
     js_assert(nargs == 2);
-    js_assert(argbase->type == vt_array);
-    js_array_push(argbase, argbase[1]);
+    js_assert(_is_hash_container(argbase));
+    js_hashmap_put(argbase, argbase[1], js_null());
     _return_null();
 }
 
-struct js_result js_std_remove(struct js_vm *vm) {
+struct js_result js_std_exists(struct js_vm *vm) {
+#ifdef _WIN32
     _one_string_argument(vm, path, {
-        _posix_zero_on_success(remove(path));
-        _return_null();
+        js_return(js_boolean(GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES ? true : false));
     });
-}
-
-struct js_result js_std_rmdir(struct js_vm *vm) {
+#else
     _one_string_argument(vm, path, {
-        _posix_zero_on_success(rmdir(path));
-        _return_null();
+        js_return(js_boolean(access(path, F_OK) == 0 ? true : false));
     });
+#endif
 }
 
-struct _comparator_context {
-    struct js_vm *vm;
-    struct js_value *func;
-};
-
-// mingw is also windows style
-#ifdef _WIN32
-static int _comparator(void *ctx, const void *lhs, const void *rhs) {
-#else
-static int _comparator(const void *lhs, const void *rhs, void *ctx) {
-#endif
-    struct _comparator_context *comp_ctx = (struct _comparator_context *)ctx;
-    struct js_result result = js_call(
-        comp_ctx->vm, *(comp_ctx->func),
-        (struct js_value[]){*((struct js_value *)lhs), *((struct js_value *)rhs)}, 2);
-    if (!result.success || result.value.type != vt_number) {
-        return 0;
-    } else {
-        return (int)result.value.number;
+// typed array from length, array or another typed array
+// fill(arr, value, [begin, [end]]), in place, won't expand
+struct js_result js_std_fill(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs >= 2 && nargs <= 4);
+    js_assert(argbase->type == vt_array);
+    js_assert(nargs < 3 || argbase[2].type == vt_number);
+    js_assert(nargs < 4 || argbase[3].type == vt_number);
+    size_t length = argbase->managed->array.length;
+    size_t begin = _relative_index(nargs >= 3 ? argbase + 2 : NULL, length, 0);
+    size_t end = _relative_index(nargs >= 4 ? argbase + 3 : NULL, length, length);
+    for (size_t i = begin; i < end; i++) {
+        js_array_put(argbase, i, argbase[1]);
     }
+    js_return(*argbase);
 }
 
-struct js_result js_std_sort(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
+// filter(arr, callback), callback(element, index) must return boolean
+struct js_result js_std_filter(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
     struct js_value *argbase = js_get_arguments_base(vm);
     js_assert(nargs == 2);
     js_assert(argbase->type == vt_array);
-    js_assert(js_is_function(argbase + 1));
-    struct _comparator_context ctx = {.vm = vm, .func = argbase + 1};
-#ifdef _WIN32
-    qsort_s(argbase->managed->array.base, argbase->managed->array.length,
-        sizeof(struct js_value), _comparator, &ctx);
-#else
-    qsort_r(argbase->managed->array.base, argbase->managed->array.length,
-        sizeof(struct js_value), _comparator, &ctx);
-#endif
-    _return_null();
+    struct js_value ret = js_array(&(vm->heap));
+    bool boolean = true;
+    _array_for_each_call(vm, argbase, ret, i, elem, yes, {
+        if (yes.type != vt_boolean) {
+            boolean = false;
+            break;
+        }
+        if (yes.boolean) {
+            js_array_push(&ret, elem);
+        }
+    });
+    if (!boolean) {
+        js_throw(js_scripture_sz("Callback must return boolean"));
+    }
+    js_return(ret);
 }
 
-struct js_result js_std_split(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
+// find(arr, callback), returns first element which callback(element, index) returns true, or null
+struct js_result js_std_find(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
     struct js_value *argbase = js_get_arguments_base(vm);
     js_assert(nargs == 2);
-    js_assert(js_is_string(argbase));
-    js_assert(js_is_string(argbase + 1));
-    // DON'T use strtok, will modify source
-    char *str = js_string_base(argbase);
-    size_t slen = js_string_length(argbase);
-    char *delim = js_string_base(argbase + 1);
-    size_t dlen = js_string_length(argbase + 1);
-    js_assert(dlen > 0);
-    struct js_value ret = js_array(&(vm->heap));
-    char *p, *q;
-    for (p = str; p < str + slen;) {
-        q = strstr(p, delim);
-        // log_debug("%s %s", p, q);
-        // see https://en.cppreference.com/w/c/string/byte/strstr.html for return value
-        // TODO: optimize for scripture?
-        // if delim is an empty string, acorrding to standard, cannot distinguish with match on first character, so empty string is forbidden here
-        if (q == NULL) {
-            js_array_push(&ret, js_string(&(vm->heap), p, str + slen - p));
+    js_assert(argbase->type == vt_array);
+    struct js_value ret = js_null();
+    _array_for_each_call(vm, argbase, js_null(), i, elem, yes, {
+        if (yes.type == vt_boolean && yes.boolean) {
+            ret = elem;
             break;
-        } else {
-            js_array_push(&ret, js_string(&(vm->heap), p, q - p));
-            p = q + dlen;
         }
-    }
-    if (q != NULL) {
-        js_array_push(&ret, js_scripture_sz(""));
-    }
+    });
     js_return(ret);
 }
 
-struct js_result js_std_startswith(struct js_vm *vm) {
-    _two_string_arguments(vm, lhs, rhs, js_return(js_boolean(string_starts_with_sz(lhs, rhs))));
+static struct js_result _typed_array_new(struct js_vm *vm, enum js_typed_array_kind kind) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    struct js_value ret;
+    if (argbase->type == vt_number) {
+        js_assert(argbase->number >= 0 && argbase->number == (size_t)argbase->number);
+        js_return(js_typed_array(&(vm->heap), kind, (size_t)argbase->number));
+    } else if (argbase->type == vt_array) {
+        ret = js_typed_array(&(vm->heap), kind, argbase->managed->array.length);
+        for (size_t i = 0; i < argbase->managed->array.length; i++) {
+            if (!js_typed_array_put(&ret, i, js_array_get(argbase, i))) {
+                js_throw(js_scripture_sz("Typed array elements must be numbers"));
+            }
+        }
+        js_return(ret);
+    } else if (argbase->type == vt_typed_array) {
+        ret = js_typed_array(&(vm->heap), kind, argbase->managed->typed_array.length);
+        for (size_t i = 0; i < argbase->managed->typed_array.length; i++) {
+            js_typed_array_put(&ret, i, js_typed_array_get(argbase, i));
+        }
+        js_return(ret);
+    } else {
+        js_throw(js_scripture_sz("Require length, array or typed array"));
+    }
+}
+
+struct js_result js_std_float64array(struct js_vm *vm) {
+    return _typed_array_new(vm, ta_float64);
+}
+
+struct js_result js_std_flush(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    _file_argument(file);
+    _posix_zero_on_success(fflush(file->fp));
+    _return_null();
+}
+
+// fmap(fname), same as fread() but zero copy, string is read only mapped file, falls back to fread() if not supported
+struct js_result js_std_fmap(struct js_vm *vm) {
+    _one_string_argument(vm, fname, {
+        size_t length;
+        char *base = file_map(fname, &length);
+        if (base == NULL) {
+            return js_std_fread(vm);
+        }
+        js_return(js_mapped_string(&(vm->heap), base, length));
+    });
+}
+
+// foreach(arr, callback), callback(element, index)
+struct js_result js_std_foreach(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(argbase->type == vt_array);
+    _array_for_each_call(vm, argbase, js_null(), i, elem, ret, {
+        (void)elem;
+        (void)ret;
+    });
+    _return_null();
+}
+
+struct js_result js_std_format(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs > 0);
+    js_assert(js_is_string(argbase));
+    struct js_value ret = js_string(&(vm->heap), NULL, 0);
+    enum { _searching,
+        _expect_left_brace,
+        _matching } state = _searching;
+    char *vbase = NULL;
+    for (char *p = js_string_base(argbase); p < js_string_base(argbase) + js_string_length(argbase); p++) {
+        // log_debug("%d %c", state, *p);
+        switch (state) {
+        case _searching:
+            if (*p == '$') {
+                state = _expect_left_brace;
+            } else {
+                string_buffer_append_ch(
+                    ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity, *p);
+            }
+            break;
+        case _expect_left_brace:
+            js_assert(*p == '{');
+            vbase = p + 1;
+            state = _matching;
+            break;
+        case _matching:
+            if (*p == '}') {
+                uint32_t vlen = (uint32_t)(p - vbase);
+                struct js_value val;
+                if (isdigit(*vbase)) {
+                    uint32_t idx = *vbase - '0';
+                    for (char *p = vbase + 1; p < vbase + vlen; p++) {
+                        js_assert(isdigit(*p));
+                        idx = idx * 10 + (*p - '0');
+                    }
+                    val = js_get_argument(vm, idx + 1);
+                } else {
+                    struct js_result ret = js_get_variable(vm, vbase, vlen);
+                    if (!ret.success) {
+                        return ret;
+                    }
+                    val = ret.value;
+                }
+                js_assert(js_is_string(&val));
+                string_buffer_append(
+                    ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity,
+                    js_string_base(&val), js_string_length(&val));
+                state = _searching;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    js_assert(state == _searching); // test if correctly ended with '}'
+    js_return(ret);
+}
+
+struct js_result js_std_fread(struct js_vm *vm) {
+    _one_string_argument(vm, fname, {
+        FILE *fp = fopen(fname, "r");
+        if (fp == NULL) {
+            _throw_posix_error(vm);
+        }
+        if (fseek(fp, 0, SEEK_END) != 0) {
+            fclose(fp);
+            _throw_posix_error(vm);
+        }
+        long fsize = ftell(fp);
+        if (fsize == -1) {
+            fclose(fp);
+            _throw_posix_error(vm);
+        }
+        if (fseek(fp, 0, SEEK_SET) != 0) {
+            fclose(fp);
+            _throw_posix_error(vm);
+        }
+        struct js_value ret = js_string(&(vm->heap), NULL, 0);
+        buffer_alloc(
+            ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity,
+            fsize + 1); // always +1 to make sure null terminated
+        size_t num_read = fread(ret.managed->string.base, 1, fsize, fp);
+        // log_debug("fsize=%ld num_read=%zu", fsize, num_read);
+        // if (feof(fp)) {
+        //     log_debug("eof");
+        // }
+        if (ferror(fp)) {
+            fclose(fp);
+            _throw_posix_error(vm);
+        }
+        ret.managed->string.length = num_read;
+        fclose(fp);
+        js_return(ret);
+    });
+}
+
+struct js_result js_std_fwrite(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(js_is_string(argbase));
+    js_assert(js_is_string(argbase + 1));
+    char *str = js_string_base(argbase);
+    size_t slen = js_string_length(argbase);
+    char *fname = js_string_base(argbase + 1);
+    FILE *fp = fopen(fname, "w");
+    fwrite(str, 1, slen, fp);
+    // size_t num_written = fwrite(str, 1, slen, fp);
+    // log_debug("slen=%zu num_written=%zu", slen, num_written);
+    if (ferror(fp)) {
+        fclose(fp);
+        _throw_posix_error(vm);
+    }
+    fclose(fp);
+    _return_null();
+}
+
+struct js_result js_std_get(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(argbase->type == vt_hashmap);
+    js_return(js_hashmap_get(argbase, argbase[1]));
+}
+
+struct js_result js_std_getcwd(struct js_vm *vm) {
+    char *cwd = getcwd(NULL, 0);
+    if (cwd) {
+        struct js_value ret = js_string_sz(&(vm->heap), (const char *)cwd);
+        free(cwd);
+        js_return(ret);
+    } else {
+        js_throw(js_string_sz(&(vm->heap), (const char *)strerror(errno)));
+    }
+}
+
+struct js_result js_std_has(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(_is_hash_container(argbase));
+    js_return(js_boolean(js_hashmap_get(argbase, argbase[1]).type != vt_null));
+}
+
+struct js_result js_std_hashmap(struct js_vm *vm) {
+    js_assert(js_get_arguments_length(vm) == 0);
+    js_return(js_hashmap(&(vm->heap)));
+}
+
+// hashset(...values)
+struct js_result js_std_hashset(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    struct js_value ret = js_hashset(&(vm->heap));
+    for (uint32_t i = 0; i < nargs; i++) {
+        js_assert(argbase[i].type != vt_null);
+        js_hashmap_put(&ret, argbase[i], js_boolean(true));
+    }
+    js_return(ret);
+}
+
+// index of first element equals to value, or -1, numbers are scanned directly
+static double _array_index_of(struct js_value *arr, struct js_value *value) {
+    struct js_managed_value *managed = arr->managed;
+    if (managed->array.kind == ak_number) {
+        if (value->type == vt_number) {
+            for (size_t i = 0; i < managed->array.length; i++) {
+                if (managed->array.numbers[i] == value->number) {
+                    return (double)i;
+                }
+            }
+        }
+        return -1;
+    }
+    for (size_t i = js_array_next(arr, 0); i < managed->array.length; i = js_array_next(arr, i + 1)) {
+        struct js_value elem = js_array_get(arr, i);
+        if (_value_equal(&elem, value)) {
+            return (double)i;
+        }
+    }
+    return -1;
+}
+
+struct js_result js_std_includes(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(argbase->type == vt_array);
+    js_return(js_boolean(_array_index_of(argbase, argbase + 1) >= 0));
+}
+
+struct js_result js_std_indexof(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(argbase->type == vt_array);
+    js_return(js_number(_array_index_of(argbase, argbase + 1)));
+}
+
+struct js_result js_std_input(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    if (nargs > 1) {
+        js_throw(js_scripture_sz("Too many arguments"));
+    }
+    if (nargs == 1) {
+        struct js_value *argbase = js_get_arguments_base(vm);
+        if (!js_is_string(argbase)) {
+            js_throw(js_scripture_sz("Prompt must be string"));
+        }
+        js_value_print(argbase);
+    }
+    struct js_value line = js_string(&(vm->heap), NULL, 0);
+    read_line(stdin, line.managed->string.base, line.managed->string.length, line.managed->string.capacity);
+    js_return(line);
+}
+
+struct js_result js_std_int32array(struct js_vm *vm) {
+    return _typed_array_new(vm, ta_int32);
+}
+
+struct js_result js_std_join(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(argbase->type == vt_array);
+    js_assert(js_is_string(argbase + 1));
+    struct js_value ret = js_string(&(vm->heap), NULL, 0);
+    for (size_t i = 0; i < argbase->managed->array.length; i++) {
+        // be careful of vt_undefined
+        struct js_value elem_value = js_array_get(argbase, i);
+        struct js_value *elem = &elem_value;
+        js_assert(js_is_string(elem));
+        if (i > 0) {
+            string_buffer_append(
+                ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity,
+                js_string_base(argbase + 1), js_string_length(argbase + 1));
+        }
+        string_buffer_append(
+            ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity,
+            js_string_base(elem), js_string_length(elem));
+    }
+    js_return(ret);
+}
+
+struct js_result js_std_length(struct js_vm *vm) {
+    if (js_get_arguments_length(vm) != 1) {
+        js_throw(js_scripture_sz("Require exactly one argument"));
+    }
+    struct js_value *argbase = js_get_arguments_base(vm);
+    if (argbase->type == vt_array) {
+        js_return(js_number((double)argbase->managed->array.length));
+    } else if (argbase->type == vt_typed_array) {
+        js_return(js_number((double)argbase->managed->typed_array.length));
+    } else if (_is_hash_container(argbase)) {
+        js_return(js_number((double)argbase->managed->hashmap.length));
+    } else if (_bytes_of(argbase)) {
+        js_return(js_number((double)_bytes_of(argbase)->length));
+    } else if (argbase->type == vt_object) {
+        js_return(js_number((double)argbase->managed->object.length));
+    } else if (js_is_string(argbase)) {
+        js_return(js_number((double)js_string_length(argbase)));
+    } else {
+        js_throw(js_scripture_sz("Only string, array, typed array, bytes, hashmap, hashset and object have length"));
+    }
+}
+
+struct js_result js_std_listdir(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(js_is_string(argbase));
+    js_assert(js_is_function(argbase + 1));
+    char *dir = js_string_base(argbase);
+    // must be standardized for windows '*'
+    char *standardized_dir =
+        string_ends_with_sz(dir, js_std_pathsep) ? string_concat_sz(dir) : string_concat_sz(dir, js_std_pathsep);
+    bool isdir;
+    char *filename;
+    struct js_result result = {.success = true, .value = js_null()};
+    bool all_success = true;
+#ifdef _WIN32
+    char *pattern = string_concat_sz(standardized_dir, "*");
+    HANDLE sh;
+    WIN32_FIND_DATAA fd;
+    sh = FindFirstFileA(pattern, &fd);
+    if (sh != INVALID_HANDLE_VALUE) {
+        do {
+            isdir = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+            filename = fd.cFileName;
+#else
+    // https://www.geeksforgeeks.org/c-program-list-files-sub-directories-directory/
+    struct dirent *de;
+    DIR *dr = opendir(standardized_dir);
+    if (dr != NULL) {
+        while ((de = readdir(dr)) != NULL) {
+            isdir = de->d_type == DT_DIR;
+            filename = de->d_name;
+#endif
+            // BEGIN BLOCK
+            // log_debug("isdir=%d standardized_dir=%s filename=%s", isdir, standardized_dir, filename);
+            // if (isdir) {
+            //     if (!string_equals_sz(filename, ".") && !string_equals_sz(filename, "..")) {
+            //         char *subdir = string_concat_sz(standardized_dir, filename, js_std_pathsep);
+            //         result = js_call(vm, argbase[1],
+            //             (struct js_value[]){js_string_sz(&(vm->heap), subdir), js_null(), js_null()}, 3);
+            //         free(subdir);
+            //     } else {
+            //         result = ((struct js_result){.success = true, .value = js_null()});
+            //     }
+            // } else {
+            //     char *ext = strrchr(filename, '.');
+            //     if (ext) {
+            //         size_t baselen = ext - filename;
+            //         char *base = (char *)calloc(baselen + 1, 1);
+            //         strncpy(base, filename, baselen);
+            //         result = js_call(vm, argbase[1],
+            //             (struct js_value[]){
+            //                 js_string_sz(&(vm->heap), standardized_dir),
+            //                 js_string_sz(&(vm->heap), base),
+            //                 js_string_sz(&(vm->heap), ext)},
+            //             3);
+            //         free(base);
+            //     } else {
+            //         result = js_call(vm, argbase[1],
+            //             (struct js_value[]){
+            //                 js_string_sz(&(vm->heap), standardized_dir),
+            //                 js_string_sz(&(vm->heap), filename),
+            //                 js_scripture_sz("")},
+            //             3);
+            //     }
+            // }
+            if (isdir && (string_equals_sz(filename, ".") || string_equals_sz(filename, ".."))) {
+                result = ((struct js_result){.success = true, .value = js_null()});
+            } else {
+                result = js_call(vm, argbase[1],
+                    (struct js_value[]){
+                        js_string_sz(&(vm->heap), filename),
+                        js_boolean(isdir)},
+                    2);
+            }
+            if (!result.success) {
+                all_success = false;
+                break;
+            }
+            // END BLOCK
+#ifdef _WIN32
+        } while (FindNextFileA(sh, &fd) != 0);
+        FindClose(sh);
+    }
+    free(pattern);
+#else
+        }
+        closedir(dr);
+    }
+#endif
+    free(standardized_dir);
+    if (all_success) {
+        _return_null();
+    } else {
+        return result;
+    }
+}
+
+// map(arr, callback), callback(element, index), holes are kept, null result is also hole, same as 'a[i] = null'
+struct js_result js_std_map(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(argbase->type == vt_array);
+    struct js_value ret = js_array(&(vm->heap));
+    _array_for_each_call(vm, argbase, ret, i, elem, mapped, {
+        (void)elem;
+        js_array_put(&ret, i, mapped);
+    });
+    js_return(ret);
+}
+
+struct js_result js_std_mkdir(struct js_vm *vm) {
+    _one_string_argument(vm, path, {
+        _posix_zero_on_success(_mkdir(path));
+        _return_null();
+    });
+}
+
+// rename if possible, otherwise copy then remove source
+static bool _move(const char *src, const char *dst) {
+#ifdef _WIN32
+    // also copies file across volumes, but not directory
+    if (MoveFileExA(src, dst, MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED)) {
+        return true;
+    }
+    _set_errno_from_last_error();
+    return errno == EXDEV && _copy_tree(src, dst) && _remove_tree(src);
+#else
+    if (rename(src, dst) == 0) {
+        return true;
+    } else if (errno != EXDEV) {
+        return false;
+    }
+    struct stat st;
+    if (lstat(src, &st) != 0) {
+        return false;
+    } else if (S_ISDIR(st.st_mode)) {
+        return _copy_tree(src, dst) && _remove_tree(src);
+    } else if (S_ISLNK(st.st_mode)) {
+        return _copy_link(src, dst) && remove(src) == 0;
+    } else {
+        return _copy_file(src, dst) && remove(src) == 0;
+    }
+#endif
+}
+
+// move(src, dst), file or directory
+struct js_result js_std_move(struct js_vm *vm) {
+    _two_string_arguments(vm, src, dst, {
+        if (!_move(src, dst)) {
+            _throw_posix_error(vm);
+        }
+        _return_null();
+    });
+}
+
+struct js_result js_std_natural_compare(struct js_vm *vm) {
+    _two_string_arguments(vm, lhs, rhs, {
+        js_return(js_number(string_natural_compare_sz(lhs, rhs)));
+    });
+}
+
+// wall clock seconds, unlike clock() which is processor time of all threads
+struct js_result js_std_now(struct js_vm *vm) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    js_return(js_number((double)ts.tv_sec + ts.tv_nsec / 1e9));
+}
+
+// open(fname, [mode]), mode is same as fopen(), default "r"
+struct js_result js_std_open(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1 || nargs == 2);
+    js_assert(js_is_string(argbase));
+    js_assert(nargs == 1 || js_is_string(argbase + 1));
+    FILE *fp = fopen(js_string_base(argbase), nargs == 2 ? js_string_base(argbase + 1) : "r");
+    if (fp == NULL) {
+        _throw_posix_error(vm);
+    }
+    char *buffer = alloc(char, _file_buffer_size);
+    setvbuf(fp, buffer, _IOFBF, _file_buffer_size);
+    js_return(_file_new(&(vm->heap), fp, buffer));
+}
+
+struct js_result js_std_pop(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    js_assert(argbase->type == vt_array);
+    js_assert(argbase->managed->array.length > 0);
+    struct js_value ret = js_array_get(argbase, argbase->managed->array.length - 1);
+    js_array_pop(argbase);
+    js_return(ret);
+}
+
+struct js_result js_std_print(struct js_vm *vm) {
+    for (uint32_t i = 0; i < js_get_arguments_length(vm); i++) {
+        js_value_print(js_get_arguments_base(vm) + i);
+        printf(" ");
+    }
+    printf("\n");
+    _return_null();
+}
+
+struct js_result js_std_push(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs >= 1);
+    js_assert(argbase->type == vt_array);
+    for (uint32_t i = 1; i < nargs; i++) { // 'push(arr, ...values)' is allowed
+        js_array_push(argbase, argbase[i]);
+    }
+    _return_null();
+}
+
+// read(file, [n]), at most n bytes or until end, null if already at end
+struct js_result js_std_read(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1 || nargs == 2);
+    _file_argument(file);
+    js_assert(nargs == 1 || (argbase[1].type == vt_number && argbase[1].number >= 0));
+    size_t remaining = nargs == 2 ? (size_t)argbase[1].number : SIZE_MAX;
+    struct js_value ret = js_string(&(vm->heap), NULL, 0);
+    while (remaining > 0) {
+        // grow step by step, so that n can be larger than file
+        size_t chunk = min(remaining, (size_t)_file_buffer_size);
+        buffer_alloc(
+            ret.managed->string.base, ret.managed->string.length, ret.managed->string.capacity,
+            ret.managed->string.length + chunk + 1); // always +1 to make sure null terminated
+        size_t num_read = fread(ret.managed->string.base + ret.managed->string.length, 1, chunk, file->fp);
+        ret.managed->string.length += num_read;
+        remaining -= num_read;
+        if (num_read < chunk) {
+            break;
+        }
+    }
+    if (ferror(file->fp)) {
+        _throw_posix_error(vm);
+    }
+    if (ret.managed->string.length == 0 && remaining > 0 && feof(file->fp)) {
+        _return_null();
+    }
+    js_return(ret);
+}
+
+// readline(file), newline is not included, null if already at end
+struct js_result js_std_readline(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    _file_argument(file);
+    struct js_value line = js_string(&(vm->heap), NULL, 0);
+    read_line(file->fp, line.managed->string.base, line.managed->string.length, line.managed->string.capacity);
+    if (ferror(file->fp)) {
+        _throw_posix_error(vm);
+    }
+    if (line.managed->string.length == 0 && feof(file->fp)) {
+        _return_null();
+    }
+    js_return(line);
+}
+
+// reduce(arr, callback, [initial]), callback(accumulator, element, index)
+struct js_result js_std_reduce(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2 || nargs == 3);
+    js_assert(argbase->type == vt_array);
+    size_t i = js_array_next(argbase, 0);
+    struct js_value accumulator;
+    if (nargs == 3) {
+        accumulator = argbase[2];
+    } else if (i < argbase->managed->array.length) {
+        accumulator = js_array_get(argbase, i);
+        i = js_array_next(argbase, i + 1);
+    } else {
+        js_throw(js_scripture_sz("Reduce of empty array with no initial value"));
+    }
+    struct js_prepared_call prepared;
+    struct js_result result = js_call_prepare(vm, &prepared, argbase[1], js_null());
+    if (!result.success) {
+        return result;
+    }
+    for (; i < argbase->managed->array.length; i = js_array_next(argbase, i + 1)) {
+        // accumulator is kept alive by arguments during call
+        struct js_value args[3] = {accumulator, js_array_get(argbase, i), js_number((double)i)};
+        result = js_call_prepared(vm, &prepared, args, 3);
+        if (!result.success) {
+            break;
+        }
+        accumulator = result.value;
+    }
+    js_call_release(vm, &prepared);
+    if (!result.success) {
+        return result;
+    }
+    js_return(accumulator);
+}
+
+struct js_result js_std_remove(struct js_vm *vm) {
+    _one_string_argument(vm, path, {
+        _posix_zero_on_success(remove(path));
+        _return_null();
+    });
+}
+
+// resume(co, [value]), returns next yielded value, or returned value when finished
+struct js_result js_std_resume(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1 || nargs == 2);
+    js_assert(js_is_coroutine(argbase));
+    return js_resume(vm, argbase[0], nargs == 2 ? argbase[1] : js_null());
+}
+
+// reverse(arr), in place
+struct js_result js_std_reverse(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    js_assert(argbase->type == vt_array);
+    js_array_unshare(argbase);
+    struct js_managed_value *managed = argbase->managed;
+    for (size_t i = 0, j = managed->array.length; i + 1 < j; i++, j--) {
+        if (managed->array.kind == ak_number) {
+            double tmp = managed->array.numbers[i];
+            managed->array.numbers[i] = managed->array.numbers[j - 1];
+            managed->array.numbers[j - 1] = tmp;
+        } else {
+            struct js_value tmp = managed->array.base[i];
+            managed->array.base[i] = managed->array.base[j - 1];
+            managed->array.base[j - 1] = tmp;
+        }
+    }
+    js_return(*argbase);
+}
+
+struct js_result js_std_rmdir(struct js_vm *vm) {
+    _one_string_argument(vm, path, {
+        _posix_zero_on_success(rmdir(path));
+        _return_null();
+    });
+}
+
+// stable merge sort, comparison may fail and abort sorting, see _sort_compare()
+struct _sort_context {
+    struct js_vm *vm;
+    struct js_prepared_call prepared; // comparator
+    struct js_result result; // failure of comparator
+};
+
+static int _sort_compare(struct _sort_context *ctx, struct js_value *lhs, struct js_value *rhs) {
+    if (!ctx->result.success) {
+        return 0;
+    }
+    struct js_value args[2] = {*lhs, *rhs};
+    ctx->result = js_call_prepared(ctx->vm, &(ctx->prepared), args, 2);
+    if (!ctx->result.success) {
+        return 0;
+    }
+    if (ctx->result.value.type != vt_number) {
+        ctx->result = (struct js_result){.success = false, .value = js_scripture_sz("Comparator must return number")};
+        return 0;
+    }
+    // sign only, 0.5 is not 0
+    return ctx->result.value.number < 0 ? -1 : (ctx->result.value.number > 0 ? 1 : 0);
+}
+
+// string with its first 8 bytes in big endian, most comparisons won't touch string content
+struct _string_item {
+    uint64_t prefix;
+    struct js_value value;
+};
+
+static int _string_compare(struct _sort_context *ctx, struct _string_item *lhs, struct _string_item *rhs) {
+    (void)ctx;
+    if (lhs->prefix != rhs->prefix) {
+        return lhs->prefix < rhs->prefix ? -1 : 1;
+    }
+    size_t ll = js_string_length(&(lhs->value));
+    size_t lr = js_string_length(&(rhs->value));
+    int ret = memcmp(js_string_base(&(lhs->value)), js_string_base(&(rhs->value)), min(ll, lr));
+    return ret != 0 ? ret : (ll < lr ? -1 : (ll > lr ? 1 : 0));
+}
+
+#define _sort_insertion_length 16
+
+// binary insertion, inserted after equal ones to keep stable, less comparisons than linear one
+// merge sort's temp must have at least length / 2 elements, base is garbage if failed
+#define _define_merge_sort(__arg_name, __arg_type, __arg_compare) \
+    static void __arg_name##_insertion(__arg_type *base, size_t length, struct _sort_context *ctx) { \
+        for (size_t i = 1; i < length && ctx->result.success; i++) { \
+            __arg_type value = base[i]; \
+            if (__arg_compare(ctx, &value, base + i - 1) >= 0) { \
+                continue; /* ordered input costs one comparison each */ \
+            } \
+            size_t low = 0, high = i - 1; \
+            while (low < high) { \
+                size_t middle = low + (high - low) / 2; \
+                if (__arg_compare(ctx, &value, base + middle) < 0) { \
+                    high = middle; \
+                } else { \
+                    low = middle + 1; \
+                } \
+            } \
+            memmove(base + low + 1, base + low, (i - low) * sizeof(__arg_type)); \
+            base[low] = value; \
+        } \
+    } \
+    static void __arg_name(__arg_type *base, __arg_type *temp, size_t length, struct _sort_context *ctx) { \
+        if (length <= _sort_insertion_length) { \
+            __arg_name##_insertion(base, length, ctx); \
+            return; \
+        } \
+        size_t middle = length / 2; \
+        __arg_name(base, temp, middle, ctx); \
+        __arg_name(base + middle, temp, length - middle, ctx); \
+        /* already ordered runs, such as sorted or reversely appended input, cost only one comparison */ \
+        if (!ctx->result.success || __arg_compare(ctx, base + middle - 1, base + middle) <= 0) { \
+            return; \
+        } \
+        memcpy(temp, base, middle * sizeof(__arg_type)); \
+        size_t i = 0, j = middle, k = 0; \
+        while (i < middle && j < length && ctx->result.success) { \
+            /* take left one when equal to keep stable */ \
+            if (__arg_compare(ctx, base + j, temp + i) < 0) { \
+                base[k++] = base[j++]; \
+            } else { \
+                base[k++] = temp[i++]; \
+            } \
+        } \
+        memcpy(base + k, temp + i, (middle - i) * sizeof(__arg_type)); \
+    }
+
+_define_merge_sort(_merge_sort, struct js_value, _sort_compare)
+_define_merge_sort(_string_merge_sort, struct _string_item, _string_compare)
+
+// ordered bit pattern, unsigned comparison is same as number comparison, except -0 is before 0 and NaNs are last
+static uint64_t _number_key(double number) {
+    uint64_t key;
+    number = isnan(number) ? NAN : number;
+    memcpy(&key, &number, sizeof(key));
+    return (key >> 63) ? ~key : (key | ((uint64_t)1 << 63));
+}
+
+static double _key_number(uint64_t key) {
+    double number;
+    key = (key >> 63) ? (key & ~((uint64_t)1 << 63)) : ~key;
+    memcpy(&number, &key, sizeof(key));
+    return number;
+}
+
+// lsd radix sort, returns keys or temp, whichever holds result
+static uint64_t *_radix_sort(uint64_t *keys, uint64_t *temp, size_t length) {
+    size_t (*counts)[256] = calloc(8, sizeof(*counts));
+    for (size_t i = 0; i < length; i++) {
+        for (int pass = 0; pass < 8; pass++) {
+            counts[pass][(keys[i] >> (pass * 8)) & 0xff]++;
+        }
+    }
+    for (int pass = 0; pass < 8 && length > 0; pass++) {
+        size_t *count = counts[pass];
+        if (count[(keys[0] >> (pass * 8)) & 0xff] == length) {
+            continue; // all same byte, such as exponent bytes of similar numbers
+        }
+        for (size_t b = 0, offset = 0; b < 256; b++) {
+            size_t n = count[b];
+            count[b] = offset;
+            offset += n;
+        }
+        for (size_t i = 0; i < length; i++) {
+            temp[count[(keys[i] >> (pass * 8)) & 0xff]++] = keys[i];
+        }
+        uint64_t *swap = keys;
+        keys = temp;
+        temp = swap;
+    }
+    free(counts);
+    return keys;
+}
+
+// above this length, elements are sorted in chunks by threads and merged by pairs, result is exactly same as single threaded one
+#define _parallel_sort_length 65536
+#define _parallel_sort_threads 64 // power of 2
+
+struct _sort_chunk {
+    bool strings; // string items or number keys
+    void *base;
+    void *temp;
+    size_t begin;
+    size_t middle; // merged with [middle, end) if not 0, otherwise sorted
+    size_t end;
+};
+
+static void *_sort_chunk_run(void *argument) {
+    struct _sort_chunk *chunk = (struct _sort_chunk *)argument;
+    if (chunk->strings) {
+        struct _string_item *base = (struct _string_item *)chunk->base;
+        struct _string_item *temp = (struct _string_item *)chunk->temp;
+        struct _sort_context ctx = {.result = {.success = true}}; // never fails
+        if (chunk->middle == 0) {
+            _string_merge_sort(base + chunk->begin, temp + chunk->begin, chunk->end - chunk->begin, &ctx);
+            return NULL;
+        }
+        // stable, take left one when equal
+        size_t i = chunk->begin, j = chunk->middle, k = chunk->begin;
+        while (i < chunk->middle && j < chunk->end) {
+            temp[k++] = _string_compare(&ctx, base + j, base + i) < 0 ? base[j++] : base[i++];
+        }
+        memcpy(temp + k, base + i, (chunk->middle - i) * sizeof(struct _string_item));
+        memcpy(temp + k + chunk->middle - i, base + j, (chunk->end - j) * sizeof(struct _string_item));
+    } else {
+        uint64_t *base = (uint64_t *)chunk->base;
+        uint64_t *temp = (uint64_t *)chunk->temp;
+        if (chunk->middle == 0) {
+            size_t length = chunk->end - chunk->begin;
+            if (_radix_sort(base + chunk->begin, temp + chunk->begin, length) != base + chunk->begin) {
+                memcpy(base + chunk->begin, temp + chunk->begin, length * sizeof(uint64_t));
+            }
+            return NULL;
+        }
+        size_t i = chunk->begin, j = chunk->middle, k = chunk->begin;
+        while (i < chunk->middle && j < chunk->end) {
+            temp[k++] = base[j] < base[i] ? base[j++] : base[i++];
+        }
+        memcpy(temp + k, base + i, (chunk->middle - i) * sizeof(uint64_t));
+        memcpy(temp + k + chunk->middle - i, base + j, (chunk->end - j) * sizeof(uint64_t));
+    }
+    return NULL;
+}
+
+static void _sort_chunks_range(size_t begin, size_t end, void *argument) {
+    for (size_t i = begin; i < end; i++) {
+        _sort_chunk_run((struct _sort_chunk *)argument + i);
+    }
+}
+
+// run all chunks in thread pool
+static void _sort_chunks_run(struct _sort_chunk *chunks, size_t count) {
+    pool_parallel_for(0, count, 1, _sort_chunks_range, chunks);
+}
+
+// number keys or string items, sorted result is in base
+static void _parallel_sort(bool strings, void *base, size_t length) {
+    size_t size = strings ? sizeof(struct _string_item) : sizeof(uint64_t);
+    void *temp = calloc(length, size);
+    size_t count = 1;
+    if (length >= _parallel_sort_length) {
+        for (size_t processors = min(pool_threads(), _parallel_sort_threads); count * 2 <= processors; count *= 2) {
+        }
+    }
+    struct _sort_chunk chunks[_parallel_sort_threads];
+    for (size_t i = 0; i < count; i++) {
+        chunks[i] = (struct _sort_chunk){.strings = strings, .base = base, .temp = temp, .begin = length * i / count, .end = length * (i + 1) / count};
+    }
+    _sort_chunks_run(chunks, count);
+    // merge neighbours, between base and temp alternately
+    void *source = base;
+    for (size_t width = 1; width < count; width *= 2) {
+        size_t merges = 0;
+        void *target = source == base ? temp : base;
+        for (size_t i = 0; i < count; i += width * 2) {
+            chunks[merges++] = (struct _sort_chunk){.strings = strings, .base = source, .temp = target, .begin = length * i / count, .middle = length * (i + width) / count, .end = length * (i + width * 2) / count};
+        }
+        _sort_chunks_run(chunks, merges);
+        source = target;
+    }
+    if (source != base) {
+        memcpy(base, source, length * size);
+    }
+    free(temp);
+}
+
+static void _sort_numbers(double *numbers, size_t length) {
+    uint64_t *keys = alloc(uint64_t, length);
+    for (size_t i = 0; i < length; i++) {
+        keys[i] = _number_key(numbers[i]);
+    }
+    _parallel_sort(false, keys, length);
+    for (size_t i = 0; i < length; i++) {
+        numbers[i] = _key_number(keys[i]);
+    }
+    free(keys);
+}
+
+static void _sort_strings(struct js_value *values, size_t length) {
+    struct _string_item *items = alloc(struct _string_item, length);
+    for (size_t i = 0; i < length; i++) {
+        uint8_t bytes[8] = {0};
+        memcpy(bytes, js_string_base(values + i), min(js_string_length(values + i), sizeof(bytes)));
+        for (size_t b = 0; b < sizeof(bytes); b++) {
+            items[i].prefix = (items[i].prefix << 8) | bytes[b];
+        }
+        items[i].value = values[i];
+    }
+    _parallel_sort(true, items, length);
+    for (size_t i = 0; i < length; i++) {
+        values[i] = items[i].value;
+    }
+    free(items);
+}
+
+// set(map, key, value), null value means delete
+struct js_result js_std_set(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 3);
+    js_assert(argbase->type == vt_hashmap);
+    js_assert(argbase[1].type != vt_null);
+    js_hashmap_put(argbase, argbase[1], argbase[2]);
+    _return_null();
+}
+
+struct js_result js_std_shift(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    js_assert(argbase->type == vt_array);
+    js_assert(argbase->managed->array.length > 0);
+    struct js_value ret = js_array_get(argbase, 0);
+    js_array_splice(argbase, 0, 1, NULL, 0);
+    js_return(ret);
+}
+
+// slice(arr, [begin, [end]]), same as javascript
+struct js_result js_std_slice(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs >= 1 && nargs <= 3);
+    js_assert(argbase->type == vt_array);
+    js_assert(nargs < 2 || argbase[1].type == vt_number);
+    js_assert(nargs < 3 || argbase[2].type == vt_number);
+    size_t length = argbase->managed->array.length;
+    size_t begin = _relative_index(nargs >= 2 ? argbase + 1 : NULL, length, 0);
+    size_t end = _relative_index(nargs >= 3 ? argbase + 2 : NULL, length, length);
+    struct js_value ret = js_array(&(vm->heap));
+    for (size_t i = js_array_next(argbase, begin); i < end; i = js_array_next(argbase, i + 1)) {
+        js_array_put(&ret, i - begin, js_array_get(argbase, i));
+    }
+    js_return(ret);
+}
+
+// sort(arr, [comparator]), stable and in place, nulls are moved to last without calling comparator
+// without comparator, elements must be all numbers or all strings, and vm is never called back
+// if comparator throws, array is unchanged and error is propagated
+struct js_result js_std_sort(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1 || nargs == 2);
+    js_assert(argbase->type == vt_array);
+    js_assert(nargs == 1 || js_is_function(argbase + 1));
+    js_array_unshare(argbase);
+    size_t length = argbase->managed->array.length;
+    if (nargs == 1 && length >= _parallel_sort_length) {
+        js_use_pool(vm);
+    }
+    if (nargs == 1 && argbase->managed->array.kind == ak_number) {
+        _sort_numbers(argbase->managed->array.numbers, length);
+        _return_null();
+    }
+    struct js_value *values = alloc(struct js_value, length);
+    size_t count = 0;
+    bool numbers = true, strings = true;
+    for (size_t i = js_array_next(argbase, 0); i < length; i = js_array_next(argbase, i + 1)) {
+        values[count] = js_array_get(argbase, i);
+        numbers = numbers && values[count].type == vt_number;
+        strings = strings && js_is_string(values + count);
+        count++;
+    }
+    struct _sort_context ctx = {.vm = vm, .result = {.success = true}};
+    if (nargs == 1 && numbers) {
+        double *packed = alloc(double, count);
+        for (size_t i = 0; i < count; i++) {
+            packed[i] = values[i].number;
+        }
+        _sort_numbers(packed, count);
+        for (size_t i = 0; i < count; i++) {
+            values[i] = js_number(packed[i]);
+        }
+        free(packed);
+    } else if (nargs == 1 && strings) {
+        _sort_strings(values, count);
+    } else if (nargs == 1) {
+        free(values);
+        js_throw(js_scripture_sz("Require comparator unless elements are all numbers or all strings"));
+    } else {
+        // comparator may modify array, elements are kept alive by a copy sharing original storage
+        struct js_value keep = js_array(&(vm->heap));
+        js_array_spread(&keep, argbase);
+        ctx.result = js_call_prepare(vm, &(ctx.prepared), argbase[1], keep);
+        if (ctx.result.success) {
+            struct js_value *temp = alloc(struct js_value, count / 2 + 1);
+            _merge_sort(values, temp, count, &ctx);
+            free(temp);
+            js_call_release(vm, &(ctx.prepared));
+        }
+    }
+    if (ctx.result.success) {
+        js_array_splice(argbase, 0, count, values, count);
+        for (size_t i = count; i < length; i++) {
+            js_array_put(argbase, i, js_null());
+        }
+    }
+    free(values);
+    if (!ctx.result.success) {
+        return ctx.result;
+    }
+    _return_null();
+}
+
+// splice(arr, start, [delete_count, ...items]), same as javascript, returns removed elements
+struct js_result js_std_splice(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs >= 2);
+    js_assert(argbase->type == vt_array);
+    js_assert(argbase[1].type == vt_number);
+    js_assert(nargs == 2 || argbase[2].type == vt_number);
+    double length = (double)argbase->managed->array.length;
+    double start = argbase[1].number < 0 ? max(length + argbase[1].number, 0) : min(argbase[1].number, length);
+    double delete_count = nargs == 2 ? length - start : max(min(argbase[2].number, length - start), 0);
+    struct js_value ret = js_array(&(vm->heap));
+    for (size_t i = 0; i < (size_t)delete_count; i++) {
+        js_array_push(&ret, js_array_get(argbase, (size_t)start + i));
+    }
+    js_array_splice(argbase, (size_t)start, (size_t)delete_count, argbase + 3, nargs > 3 ? nargs - 3 : 0);
+    js_return(ret);
+}
+
+struct js_result js_std_split(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2);
+    js_assert(js_is_string(argbase));
+    js_assert(js_is_string(argbase + 1));
+    // DON'T use strtok, will modify source
+    char *str = js_string_base(argbase);
+    size_t slen = js_string_length(argbase);
+    char *delim = js_string_base(argbase + 1);
+    size_t dlen = js_string_length(argbase + 1);
+    js_assert(dlen > 0);
+    struct js_value ret = js_array(&(vm->heap));
+    char *p, *q;
+    for (p = str; p < str + slen;) {
+        q = strstr(p, delim);
+        // log_debug("%s %s", p, q);
+        // see https://en.cppreference.com/w/c/string/byte/strstr.html for return value
+        // TODO: optimize for scripture?
+        // if delim is an empty string, acorrding to standard, cannot distinguish with match on first character, so empty string is forbidden here
+        if (q == NULL) {
+            js_array_push(&ret, js_string(&(vm->heap), p, str + slen - p));
+            break;
+        } else {
+            js_array_push(&ret, js_string(&(vm->heap), p, q - p));
+            p = q + dlen;
+        }
+    }
+    if (q != NULL) {
+        js_array_push(&ret, js_scripture_sz(""));
+    }
+    js_return(ret);
+}
+
+struct js_result js_std_startswith(struct js_vm *vm) {
+    _two_string_arguments(vm, lhs, rhs, js_return(js_boolean(string_starts_with_sz(lhs, rhs))));
+}
+
+// status(co), "suspended", "running" or "dead"
+struct js_result js_std_status(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    js_assert(js_is_coroutine(argbase));
+    js_return(js_scripture_sz(js_coroutine_status(argbase)));
+}
+
+// unshift(arr, ...values), returns new length
+struct js_result js_std_unshift(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs >= 1);
+    js_assert(argbase->type == vt_array);
+    js_array_splice(argbase, 0, 0, argbase + 1, nargs - 1);
+    js_return(js_number((double)argbase->managed->array.length));
+}
+
+// typed array kernels, float64 ones process several lanes per step, gcc and clang map lanes to simd registers, others only run the scalar tail loop
+#define _lanes 4
+#ifdef __GNUC__
+typedef double _f64_lanes __attribute__((vector_size(_lanes * sizeof(double))));
+typedef int64_t _i64_lanes __attribute__((vector_size(_lanes * sizeof(int64_t))));
+
+// macros instead of functions, passing wide vectors by value changes abi without avx
+// memcpy instead of cast, buffer is not aligned to vector size
+#define _f64_load(__arg_p) \
+    ({ \
+        _f64_lanes __v; \
+        memcpy(&__v, (__arg_p), sizeof(__v)); \
+        __v; \
+    })
+#define _f64_store(__arg_p, __arg_v) \
+    do { \
+        _f64_lanes __v = (__arg_v); \
+        memcpy((__arg_p), &__v, sizeof(__v)); \
+    } while (0)
+// lanes where mask is all ones take lhs, otherwise rhs
+#define _f64_select(__arg_mask, __arg_lhs, __arg_rhs) \
+    ((_f64_lanes)(((_i64_lanes)(__arg_lhs) & (__arg_mask)) | ((_i64_lanes)(__arg_rhs) & ~(__arg_mask))))
+#endif
+
+static double _f64_sum(const double *p, size_t n) {
+    size_t i = 0;
+    double ret = 0;
+#ifdef __GNUC__
+    _f64_lanes acc = {0};
+    for (; i + _lanes <= n; i += _lanes) {
+        acc += _f64_load(p + i);
+    }
+    for (int j = 0; j < _lanes; j++) {
+        ret += acc[j];
+    }
+#endif
+    for (; i < n; i++) {
+        ret += p[i];
+    }
+    return ret;
+}
+
+static double _f64_dot(const double *a, const double *b, size_t n) {
+    size_t i = 0;
+    double ret = 0;
+#ifdef __GNUC__
+    _f64_lanes acc = {0};
+    for (; i + _lanes <= n; i += _lanes) {
+        acc += _f64_load(a + i) * _f64_load(b + i);
+    }
+    for (int j = 0; j < _lanes; j++) {
+        ret += acc[j];
+    }
+#endif
+    for (; i < n; i++) {
+        ret += a[i] * b[i];
+    }
+    return ret;
+}
+
+static void _f64_scale(double *p, size_t n, double k) {
+    size_t i = 0;
+#ifdef __GNUC__
+    for (; i + _lanes <= n; i += _lanes) {
+        _f64_store(p + i, _f64_load(p + i) * k);
+    }
+#endif
+    for (; i < n; i++) {
+        p[i] *= k;
+    }
+}
+
+static void _f64_add(double *dst, const double *src, size_t n) {
+    size_t i = 0;
+#ifdef __GNUC__
+    for (; i + _lanes <= n; i += _lanes) {
+        _f64_store(dst + i, _f64_load(dst + i) + _f64_load(src + i));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] += src[i];
+    }
+}
+
+// n must > 0, if less is true find minimum, or maximum
+static double _f64_extremum(const double *p, size_t n, bool less) {
+    size_t i = 0;
+    double ret = p[0];
+#ifdef __GNUC__
+    if (n >= _lanes) {
+        _f64_lanes acc = _f64_load(p);
+        for (i = _lanes; i + _lanes <= n; i += _lanes) {
+            _f64_lanes v = _f64_load(p + i);
+            acc = _f64_select(less ? (_i64_lanes)(v < acc) : (_i64_lanes)(v > acc), v, acc);
+        }
+        for (int j = 0; j < _lanes; j++) {
+            if (less ? acc[j] < ret : acc[j] > ret) {
+                ret = acc[j];
+            }
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if (less ? p[i] < ret : p[i] > ret) {
+            ret = p[i];
+        }
+    }
+    return ret;
+}
+
+// int32 ones are plain loops that compilers can vectorize by themselves, sum and dot accumulate in 64 bits
+static double _i32_sum(const int32_t *p, size_t n) {
+    int64_t ret = 0;
+    for (size_t i = 0; i < n; i++) {
+        ret += p[i];
+    }
+    return (double)ret;
+}
+
+static double _i32_dot(const int32_t *a, const int32_t *b, size_t n) {
+    int64_t ret = 0;
+    for (size_t i = 0; i < n; i++) {
+        ret += (int64_t)a[i] * b[i];
+    }
+    return (double)ret;
+}
+
+// wrap around like int32 put
+static void _i32_add(int32_t *dst, const int32_t *src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = (int32_t)((uint32_t)dst[i] + (uint32_t)src[i]);
+    }
+}
+
+static double _i32_extremum(const int32_t *p, size_t n, bool less) {
+    int32_t ret = p[0];
+    for (size_t i = 1; i < n; i++) {
+        ret = (less ? p[i] < ret : p[i] > ret) ? p[i] : ret;
+    }
+    return (double)ret;
+}
+#undef _lanes
+#ifdef __GNUC__
+    #undef _f64_load
+    #undef _f64_store
+    #undef _f64_select
+#endif
+
+#define _one_typed_array_argument(__arg_vm, __arg_nargs, __arg_ta) \
+    uint32_t __arg_nargs = js_get_arguments_length(__arg_vm); \
+    struct js_value *__arg_ta = js_get_arguments_base(__arg_vm); \
+    js_assert(__arg_ta->type == vt_typed_array);
+
+#define _two_typed_array_arguments(__arg_vm, __arg_nargs, __arg_ta_0, __arg_ta_1) \
+    _one_typed_array_argument(__arg_vm, __arg_nargs, __arg_ta_0); \
+    js_assert(__arg_nargs == 2); \
+    struct js_value *__arg_ta_1 = __arg_ta_0 + 1; \
+    js_assert(__arg_ta_1->type == vt_typed_array); \
+    js_assert(__arg_ta_0->managed->typed_array.kind == __arg_ta_1->managed->typed_array.kind); \
+    js_assert(__arg_ta_0->managed->typed_array.length == __arg_ta_1->managed->typed_array.length);
+
+struct js_result js_std_vadd(struct js_vm *vm) {
+    _two_typed_array_arguments(vm, nargs, dst, src);
+    if (dst->managed->typed_array.kind == ta_float64) {
+        _f64_add(dst->managed->typed_array.float64, src->managed->typed_array.float64, dst->managed->typed_array.length);
+    } else {
+        _i32_add(dst->managed->typed_array.int32, src->managed->typed_array.int32, dst->managed->typed_array.length);
+    }
+    js_return(*dst);
+}
+
+// copy as much as possible, length is not changed
+struct js_result js_std_vcopy(struct js_vm *vm) {
+    _one_typed_array_argument(vm, nargs, dst);
+    js_assert(nargs == 2);
+    struct js_value *src = dst + 1;
+    js_assert(src->type == vt_typed_array);
+    size_t n = min(dst->managed->typed_array.length, src->managed->typed_array.length);
+    if (dst->managed->typed_array.kind == src->managed->typed_array.kind) {
+        memmove(dst->managed->typed_array.base, src->managed->typed_array.base,
+            n * (dst->managed->typed_array.kind == ta_float64 ? sizeof(double) : sizeof(int32_t)));
+    } else {
+        for (size_t i = 0; i < n; i++) {
+            js_typed_array_put(dst, i, js_typed_array_get(src, i));
+        }
+    }
+    js_return(*dst);
+}
+
+struct js_result js_std_vdot(struct js_vm *vm) {
+    _two_typed_array_arguments(vm, nargs, lhs, rhs);
+    if (lhs->managed->typed_array.kind == ta_float64) {
+        js_return(js_number(_f64_dot(lhs->managed->typed_array.float64, rhs->managed->typed_array.float64, lhs->managed->typed_array.length)));
+    } else {
+        js_return(js_number(_i32_dot(lhs->managed->typed_array.int32, rhs->managed->typed_array.int32, lhs->managed->typed_array.length)));
+    }
+}
+
+struct js_result js_std_vfill(struct js_vm *vm) {
+    _one_typed_array_argument(vm, nargs, ta);
+    js_assert(nargs == 2);
+    js_assert(ta[1].type == vt_number);
+    size_t n = ta->managed->typed_array.length;
+    if (n == 0) {
+        js_return(*ta);
+    }
+    js_typed_array_put(ta, 0, ta[1]); // converted value is in [0]
+    if (ta->managed->typed_array.kind == ta_float64) {
+        double *p = ta->managed->typed_array.float64;
+        for (size_t i = 1; i < n; i++) {
+            p[i] = p[0];
+        }
+    } else {
+        int32_t *p = ta->managed->typed_array.int32;
+        for (size_t i = 1; i < n; i++) {
+            p[i] = p[0];
+        }
+    }
+    js_return(*ta);
+}
+
+static struct js_result _extremum(struct js_vm *vm, bool less) {
+    _one_typed_array_argument(vm, nargs, ta);
+    js_assert(nargs == 1);
+    if (ta->managed->typed_array.length == 0) {
+        _return_null();
+    }
+    if (ta->managed->typed_array.kind == ta_float64) {
+        js_return(js_number(_f64_extremum(ta->managed->typed_array.float64, ta->managed->typed_array.length, less)));
+    } else {
+        js_return(js_number(_i32_extremum(ta->managed->typed_array.int32, ta->managed->typed_array.length, less)));
+    }
+}
+
+struct js_result js_std_vmax(struct js_vm *vm) {
+    return _extremum(vm, false);
+}
+
+struct js_result js_std_vmin(struct js_vm *vm) {
+    return _extremum(vm, true);
+}
+
+struct js_result js_std_vscale(struct js_vm *vm) {
+    _one_typed_array_argument(vm, nargs, ta);
+    js_assert(nargs == 2);
+    js_assert(ta[1].type == vt_number);
+    if (ta->managed->typed_array.kind == ta_float64) {
+        _f64_scale(ta->managed->typed_array.float64, ta->managed->typed_array.length, ta[1].number);
+    } else {
+        // same conversion as put
+        for (size_t i = 0; i < ta->managed->typed_array.length; i++) {
+            js_typed_array_put(ta, i, js_number(ta->managed->typed_array.int32[i] * ta[1].number));
+        }
+    }
+    js_return(*ta);
+}
+
+struct js_result js_std_vsum(struct js_vm *vm) {
+    _one_typed_array_argument(vm, nargs, ta);
+    js_assert(nargs == 1);
+    if (ta->managed->typed_array.kind == ta_float64) {
+        js_return(js_number(_f64_sum(ta->managed->typed_array.float64, ta->managed->typed_array.length)));
+    } else {
+        js_return(js_number(_i32_sum(ta->managed->typed_array.int32, ta->managed->typed_array.length)));
+    }
+}
+
+// '*', '?' and '[...]' ('[!...]' negates, 'a-z' is range), only file name is matched so path separator is nothing special
+static bool _glob_match(const char *pattern, const char *name) {
+    const char *star = NULL;
+    const char *resume = NULL;
+    while (*name) {
+        if (*pattern == '*') {
+            star = ++pattern;
+            resume = name;
+            continue;
+        } else if (*pattern == '?') {
+            pattern++;
+            name++;
+            continue;
+        } else if (*pattern == '[') {
+            const char *p = pattern + 1;
+            bool negate = *p == '!' || *p == '^';
+            if (negate) {
+                p++;
+            }
+            // ']' right after '[' is literal
+            const char *first = p;
+            bool matched = false;
+            while (*p && (*p != ']' || p == first)) {
+                if (p[1] == '-' && p[2] && p[2] != ']') {
+                    matched |= (unsigned char)*name >= (unsigned char)p[0] && (unsigned char)*name <= (unsigned char)p[2];
+                    p += 3;
+                } else {
+                    matched |= *p == *name;
+                    p++;
+                }
+            }
+            if (*p == ']' && matched != negate) {
+                pattern = p + 1;
+                name++;
+                continue;
+            }
+        } else if (*pattern == *name) {
+            pattern++;
+            name++;
+            continue;
+        }
+        if (!star) {
+            return false;
+        }
+        pattern = star;
+        name = ++resume;
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+#define _walk_batch 4096
+#define _walk_threads 64
+
+struct _walk_entry {
+    char *path;
+    enum _entry_type type;
+    double size;
+    double mtime; // seconds since epoch
+};
+
+// shared by worker threads, all fields except filters are protected by mutex
+struct _walk {
+    void *mutex;
+    void *condition;
+    char **dirs; // pending directories, ending with path separator
+    size_t dirs_length;
+    size_t dirs_capacity;
+    size_t busy; // number of directories being read
+    struct _walk_entry *entries; // read but not yet taken by main thread
+    size_t entries_length;
+    size_t entries_capacity;
+    size_t batch;
+    bool stop;
+    char *glob;
+    char **exts;
+    size_t exts_length;
+    size_t exts_capacity;
+};
+
+// what one worker found in one directory, merged into shared one at once to keep locking rare
+struct _walk_found {
+    char **dirs;
+    size_t dirs_length;
+    size_t dirs_capacity;
+    struct _walk_entry *entries;
+    size_t entries_length;
+    size_t entries_capacity;
+};
+
+static bool _walk_filter(struct _walk *walk, const char *name) {
+    if (walk->glob && !_glob_match(walk->glob, name)) {
+        return false;
+    }
+    if (walk->exts_length == 0) {
+        return true;
+    }
+    for (size_t i = 0; i < walk->exts_length; i++) {
+        if (string_ends_with_sz(name, walk->exts[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// subdirectories are always descended, symbolic links are never followed
+static void _walk_add(struct _walk *walk, struct _walk_found *found, const char *dir, const char *name, enum _entry_type type, double size, double mtime) {
+    if (type == _entry_dir) {
+        buffer_push(found->dirs, found->dirs_length, found->dirs_capacity, string_concat_sz(dir, name, js_std_pathsep));
+    }
+    if (_walk_filter(walk, name)) {
+        struct _walk_entry entry = {.path = string_concat_sz(dir, name), .type = type, .size = size, .mtime = mtime};
+        buffer_push(found->entries, found->entries_length, found->entries_capacity, entry);
+    }
+}
+
+// unreadable directories and vanished entries are silently skipped
+static void _walk_read(struct _walk *walk, struct _walk_found *found, const char *dir) {
+#ifdef _WIN32
+    char *pattern = string_concat_sz(dir, "*");
+    WIN32_FIND_DATAA fd;
+    HANDLE sh = FindFirstFileA(pattern, &fd);
+    free(pattern);
+    if (sh == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        if (string_equals_sz(fd.cFileName, ".") || string_equals_sz(fd.cFileName, "..")) {
+            continue;
+        }
+        enum _entry_type type = (fd.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) ? _entry_link
+                               : (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) ? _entry_dir
+                                                                                  : _entry_file;
+        double size = (double)(((uint64_t)fd.nFileSizeHigh << 32) | fd.nFileSizeLow);
+        // 100 nanoseconds since 1601
+        double mtime = (((uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32) | fd.ftLastWriteTime.dwLowDateTime) / 1e7 - 11644473600.0;
+        _walk_add(walk, found, dir, fd.cFileName, type, size, mtime);
+    } while (FindNextFileA(sh, &fd));
+    FindClose(sh);
+#else
+    DIR *dr = opendir(dir);
+    if (dr == NULL) {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(dr)) != NULL) {
+        if (string_equals_sz(de->d_name, ".") || string_equals_sz(de->d_name, "..")) {
+            continue;
+        }
+        // no need to stat filtered out files if type is already known
+        if (de->d_type != DT_DIR && de->d_type != DT_UNKNOWN && !_walk_filter(walk, de->d_name)) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dr), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+        enum _entry_type type = S_ISREG(st.st_mode)   ? _entry_file
+                               : S_ISDIR(st.st_mode) ? _entry_dir
+                               : S_ISLNK(st.st_mode) ? _entry_link
+                                                     : _entry_other;
+        _walk_add(walk, found, dir, de->d_name, type, (double)st.st_size, (double)st.st_mtime);
+    }
+    closedir(dr);
+#endif
+}
+
+static void *_walk_worker(void *arg) {
+    struct _walk *walk = (struct _walk *)arg;
+    struct _walk_found found = {0};
+    mutex_lock(walk->mutex);
+    for (;;) {
+        // other busy workers may still find more directories
+        while (!walk->stop && walk->dirs_length == 0 && walk->busy > 0) {
+            condition_wait(walk->condition, walk->mutex);
+        }
+        if (walk->stop || walk->dirs_length == 0) {
+            break;
+        }
+        char *dir = walk->dirs[--walk->dirs_length];
+        walk->busy++;
+        mutex_unlock(walk->mutex);
+        _walk_read(walk, &found, dir);
+        free(dir);
+        mutex_lock(walk->mutex);
+        buffer_alloc(walk->dirs, walk->dirs_length, walk->dirs_capacity, walk->dirs_length + found.dirs_length);
+        memcpy(walk->dirs + walk->dirs_length, found.dirs, found.dirs_length * sizeof(char *));
+        walk->dirs_length += found.dirs_length;
+        found.dirs_length = 0;
+        buffer_alloc(walk->entries, walk->entries_length, walk->entries_capacity, walk->entries_length + found.entries_length);
+        memcpy(walk->entries + walk->entries_length, found.entries, found.entries_length * sizeof(struct _walk_entry));
+        walk->entries_length += found.entries_length;
+        found.entries_length = 0;
+        walk->busy--;
+        condition_broadcast(walk->condition);
+    }
+    mutex_unlock(walk->mutex);
+    buffer_free(found.dirs, found.dirs_length, found.dirs_capacity);
+    buffer_free(found.entries, found.entries_length, found.entries_capacity);
+    return NULL;
+}
+
+static struct js_value _walk_entry_value(struct js_heap *heap, struct _walk_entry *entry) {
+    struct js_value ret = js_object(heap);
+    js_object_put_sz(&ret, "path", js_string_sz(heap, entry->path));
+    js_object_put_sz(&ret, "type", js_scripture_sz(_entry_type_names[entry->type]));
+    js_object_put_sz(&ret, "size", js_number(entry->size));
+    js_object_put_sz(&ret, "mtime", js_number(entry->mtime));
+    return ret;
+}
+
+static bool _walk_option_number(struct js_value *options, const char *key, double *number) {
+    struct js_value value = js_object_get_sz(options, key);
+    if (value.type == vt_null) {
+        return true;
+    } else if (value.type == vt_number && value.number >= 1) {
+        *number = value.number;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+// walk(root, [options], [callback]), directories are read by worker threads, returns array of {path, type, size, mtime}, entries are in no particular order
+// options are 'ext' (string or array of strings), 'glob' (matched against file name), 'batch' and 'threads'
+// if callback is given, it is called with arrays of at most 'batch' entries and null is returned, returning false from callback stops walking
+struct js_result js_std_walk(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs >= 1 && nargs <= 3);
+    js_assert(js_is_string(argbase));
+    struct js_value *options = nargs >= 2 && argbase[1].type == vt_object ? argbase + 1 : NULL;
+    struct js_value *callback = nargs >= 2 && js_is_function(argbase + nargs - 1) ? argbase + nargs - 1 : NULL;
+    js_assert(nargs == 1 + (options != NULL) + (callback != NULL));
+    char *root = js_string_base(argbase);
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(root);
+    if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        js_throw(js_scripture_sz("Not a directory"));
+    }
+#else
+    DIR *dr = opendir(root);
+    if (dr == NULL) {
+        _throw_posix_error(vm);
+    }
+    closedir(dr);
+#endif
+    // reading directories mostly waits for disk, so a few more threads than processors does no harm
+    double batch = _walk_batch;
+    double nthreads = (double)max(thread_processors(), 4);
+    struct js_value glob = js_null();
+    struct js_value ext = js_null();
+    if (options) {
+        js_assert(_walk_option_number(options, "batch", &batch));
+        js_assert(_walk_option_number(options, "threads", &nthreads));
+        glob = js_object_get_sz(options, "glob");
+        js_assert(glob.type == vt_null || js_is_string(&glob));
+        ext = js_object_get_sz(options, "ext");
+        js_assert(ext.type == vt_null || js_is_string(&ext) || ext.type == vt_array);
+        if (ext.type == vt_array) {
+            for (size_t i = 0; i < ext.managed->array.length; i++) {
+                struct js_value e = js_array_get(&ext, i);
+                js_assert(js_is_string(&e));
+            }
+        }
+    }
+    struct js_prepared_call prepared;
+    struct js_result result = {.success = true, .value = js_null()};
+    if (callback) {
+        result = js_call_prepare(vm, &prepared, *callback, js_null());
+        if (!result.success) {
+            return result;
+        }
+    }
+    struct _walk walk = {.mutex = mutex_new(), .condition = condition_new(), .batch = (size_t)batch};
+    if (js_is_string(&glob)) {
+        walk.glob = string_dupe(js_string_base(&glob), js_string_length(&glob));
+    }
+    if (js_is_string(&ext)) {
+        buffer_push(walk.exts, walk.exts_length, walk.exts_capacity, string_dupe(js_string_base(&ext), js_string_length(&ext)));
+    } else if (ext.type == vt_array) {
+        for (size_t i = 0; i < ext.managed->array.length; i++) {
+            struct js_value e = js_array_get(&ext, i);
+            buffer_push(walk.exts, walk.exts_length, walk.exts_capacity, string_dupe(js_string_base(&e), js_string_length(&e)));
+        }
+    }
+    buffer_push(walk.dirs, walk.dirs_length, walk.dirs_capacity,
+        string_ends_with_sz(root, js_std_pathsep) ? string_concat_sz(root) : string_concat_sz(root, js_std_pathsep));
+    void *threads[_walk_threads];
+    size_t count = 0;
+    for (size_t n = min((size_t)nthreads, _walk_threads); count < n; count++) {
+        if ((threads[count] = thread_start(_walk_worker, &walk)) == NULL) {
+            break;
+        }
+    }
+    if (count == 0) {
+        // walk in current thread
+        _walk_worker(&walk);
+    }
+    struct js_value ret = callback ? js_null() : js_array(&(vm->heap));
+    struct _walk_entry *taken = NULL;
+    size_t taken_length = 0;
+    size_t taken_capacity = 0;
+    mutex_lock(walk.mutex);
+    for (;;) {
+        bool finished;
+        while (!(finished = walk.dirs_length == 0 && walk.busy == 0) && walk.entries_length < walk.batch) {
+            condition_wait(walk.condition, walk.mutex);
+        }
+        // swap buffers, so that workers need not wait for script
+        struct _walk_entry *entries = walk.entries;
+        size_t entries_capacity = walk.entries_capacity;
+        taken_length = walk.entries_length;
+        walk.entries = taken;
+        walk.entries_length = 0;
+        walk.entries_capacity = taken_capacity;
+        taken = entries;
+        taken_capacity = entries_capacity;
+        mutex_unlock(walk.mutex);
+        bool stop = false;
+        for (size_t i = 0; i < taken_length; i += walk.batch) {
+            size_t n = min(walk.batch, taken_length - i);
+            if (!stop) {
+                struct js_value arr = callback ? js_array(&(vm->heap)) : ret;
+                for (size_t j = i; j < i + n; j++) {
+                    js_array_push(&arr, _walk_entry_value(&(vm->heap), taken + j));
+                }
+                if (callback) {
+                    result = js_call_prepared(vm, &prepared, &arr, 1);
+                    stop = !result.success || (result.value.type == vt_boolean && !result.value.boolean);
+                }
+            }
+            for (size_t j = i; j < i + n; j++) {
+                free(taken[j].path);
+            }
+        }
+        mutex_lock(walk.mutex);
+        if (stop) {
+            walk.stop = true;
+            condition_broadcast(walk.condition);
+            break;
+        } else if (finished) {
+            break;
+        }
+    }
+    mutex_unlock(walk.mutex);
+    for (size_t i = 0; i < count; i++) {
+        thread_join(threads[i]);
+    }
+    // left behind if stopped
+    for (size_t i = 0; i < walk.entries_length; i++) {
+        free(walk.entries[i].path);
+    }
+    for (size_t i = 0; i < walk.dirs_length; i++) {
+        free(walk.dirs[i]);
+    }
+    for (size_t i = 0; i < walk.exts_length; i++) {
+        free(walk.exts[i]);
+    }
+    buffer_free(walk.entries, walk.entries_length, walk.entries_capacity);
+    buffer_free(walk.dirs, walk.dirs_length, walk.dirs_capacity);
+    buffer_free(walk.exts, walk.exts_length, walk.exts_capacity);
+    buffer_free(taken, taken_length, taken_capacity);
+    free(walk.glob);
+    mutex_free(walk.mutex);
+    condition_free(walk.condition);
+    if (callback) {
+        js_call_release(vm, &prepared);
+    }
+    if (!result.success) {
+        return result;
+    }
+    js_return(ret);
+}
+
+// write(file, ...values), values are strings or bytes
+struct js_result js_std_write(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs >= 1);
+    _file_argument(file);
+    for (uint32_t i = 1; i < nargs; i++) {
+        struct _bytes *bytes = _bytes_of(argbase + i);
+        if (bytes) {
+            fwrite(bytes->base, 1, bytes->length, file->fp);
+        } else if (js_is_string(argbase + i)) {
+            fwrite(js_string_base(argbase + i), 1, js_string_length(argbase + i), file->fp);
+        } else {
+            js_throw(js_scripture_sz("Only string and bytes can be written"));
+        }
+        if (ferror(file->fp)) {
+            _throw_posix_error(vm);
+        }
+    }
+    _return_null();
+}
+
+// yield([value]), suspends running coroutine, returns value given to next resume()
+struct js_result js_std_yield(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    js_assert(nargs <= 1);
+    return js_yield(vm, nargs == 1 ? js_get_argument(vm, 0) : js_null());
 }
 
 #define _function_list \
+    X(add) \
+    X(bytes) \
+    X(bytesget) \
+    X(bytesput) \
+    X(bytesread) \
+    X(byteslice) \
+    X(bytestring) \
+    X(byteswrite) \
     X(chdir) \
     X(clock) \
+    X(close) \
+    X(concat) \
+    X(copy) \
+    X(copytree) \
+    X(coroutine) \
     X(dirname) \
     X(endswith) \
+    X(erase) \
     X(exists) \
+    X(fill) \
+    X(filter) \
+    X(find) \
+    X(float64array) \
+    X(flush) \
+    X(fmap) \
+    X(foreach) \
     X(format) \
     X(fread) \
     X(fwrite) \
+    X(get) \
     X(getcwd) \
+    X(has) \
+    X(hashmap) \
+    X(hashset) \
+    X(includes) \
+    X(indexof) \
     X(input) \
+    X(int32array) \
     X(join) \
     X(length) \
     X(listdir) \
+    X(map) \
     X(mkdir) \
+    X(move) \
     X(natural_compare) \
+    X(now) \
+    X(open) \
     X(pop) \
     X(print) \
     X(push) \
+    X(read) \
+    X(readline) \
+    X(reduce) \
     X(remove) \
+    X(resume) \
+    X(reverse) \
     X(rmdir) \
+    X(set) \
+    X(shift) \
+    X(slice) \
     X(sort) \
+    X(splice) \
     X(split) \
-    X(startswith)
+    X(startswith) \
+    X(status) \
+    X(unshift) \
+    X(vadd) \
+    X(vcopy) \
+    X(vdot) \
+    X(vfill) \
+    X(vmax) \
+    X(vmin) \
+    X(vscale) \
+    X(vsum) \
+    X(walk) \
+    X(write) \
+    X(yield)
 
 #ifdef DEBUG
 struct js_result js_std_transponder(struct js_vm *vm) {
-    uint16_t nargs = js_get_arguments_length(vm);
+    uint32_t nargs = js_get_arguments_length(vm);
     struct js_value *argbase = js_get_arguments_base(vm);
     js_assert(nargs > 0);
     js_assert(js_is_function(argbase));
@@ -589,6 +2719,9 @@ void js_declare_std_functions(struct js_vm *vm, int argc, char *argv[]) {
     js_declare_variable_sz(vm, "dump", js_c_function(js_vm_dump));
     js_declare_variable_sz(vm, "gc", js_c_function(js_collect_garbage));
     js_declare_variable_sz(vm, "pathsep", js_scripture_sz(js_std_pathsep));
+    js_declare_variable_sz(vm, "stdin", _file_new(&(vm->heap), stdin, NULL));
+    js_declare_variable_sz(vm, "stdout", _file_new(&(vm->heap), stdout, NULL));
+    js_declare_variable_sz(vm, "stderr", _file_new(&(vm->heap), stderr, NULL));
     // compatibility purpose
     struct js_value console = js_object(&(vm->heap));
     js_declare_variable_sz(vm, "console", console);
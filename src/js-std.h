@@ -14,29 +14,83 @@ You should have received a copy of the GNU General Public License along with thi
 #include "js-vm.h"
 
 shared const char *js_std_pathsep;
+shared struct js_result js_std_add(struct js_vm *);
+shared struct js_result js_std_bytes(struct js_vm *);
+shared struct js_result js_std_bytesget(struct js_vm *);
+shared struct js_result js_std_bytesput(struct js_vm *);
+shared struct js_result js_std_bytesread(struct js_vm *);
+shared struct js_result js_std_byteslice(struct js_vm *);
+shared struct js_result js_std_bytestring(struct js_vm *);
+shared struct js_result js_std_byteswrite(struct js_vm *);
 shared struct js_result js_std_chdir(struct js_vm *);
 shared struct js_result js_std_clock(struct js_vm *);
+shared struct js_result js_std_close(struct js_vm *);
+shared struct js_result js_std_concat(struct js_vm *);
+shared struct js_result js_std_copy(struct js_vm *);
+shared struct js_result js_std_copytree(struct js_vm *);
+shared struct js_result js_std_coroutine(struct js_vm *);
 shared struct js_result js_std_dirname(struct js_vm *);
 shared struct js_result js_std_endswith(struct js_vm *);
+shared struct js_result js_std_erase(struct js_vm *);
 shared struct js_result js_std_exists(struct js_vm *);
+shared struct js_result js_std_fill(struct js_vm *);
+shared struct js_result js_std_filter(struct js_vm *);
+shared struct js_result js_std_find(struct js_vm *);
+shared struct js_result js_std_float64array(struct js_vm *);
+shared struct js_result js_std_flush(struct js_vm *);
+shared struct js_result js_std_fmap(struct js_vm *);
+shared struct js_result js_std_foreach(struct js_vm *);
 shared struct js_result js_std_format(struct js_vm *);
 shared struct js_result js_std_fread(struct js_vm *);
 shared struct js_result js_std_fwrite(struct js_vm *);
+shared struct js_result js_std_get(struct js_vm *);
 shared struct js_result js_std_getcwd(struct js_vm *);
+shared struct js_result js_std_has(struct js_vm *);
+shared struct js_result js_std_hashmap(struct js_vm *);
+shared struct js_result js_std_hashset(struct js_vm *);
+shared struct js_result js_std_includes(struct js_vm *);
+shared struct js_result js_std_indexof(struct js_vm *);
 shared struct js_result js_std_input(struct js_vm *);
+shared struct js_result js_std_int32array(struct js_vm *);
 shared struct js_result js_std_join(struct js_vm *);
 shared struct js_result js_std_length(struct js_vm *);
 shared struct js_result js_std_listdir(struct js_vm *);
+shared struct js_result js_std_map(struct js_vm *);
 shared struct js_result js_std_mkdir(struct js_vm *);
+shared struct js_result js_std_move(struct js_vm *);
 shared struct js_result js_std_natural_compare(struct js_vm *);
+shared struct js_result js_std_now(struct js_vm *);
+shared struct js_result js_std_open(struct js_vm *);
 shared struct js_result js_std_pop(struct js_vm *);
 shared struct js_result js_std_print(struct js_vm *);
 shared struct js_result js_std_push(struct js_vm *);
+shared struct js_result js_std_read(struct js_vm *);
+shared struct js_result js_std_readline(struct js_vm *);
+shared struct js_result js_std_reduce(struct js_vm *);
 shared struct js_result js_std_remove(struct js_vm *);
+shared struct js_result js_std_resume(struct js_vm *);
+shared struct js_result js_std_reverse(struct js_vm *);
 shared struct js_result js_std_rmdir(struct js_vm *);
+shared struct js_result js_std_set(struct js_vm *);
+shared struct js_result js_std_shift(struct js_vm *);
+shared struct js_result js_std_slice(struct js_vm *);
 shared struct js_result js_std_sort(struct js_vm *);
+shared struct js_result js_std_splice(struct js_vm *);
 shared struct js_result js_std_split(struct js_vm *);
 shared struct js_result js_std_startswith(struct js_vm *);
+shared struct js_result js_std_status(struct js_vm *);
+shared struct js_result js_std_unshift(struct js_vm *);
+shared struct js_result js_std_vadd(struct js_vm *);
+shared struct js_result js_std_vcopy(struct js_vm *);
+shared struct js_result js_std_vdot(struct js_vm *);
+shared struct js_result js_std_vfill(struct js_vm *);
+shared struct js_result js_std_vmax(struct js_vm *);
+shared struct js_result js_std_vmin(struct js_vm *);
+shared struct js_result js_std_vscale(struct js_vm *);
+shared struct js_result js_std_vsum(struct js_vm *);
+shared struct js_result js_std_walk(struct js_vm *);
+shared struct js_result js_std_write(struct js_vm *);
+shared struct js_result js_std_yield(struct js_vm *);
 shared void js_declare_std_functions(struct js_vm *, int, char *[]);
 
 #ifdef DEBUG
@@ -10,6 +10,7 @@ You should have received a copy of the GNU General Public License along with thi
 
 #include <ctype.h>
 #include <math.h>
+#include <time.h>
 #include "js-syntax.h"
 
 // if extern const array, sizeof is not useable anymore
@@ -1683,4 +1684,118 @@ void test_free_vm() {
     }
 }
 
+void test_budget() {
+    struct js_source source = {0};
+    struct js_token token = {0};
+    struct js_vm vm = {.step_limit = 1000, .heap_limit = 10000};
+    // first loop yields several times, second loop throws out of memory error and is caught
+    const char *src = "let n = 0; while (n < 5000) { n += 1; } let s = []; try { for (let i = 0; ; i++) { s[i] = [i]; } } catch (e) { return e; }";
+    string_buffer_append_sz(source.base, source.length, source.capacity, src);
+    if (js_compile(&source, &token, &(vm.bytecode), &(vm.cross_reference))) {
+        struct js_result result;
+        uint32_t num_yields = 0;
+        for (;;) {
+            result = js_run(&vm);
+            if (!js_is_yielded(result)) {
+                break;
+            }
+            num_yields++;
+        }
+        printf("num_yields=%u, result is: %s, ", num_yields, result.success ? "true" : "false");
+        js_value_dump(&(result.value));
+        printf("\n\n");
+    }
+    js_free_vm(&vm);
+    buffer_free(source.base, source.length, source.capacity);
+}
+
+// small frame limit, so that unbounded recursion reaches it soon after several growths, and is caught like other errors
+void test_stack_overflow() {
+    struct js_source source = {0};
+    struct js_token token = {0};
+    struct js_vm vm = {.stack = {.limit = 4096}};
+    const char *src = "function f(n) { return f(n + 1); } let m = null; try { f(0); } catch (e) { m = e.message; } ";
+    string_buffer_append_sz(source.base, source.length, source.capacity, src);
+    enforce(js_compile(&source, &token, &(vm.bytecode), &(vm.cross_reference)));
+    struct js_result result = js_run(&vm);
+    enforce(result.success);
+    result = js_get_variable_sz(&vm, "m");
+    enforce(result.success && js_is_string(&(result.value)));
+    enforce(strcmp(js_string_base(&(result.value)), "Stack overflow") == 0);
+    printf("m=%s, capacity=%u, limit=%u\n", js_string_base(&(result.value)), vm.stack.capacity, vm.stack.limit);
+    enforce(vm.stack.capacity <= vm.stack.limit);
+    // stack is unwound, deep but bounded recursion still works
+    src = "function g(n) { if (n == 0) { return 0; } else { return g(n - 1) + 1; } } return g(300);";
+    string_buffer_append_sz(source.base, source.length, source.capacity, src);
+    enforce(js_compile(&source, &token, &(vm.bytecode), &(vm.cross_reference)));
+    result = js_run(&vm);
+    enforce(result.success && result.value.type == vt_number && result.value.number == 300);
+    printf("g(300)=%g\n", result.value.number);
+    js_free_vm(&vm);
+    buffer_free(source.base, source.length, source.capacity);
+}
+
+static size_t _resident_kb() {
+    size_t pages = 0;
+#ifdef __linux__
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%*s %zu", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(fp);
+    }
+#endif
+    return pages * virtual_page_size() / 1024;
+}
+
+// 1000 live vms of same script, each with its own copy of bytecode, then all sharing one program
+void test_program() {
+    const size_t num_vms = 1000;
+    struct js_source source = {0};
+    struct js_token token = {0};
+    struct js_bytecode bytecode = {0};
+    struct js_cross_reference cross_reference = {0};
+    for (int i = 0; i < 2000; i++) {
+        string_buffer_append_f(source.base, source.length, source.capacity, "function f%d(a, b) { let s = 0; for (let i = a; i < b; i++) { s += i * %d; } return s; }\n", i, i);
+    }
+    string_buffer_append_sz(source.base, source.length, source.capacity, "f1999(0, 10);\n");
+    if (!js_compile(&source, &token, &bytecode, &cross_reference)) {
+        return;
+    }
+    printf("bytecode %u bytes, cross reference %u lines\n", bytecode.length, cross_reference.length);
+    struct js_vm *vms = alloc(struct js_vm, num_vms);
+    for (int sharing = 0; sharing <= 1; sharing++) {
+        struct js_program *program = sharing ? js_program_new(&bytecode, &cross_reference) : NULL;
+        size_t rss = _resident_kb();
+        double start = (double)clock() / CLOCKS_PER_SEC;
+        for (size_t i = 0; i < num_vms; i++) {
+            vms[i] = (struct js_vm){0};
+            if (sharing) {
+                js_load_program(vms + i, program);
+            } else {
+                buffer_alloc(vms[i].bytecode.base, vms[i].bytecode.length, vms[i].bytecode.capacity, bytecode.length);
+                memcpy(vms[i].bytecode.base, bytecode.base, bytecode.length);
+                vms[i].bytecode.length = bytecode.length;
+                buffer_alloc(vms[i].cross_reference.base, vms[i].cross_reference.length, vms[i].cross_reference.capacity, cross_reference.length);
+                memcpy(vms[i].cross_reference.base, cross_reference.base, cross_reference.length * sizeof(uint32_t));
+                vms[i].cross_reference.length = cross_reference.length;
+            }
+            struct js_result result = js_run(vms + i);
+            enforce(result.success);
+        }
+        double elapsed = (double)clock() / CLOCKS_PER_SEC - start;
+        printf("%s: %zu vms created and run in %g secs, resident memory grows %lld KB\n", sharing ? "shared" : "copied", num_vms, elapsed, (long long)_resident_kb() - (long long)rss);
+        for (size_t i = 0; i < num_vms; i++) {
+            js_free_vm(vms + i);
+        }
+        if (program) {
+            enforce(program->references == 1);
+            js_program_release(program);
+        }
+    }
+    free(vms);
+    buffer_free(source.base, source.length, source.capacity);
+}
+
 #endif
\ No newline at end of file
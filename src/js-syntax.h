@@ -152,6 +152,9 @@ shared void test_parser();
 shared void test_c_function();
 shared void test_unescape_string();
 shared void test_free_vm();
+shared void test_budget();
+shared void test_stack_overflow();
+shared void test_program();
 
 #endif
 
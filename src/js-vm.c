@@ -284,7 +284,7 @@ struct js_result js_vm_dump(struct js_vm *vm) {
     //     printf("\n");
     // });
     printf("stack base=%p length=%u capacity=%u\n", vm->stack.base, vm->stack.length, vm->stack.capacity);
-    for (uint16_t depth = 0; depth < vm->stack.length; depth++) {
+    for (uint32_t depth = 0; depth < vm->stack.length; depth++) {
         struct js_stack_frame *frame = vm->stack.base + depth;
         printf("    %u: (%u)%s", depth, frame->type, _stack_frame_type_names[frame->type]);
         switch (frame->type) {
@@ -334,9 +334,9 @@ struct js_result js_vm_dump(struct js_vm *vm) {
 // reverse order, from top to down
 #define _stack_for_each(__arg_vm, __arg_frame, __arg_block) \
     do { \
-        /* DON'T use "for (uint16_t i = vm->stack.length - 1; i >= 0; i--)", \
+        /* DON'T use "for (uint32_t i = vm->stack.length - 1; i >= 0; i--)", \
         because turn unsigned i into negative will result a huge positive value */ \
-        for (uint16_t i = 0; i < __arg_vm->stack.length; i++) { \
+        for (uint32_t i = 0; i < __arg_vm->stack.length; i++) { \
             struct js_stack_frame *__arg_frame = __arg_vm->stack.base + __arg_vm->stack.length - 1 - i; \
             __arg_block; \
         } \
@@ -354,7 +354,7 @@ static struct js_variable_map *_get_current_scope(struct js_vm *vm) {
     return &(vm->globals);
 }
 
-struct js_result js_declare_variable(struct js_vm *vm, const char *name, uint16_t name_length, struct js_value value) {
+struct js_result js_declare_variable(struct js_vm *vm, const char *name, uint32_t name_length, struct js_value value) {
     struct js_variable_map *scope = _get_current_scope(vm);
     if (js_map_get(scope->base, scope->length, scope->capacity, name, name_length).type != 0) {
         log_debug("Variable \"%.*s\" already exists", (int)name_length, name);
@@ -365,10 +365,10 @@ struct js_result js_declare_variable(struct js_vm *vm, const char *name, uint16_
 }
 
 struct js_result js_declare_variable_sz(struct js_vm *vm, const char *name, struct js_value value) {
-    return js_declare_variable(vm, name, (uint16_t)strlen(name), value);
+    return js_declare_variable(vm, name, (uint32_t)strlen(name), value);
 }
 
-struct js_result js_delete_variable(struct js_vm *vm, const char *name, uint16_t name_length) {
+struct js_result js_delete_variable(struct js_vm *vm, const char *name, uint32_t name_length) {
     struct js_variable_map *scope = _get_current_scope(vm);
     if (js_map_get(scope->base, scope->length, scope->capacity, name, name_length).type == 0) {
         log_debug("Variable \"%.*s\" not found", (int)name_length, name);
@@ -379,10 +379,10 @@ struct js_result js_delete_variable(struct js_vm *vm, const char *name, uint16_t
 }
 
 struct js_result js_delete_variable_sz(struct js_vm *vm, const char *name) {
-    return js_delete_variable(vm, name, (uint16_t)strlen(name));
+    return js_delete_variable(vm, name, (uint32_t)strlen(name));
 }
 
-struct js_result js_put_variable(struct js_vm *vm, const char *name, uint16_t name_length, struct js_value value) {
+struct js_result js_put_variable(struct js_vm *vm, const char *name, uint32_t name_length, struct js_value value) {
     // first, check current stack variables
     // second, check current stack closure if is function
     // there may be multiple nested functions, so each stack should check closure
@@ -408,10 +408,10 @@ struct js_result js_put_variable(struct js_vm *vm, const char *name, uint16_t na
 }
 
 struct js_result js_put_variable_sz(struct js_vm *vm, const char *name, struct js_value value) {
-    return js_put_variable(vm, name, (uint16_t)strlen(name), value);
+    return js_put_variable(vm, name, (uint32_t)strlen(name), value);
 }
 
-struct js_result js_get_variable(struct js_vm *vm, const char *name, uint16_t name_length) {
+struct js_result js_get_variable(struct js_vm *vm, const char *name, uint32_t name_length) {
     // first, check current stack variables
     // second, check current stack closure if is function
     // there may be multiple nested functions, so each stack should check closure
@@ -438,18 +438,66 @@ struct js_result js_get_variable(struct js_vm *vm, const char *name, uint16_t na
 }
 
 struct js_result js_get_variable_sz(struct js_vm *vm, const char *name) {
-    return js_get_variable(vm, name, (uint16_t)strlen(name));
+    return js_get_variable(vm, name, (uint32_t)strlen(name));
+}
+
+void js_put_internal_sz(struct js_vm *vm, const char *name, struct js_value value) {
+    js_map_put(vm->internals.base, vm->internals.length, vm->internals.capacity, name, (uint32_t)strlen(name), value);
+}
+
+struct js_value js_get_internal_sz(struct js_vm *vm, const char *name) {
+    return js_map_get(vm->internals.base, vm->internals.length, vm->internals.capacity, name, (uint32_t)strlen(name));
+}
+
+#define _stack_default_limit (1 << 20)
+// after 'Stack overflow' is thrown, there must be enough frames for exception handling
+#define _stack_headroom 1024
+// function frame egress of js_call_prepare(), like 0, exits js_run(), but frame is kept
+#define _egress_prepared UINT32_MAX
+#define _stack_overflowed(__arg_stack) ((__arg_stack)->limit != 0 && (__arg_stack)->length + _stack_headroom >= (__arg_stack)->limit)
+
+static size_t _stack_reserved_size(struct js_stack *stack, size_t page_size) {
+    size_t size = (size_t)stack->limit * sizeof(struct js_stack_frame);
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+static void _stack_grow(struct js_stack *stack) {
+    size_t page_size = virtual_page_size();
+    if (stack->base == NULL) {
+        if (stack->limit == 0) {
+            stack->limit = _stack_default_limit;
+        }
+        enforce(stack->limit > _stack_headroom);
+        // plus 1 guard page which is never committed
+        stack->base = (struct js_stack_frame *)virtual_reserve(_stack_reserved_size(stack, page_size) + page_size);
+        enforce(stack->base != NULL);
+    }
+    if (stack->capacity >= stack->limit) {
+        // should not happen, because _stack_overflowed() is checked on every call
+        fatal("Stack overflow");
+    }
+    size_t size = stack->capacity == 0 ? page_size : (size_t)stack->capacity * 2 * sizeof(struct js_stack_frame);
+    size = min((size + page_size - 1) / page_size * page_size, _stack_reserved_size(stack, page_size));
+    enforce(virtual_commit(stack->base, size));
+    stack->capacity = (uint32_t)min(size / sizeof(struct js_stack_frame), stack->limit);
+}
+
+static void _stack_free(struct js_stack *stack) {
+    if (stack->base) {
+        size_t page_size = virtual_page_size();
+        virtual_release(stack->base, _stack_reserved_size(stack, page_size) + page_size);
+    }
+    *stack = (struct js_stack){.limit = stack->limit};
 }
 
 static void _stack_push(struct js_vm *vm, struct js_stack_frame frame) {
-    // compound literal which contains comma can not be used inside macro
-    // https://stackoverflow.com/questions/5558159/compound-literals-and-function-like-macros-bug-in-gcc-or-the-c-standard
-    // finally it can, just surround with extra parentheses
-    // such as: ((struct foo){.a = 1, .b = 2, .c = 3})
-    buffer_push(vm->stack.base, vm->stack.length, vm->stack.capacity, frame);
+    if (vm->stack.length >= vm->stack.capacity) {
+        _stack_grow(&(vm->stack));
+    }
+    vm->stack.base[vm->stack.length++] = frame;
 }
 
-static struct js_stack_frame *_stack_peek(struct js_vm *vm, uint16_t depth) { // depth from 0 (top) to length-1 (bottom)
+static struct js_stack_frame *_stack_peek(struct js_vm *vm, uint32_t depth) { // depth from 0 (top) to length-1 (bottom)
     // js_vm_dump(vm);
     // js_bytecode_dump(&(vm->bytecode));
     enforce(vm->stack.length > depth);
@@ -465,14 +513,14 @@ static void _stack_frame_free(struct js_stack_frame *frame) {
     }
 }
 
-static void _stack_pop(struct js_vm *vm, uint16_t depth) {
-    for (uint16_t i = 0; i < depth; i++) {
+static void _stack_pop(struct js_vm *vm, uint32_t depth) {
+    for (uint32_t i = 0; i < depth; i++) {
         _stack_frame_free(_stack_peek(vm, i));
     }
     vm->stack.length -= depth;
 }
 
-static struct js_value _stack_peek_value(struct js_vm *vm, uint16_t depth) { // depth from 0 (top) to length-1 (bottom)
+static struct js_value _stack_peek_value(struct js_vm *vm, uint32_t depth) { // depth from 0 (top) to length-1 (bottom)
     struct js_stack_frame *frame = _stack_peek(vm, depth);
     enforce(frame->type == sf_value);
     return frame->value;
@@ -485,7 +533,7 @@ static struct js_value _stack_pop_value(struct js_vm *vm) {
 }
 
 static void _stack_pop_to(struct js_vm *vm, enum js_stack_frame_type type) {
-    uint16_t depth = 0;
+    uint32_t depth = 0;
     _stack_for_each(vm, frame, {
         if (frame->type == type) {
             break;
@@ -499,7 +547,57 @@ static void _stack_push_value(struct js_vm *vm, struct js_value value) {
     _stack_push(vm, (struct js_stack_frame){.type = sf_value, .value = value});
 }
 
-static const char *const _typeof_table[] = {"undefined", "null", "boolean", "number", "string", "string", "string", "array", "object", "function", "function"};
+#define _mark_map(__arg_map) \
+    js_map_for_each((__arg_map).base, (__arg_map).length, (__arg_map).capacity, k, kl, v, { \
+        (void)k; \
+        (void)kl; \
+        js_mark(v); \
+    })
+#define _mark_list(__arg_map) \
+    js_list_for_each((__arg_map).base, (__arg_map).length, (__arg_map).capacity, i, v, { \
+        (void)i; \
+        js_mark(v); \
+    })
+
+// not only vm's, but also coroutines'
+static void _stack_mark(struct js_stack *stack) {
+    for (uint32_t i = 0; i < stack->length; i++) {
+        struct js_stack_frame *frame = stack->base + i;
+        if (frame->type == sf_value) {
+            // temporary values, gc may be triggered by heap limit between instructions
+            js_mark(&(frame->value));
+            continue;
+        }
+        _mark_map(frame->locals);
+        if (frame->type == sf_function) {
+            // some anonumous functions which are in use by callee
+            // c function's arguments must also be marked, for example, in an anonymous callback of c function, invoked gc(), this callback be sweeped, boom!
+            _mark_list(frame->arguments);
+            if (frame->function != NULL) {
+                _mark_map(frame->function->function.closure);
+            }
+        }
+    }
+}
+
+// coroutine owns a stack and pc, they are swapped with vm's while running, so that it can be suspended at any depth of script calls
+// smaller than default, there may be many of them
+#define _coroutine_stack_limit (1 << 16)
+
+enum _coroutine_state { _coroutine_created, _coroutine_suspended, _coroutine_running, _coroutine_dead };
+
+struct js_coroutine {
+    struct js_stack stack; // resumer's while running
+    uint32_t pc; // likewise
+    uint32_t nesting; // vm's nesting while running, yield is only allowed at this level
+    uint8_t state;
+    bool yielded; // set by js_yield(), tells js_run() to return
+    struct js_value function;
+    struct js_value value; // yielded
+    struct js_coroutine *resumer; // previous running one
+};
+
+static const char *const _typeof_table[] = {"undefined", "null", "boolean", "number", "string", "string", "array", "object", "function", "function", "object", "array", "object", "object"};
 
 struct js_value *js_get_arguments_base(struct js_vm *vm) {
     struct js_stack_frame *frame = _stack_peek(vm, 0);
@@ -507,13 +605,13 @@ struct js_value *js_get_arguments_base(struct js_vm *vm) {
     return frame->arguments.base;
 }
 
-uint16_t js_get_arguments_length(struct js_vm *vm) {
+uint32_t js_get_arguments_length(struct js_vm *vm) {
     struct js_stack_frame *frame = _stack_peek(vm, 0);
     enforce(frame->type == sf_function);
     return frame->arguments.length;
 }
 
-struct js_value js_get_argument(struct js_vm *vm, uint16_t index) {
+struct js_value js_get_argument(struct js_vm *vm, uint32_t index) {
     struct js_stack_frame *frame = _stack_peek(vm, 0);
     enforce(frame->type == sf_function);
     if (index < frame->arguments.length) {
@@ -589,7 +687,7 @@ struct js_result js_run(struct js_vm *vm) {
                 _stack_push_value(vm, __error); \
                 goto end_of_while_loop; /* DON'T use 'break' because it may be in another loop */ \
                 /* function != NULL but egress == 0 means called by c function, see js_call() */ \
-            } else if (frame->type == sf_function && frame->egress == 0) { \
+            } else if (frame->type == sf_function && (frame->egress == 0 || frame->egress == _egress_prepared)) { \
                 js_throw(__error); \
             } \
         } \
@@ -604,6 +702,26 @@ struct js_result js_run(struct js_vm *vm) {
             __throw(result.value); \
         } \
     } while (0);
+#define __check_budget() \
+    do { \
+        if (atomic_load_long(&(vm->interrupted)) || (vm->step_limit && ++(vm->steps) >= vm->step_limit)) { \
+            if (vm->nesting == 0) { \
+                /* pc already points to next instruction, so nothing else to save */ \
+                atomic_store_long(&(vm->interrupted), 0); \
+                vm->steps = 0; \
+                js_return((struct js_value){0}); \
+            } else if (atomic_load_long(&(vm->interrupted))) { \
+                /* cannot yield across c function, flag is kept, so outermost js_run() will finally yield */ \
+                __throw(js_scripture_sz("Interrupted")); \
+            } \
+        } \
+        if (vm->heap_limit && vm->heap.length > vm->heap_limit) { \
+            js_collect_garbage(vm); \
+            if (vm->heap.length > vm->heap_limit) { \
+                __throw(js_scripture_sz("Out of memory")); \
+            } \
+        } \
+    } while (0)
 #define __lhs container
 #define __rhs selector
     curr_offset = vm->pc;
@@ -689,6 +807,10 @@ struct js_result js_run(struct js_vm *vm) {
                 }
                 break;
             case sf_function:
+                if (_stack_overflowed(&(vm->stack))) {
+                    __throw(js_scripture_sz("Stack overflow"));
+                }
+                // fall through
             case sf_try:
                 enforce(instruction.num_operands = 2);
                 enforce(instruction.operands[1].type == opd_uint32);
@@ -740,6 +862,9 @@ struct js_result js_run(struct js_vm *vm) {
             enforce(instruction.num_operands == 1);
             enforce(instruction.operands[0].type == opd_uint32);
             vm->pc = instruction.operands[0].value_uint32;
+            if (vm->pc <= curr_offset) { // loops
+                __check_budget();
+            }
             break;
         case op_argument_append:
             value = _stack_pop_value(vm);
@@ -757,6 +882,7 @@ struct js_result js_run(struct js_vm *vm) {
             case vt_function:
                 frame->function = value.managed; // complete sf_function
                 vm->pc = value.managed->function.ingress;
+                __check_budget();
                 // __debug();
                 break;
             case vt_c_function:
@@ -771,6 +897,10 @@ struct js_result js_run(struct js_vm *vm) {
                 __do_try(((js_c_function_pointer_type)value.c_function)(vm));
                 _stack_pop(vm, 2);
                 _stack_push_value(vm, result.value);
+                if (vm->coroutine && vm->coroutine->yielded) {
+                    // suspended by js_yield(), pc already points to next instruction, pushed value will be replaced by js_resume()
+                    js_return((struct js_value){0});
+                }
                 // __debug();
                 break;
             default:
@@ -794,6 +924,9 @@ struct js_result js_run(struct js_vm *vm) {
                 // is called by c function, exit loop
                 _stack_pop(vm, 2); // cleanup
                 js_return(value);
+            } else if (_stack_peek(vm, 0)->egress == _egress_prepared) {
+                // frame is kept for next call, see js_call_prepared()
+                js_return(value);
             } else {
                 // else jump to function egress
                 vm->pc = _stack_peek(vm, 0)->egress;
@@ -848,10 +981,17 @@ struct js_result js_run(struct js_vm *vm) {
                     __throw(js_scripture_sz("Invalid array index, must be positive integer"));
                 }
                 js_array_put(&container, index, value);
+            } else if (container.type == vt_typed_array && selector.type == vt_number) {
+                index = (size_t)selector.number;
+                if (index != selector.number || !js_typed_array_put(&container, index, value)) {
+                    __throw(js_scripture_sz("Typed array index must be in range and element must be number"));
+                }
             } else if (container.type == vt_object && js_is_string(&selector)) {
-                js_object_put(&container, js_string_base(&selector), (uint16_t)js_string_length(&selector), value);
+                js_object_put(&container, js_string_base(&selector), (uint32_t)js_string_length(&selector), value);
+            } else if (container.type == vt_hashmap && selector.type != vt_null) {
+                js_hashmap_put(&container, selector, value);
             } else {
-                __throw(js_scripture_sz("Must be array[number] or object[string]"));
+                __throw(js_scripture_sz("Must be array[number], object[string] or hashmap[non-null]"));
             }
             break;
         case op_member_get:
@@ -863,10 +1003,18 @@ struct js_result js_run(struct js_vm *vm) {
                     __throw(js_scripture_sz("Invalid array index, must be positive integer"));
                 }
                 _stack_push_value(vm, js_array_get(&container, index));
+            } else if (container.type == vt_typed_array && selector.type == vt_number) {
+                index = (size_t)selector.number;
+                if (index != selector.number) {
+                    __throw(js_scripture_sz("Invalid array index, must be positive integer"));
+                }
+                _stack_push_value(vm, js_typed_array_get(&container, index));
             } else if (container.type == vt_object && js_is_string(&selector)) {
-                _stack_push_value(vm, js_object_get(&container, js_string_base(&selector), (uint16_t)js_string_length(&selector)));
+                _stack_push_value(vm, js_object_get(&container, js_string_base(&selector), (uint32_t)js_string_length(&selector)));
+            } else if (container.type == vt_hashmap) {
+                _stack_push_value(vm, js_hashmap_get(&container, selector));
             } else {
-                __throw(js_scripture_sz("Must be array[number] or object[string]"));
+                __throw(js_scripture_sz("Must be array[number], object[string] or hashmap[non-null]"));
             }
             break;
         case op_array_append:
@@ -883,9 +1031,11 @@ struct js_result js_run(struct js_vm *vm) {
             container = _stack_peek_value(vm, 0);
             if (container.type == vt_array && value.type == vt_array) {
                 // no skip null
-                buffer_for_each(value.managed->array.base, value.managed->array.length, _, i, v, {
-                    js_array_push(&container, *v);
-                });
+                js_array_spread(&container, &value);
+            } else if (container.type == vt_array && value.type == vt_typed_array) {
+                for (index = 0; index < value.managed->typed_array.length; index++) {
+                    js_array_push(&container, js_typed_array_get(&value, index));
+                }
             } else {
                 __throw(js_scripture_sz("Must be array[...array]"));
             }
@@ -894,7 +1044,7 @@ struct js_result js_run(struct js_vm *vm) {
             selector = _stack_pop_value(vm);
             container = _stack_pop_value(vm);
             if (container.type == vt_object && js_is_string(&selector)) {
-                _stack_push_value(vm, js_object_get(&container, js_string_base(&selector), (uint8_t)js_string_length(&selector)));
+                _stack_push_value(vm, js_object_get(&container, js_string_base(&selector), (uint32_t)js_string_length(&selector)));
             } else {
                 _stack_push_value(vm, js_null());
             }
@@ -903,13 +1053,21 @@ struct js_result js_run(struct js_vm *vm) {
             value = _stack_pop_value(vm);
             frame = _stack_peek(vm, 0);
             enforce(frame->type == sf_function);
+            if (value.type == vt_typed_array) {
+                buffer_alloc(frame->arguments.base, frame->arguments.length, frame->arguments.capacity, frame->arguments.length + (uint32_t)value.managed->typed_array.length);
+                for (index = 0; index < value.managed->typed_array.length; index++) {
+                    frame->arguments.base[frame->arguments.length++] = js_typed_array_get(&value, index);
+                }
+                break;
+            }
             if (value.type != vt_array) {
                 __throw(js_scripture_sz("Parameter to be spreaded must be array"));
             }
-            buffer_for_each(value.managed->array.base, value.managed->array.length, _, i, v, {
-                // arguments will be used by 3rd-party c functions, so special treat js_undefined here
-                buffer_push(frame->arguments.base, frame->arguments.length, frame->arguments.capacity, v->type == 0 ? js_null() : *v);
-            });
+            buffer_alloc(frame->arguments.base, frame->arguments.length, frame->arguments.capacity, frame->arguments.length + (uint32_t)value.managed->array.length);
+            for (index = 0; index < value.managed->array.length; index++) {
+                // arguments will be used by 3rd-party c functions, js_array_get() already turns holes into null
+                frame->arguments.base[frame->arguments.length++] = js_array_get(&value, index);
+            }
             break;
         case op_argument_get_rest:
             enforce(instruction.num_operands == 1);
@@ -1084,6 +1242,9 @@ struct js_result js_run(struct js_vm *vm) {
             yes = instruction.opcode == op_jump_if_true ? value.boolean : !value.boolean;
             if (yes) {
                 vm->pc = instruction.operands[0].value_uint32;
+                if (vm->pc <= curr_offset) { // do while
+                    __check_budget();
+                }
             }
             break;
         case op_break:
@@ -1098,6 +1259,7 @@ struct js_result js_run(struct js_vm *vm) {
             enforce(vm->stack.length > 0);
             frame = _stack_peek(vm, 0);
             vm->pc = frame->ingress;
+            __check_budget();
             break;
         case op_for_in_next: // push next value into stack top
         case op_for_of_next: // push next value into stack top
@@ -1108,15 +1270,15 @@ struct js_result js_run(struct js_vm *vm) {
             container = _stack_peek_value(vm, 0); // array/object to be looped
             yes = false; // whether success
             if (container.type == vt_array) {
-                for (; index < container.managed->array.length; index++) {
-                    value = container.managed->array.base[index];
-                    if (value.type != vt_undefined && value.type != vt_null) {
-                        if (instruction.opcode == op_for_in_next) {
-                            value = js_number((double)index);
-                        }
-                        yes = true;
-                        break;
-                    }
+                index = js_array_next(&container, index);
+                if (index < container.managed->array.length) {
+                    value = instruction.opcode == op_for_in_next ? js_number((double)index) : js_array_get(&container, index);
+                    yes = true;
+                }
+            } else if (container.type == vt_typed_array) {
+                if (index < container.managed->typed_array.length) {
+                    value = instruction.opcode == op_for_in_next ? js_number((double)index) : js_typed_array_get(&container, index);
+                    yes = true;
                 }
             } else if (container.type == vt_object) {
                 // js_value_map_dump(value->value.object->p, value->value.object->len, value->value.object->cap);
@@ -1133,8 +1295,25 @@ struct js_result js_run(struct js_vm *vm) {
                         break;
                     }
                 }
+            } else if (container.type == vt_hashmap || container.type == vt_hashset) {
+                // hashset gives elements in both cases
+                for (; index < container.managed->hashmap.capacity; index++) {
+                    struct js_value_pair *pair = container.managed->hashmap.base + index;
+                    if (pair->key.type != vt_undefined && pair->value.type != vt_undefined) {
+                        value = instruction.opcode == op_for_of_next && container.type == vt_hashmap ? pair->value : pair->key;
+                        yes = true;
+                        break;
+                    }
+                }
+            } else if (instruction.opcode == op_for_of_next && js_is_coroutine(&container)) {
+                // lazy, resumed once per iteration, returned value is not iterated
+                __do_try(js_resume(vm, container, js_null()));
+                if (((struct js_coroutine *)container.managed->c_value.data)->state != _coroutine_dead) {
+                    value = result.value;
+                    yes = true;
+                }
             } else {
-                __throw(js_scripture_sz("'for in/of' operand must be array or object"));
+                __throw(js_scripture_sz("'for in/of' operand must be array, typed array, hashmap, hashset, object or coroutine"));
             }
             _stack_push_value(vm, js_number((double)(index + 1))); // write back loop number
             if (yes) {
@@ -1154,6 +1333,7 @@ struct js_result js_run(struct js_vm *vm) {
     js_return(js_null());
 #undef __rhs
 #undef __lhs
+#undef __check_budget
 #undef __throw
 #undef __operand_0_length
 #undef __operand_0_offset
@@ -1161,44 +1341,28 @@ struct js_result js_run(struct js_vm *vm) {
 }
 
 struct js_result js_collect_garbage(struct js_vm *vm) {
-#define __mark_map(__arg_map) \
-    js_map_for_each((__arg_map).base, (__arg_map).length, (__arg_map).capacity, k, kl, v, { \
-        (void)k; \
-        (void)kl; \
-        js_mark(v); \
-    })
-#define __mark_list(__arg_map) \
-    js_list_for_each((__arg_map).base, (__arg_map).length, (__arg_map).capacity, i, v, { \
-        (void)i; \
-        js_mark(v); \
-    })
-    __mark_map(vm->globals);
-    _call_stack_for_each(vm, frame, {
-        __mark_map(frame->locals);
-        if (frame->type == sf_function) {
-            // some anonumous functions which are in use by callee
-            // c function's arguments must also be marked, for example, in an anonymous callback of c function, invoked gc(), this callback be sweeped, boom!
-            __mark_list(frame->arguments);
-            if (frame->function != NULL) {
-                __mark_map(frame->function->function.closure);
-            }
-        }
-    });
+    _mark_map(vm->globals);
+    _mark_map(vm->internals);
+    _stack_mark(&(vm->stack));
+    // stacks of resumers, suspended coroutines are marked only if reachable
+    for (struct js_coroutine *co = vm->coroutine; co; co = co->resumer) {
+        _stack_mark(&(co->stack));
+    }
     js_sweep(&(vm->heap));
     js_return(js_null());
-#undef __mark_list
-#undef __mark_map
 }
 
-struct js_result js_call(struct js_vm *vm, struct js_value fv, struct js_value *arguments, uint16_t num_arguments) {
+struct js_result js_call(struct js_vm *vm, struct js_value fv, struct js_value *arguments, uint32_t num_arguments) {
     if (fv.type == vt_function) {
         // backup stack depth, in callee, may throw error, stack won't be cleaned up, if not cleaned here and return at upper vm's 'op_call', and '__do_try' will check stack and found leftover .egress=0 stack, and exit vm, this shouldn't happen
-        uint16_t stack_length_backup = vm->stack.length;
-        buffer_push(vm->stack.base, vm->stack.length, vm->stack.capacity,
-            ((struct js_stack_frame){.type = sf_value, .value = fv}));
+        if (_stack_overflowed(&(vm->stack))) {
+            js_throw(js_scripture_sz("Stack overflow"));
+        }
+        uint32_t stack_length_backup = vm->stack.length;
+        _stack_push(vm, (struct js_stack_frame){.type = sf_value, .value = fv});
         struct js_stack_frame frame = (struct js_stack_frame){.type = sf_function, .function = fv.managed, .egress = 0}; // 0 indicates called by c function
         // prepare arguments
-        for (uint16_t i = 0; i < num_arguments; i++) {
+        for (uint32_t i = 0; i < num_arguments; i++) {
             // js_value_dump(arguments + i);
             // printf("\n");
             // special treat for vt_undefined from such as array element passed to sort callback
@@ -1208,11 +1372,13 @@ struct js_result js_call(struct js_vm *vm, struct js_value fv, struct js_value *
             }
             buffer_push(frame.arguments.base, frame.arguments.length, frame.arguments.capacity, arg);
         }
-        buffer_push(vm->stack.base, vm->stack.length, vm->stack.capacity, frame);
+        _stack_push(vm, frame);
         // backup program counter, jump to function ingress, wait for function completion
         uint32_t pc_backup = vm->pc;
         vm->pc = fv.managed->function.ingress;
+        vm->nesting++;
         struct js_result result = js_run(vm);
+        vm->nesting--;
         vm->pc = pc_backup;
         // restore to backuped stack depth
         if (vm->stack.length > stack_length_backup) {
@@ -1220,14 +1386,16 @@ struct js_result js_call(struct js_vm *vm, struct js_value fv, struct js_value *
         }
         return result;
     } else if (fv.type == vt_c_function) {
-        buffer_push(vm->stack.base, vm->stack.length, vm->stack.capacity,
-            ((struct js_stack_frame){.type = sf_value, .value = fv}));
+        if (_stack_overflowed(&(vm->stack))) {
+            js_throw(js_scripture_sz("Stack overflow"));
+        }
+        _stack_push(vm, (struct js_stack_frame){.type = sf_value, .value = fv});
         struct js_stack_frame frame = (struct js_stack_frame){.type = sf_function};
-        for (uint16_t i = 0; i < num_arguments; i++) {
+        for (uint32_t i = 0; i < num_arguments; i++) {
             // is it necessart to special treat for vt_undefined like above? maybe not, c_function can handle it
             buffer_push(frame.arguments.base, frame.arguments.length, frame.arguments.capacity, arguments[i]);
         }
-        buffer_push(vm->stack.base, vm->stack.length, vm->stack.capacity, frame);
+        _stack_push(vm, frame);
         struct js_result result = ((js_c_function_pointer_type)fv.c_function)(vm);
         _stack_pop(vm, 2);
         return result;
@@ -1236,7 +1404,71 @@ struct js_result js_call(struct js_vm *vm, struct js_value fv, struct js_value *
     }
 }
 
-struct js_result js_call_by_name(struct js_vm *vm, const char *name, uint16_t name_length, struct js_value *arguments, uint16_t num_arguments) {
+// [sf_value retained] [sf_value function] [sf_function]
+struct js_result js_call_prepare(struct js_vm *vm, struct js_prepared_call *prepared, struct js_value fv, struct js_value retained) {
+    if (!js_is_function(&fv)) {
+        js_throw(js_scripture_sz("Not a function"));
+    }
+    if (_stack_overflowed(&(vm->stack))) {
+        js_throw(js_scripture_sz("Stack overflow"));
+    }
+    prepared->function = fv;
+    prepared->stack_length = vm->stack.length;
+    _stack_push(vm, (struct js_stack_frame){.type = sf_value, .value = retained});
+    _stack_push(vm, (struct js_stack_frame){.type = sf_value, .value = fv});
+    if (fv.type == vt_function) {
+        _stack_push(vm, (struct js_stack_frame){.type = sf_function, .function = fv.managed, .egress = _egress_prepared});
+    } else {
+        _stack_push(vm, (struct js_stack_frame){.type = sf_function});
+    }
+    js_return(js_null());
+}
+
+// arguments buffer and local variable slots are reused, no allocation after first call
+struct js_result js_call_prepared(struct js_vm *vm, struct js_prepared_call *prepared, struct js_value *arguments, uint32_t num_arguments) {
+    uint32_t depth = prepared->stack_length + 3;
+    enforce(vm->stack.length == depth);
+    struct js_stack_frame *frame = vm->stack.base + depth - 1;
+    frame->arguments.length = 0;
+    frame->arguments.index = 0;
+    for (uint32_t i = 0; i < num_arguments; i++) {
+        // same as js_call()
+        struct js_value arg = arguments[i];
+        if (prepared->function.type == vt_function && arg.type == 0) {
+            arg = js_null();
+        }
+        buffer_push(frame->arguments.base, frame->arguments.length, frame->arguments.capacity, arg);
+    }
+    if (prepared->function.type == vt_c_function) {
+        return ((js_c_function_pointer_type)prepared->function.c_function)(vm);
+    }
+    uint32_t pc_backup = vm->pc;
+    vm->pc = prepared->function.managed->function.ingress;
+    vm->nesting++;
+    struct js_result result = js_run(vm);
+    vm->nesting--;
+    vm->pc = pc_backup;
+    // returned or thrown, all frames above are already popped, but make sure
+    enforce(vm->stack.length >= depth);
+    if (vm->stack.length > depth) {
+        _stack_pop(vm, vm->stack.length - depth);
+    }
+    // locals are deleted but slots are kept, redeclaration will reuse them
+    js_map_for_each(frame->locals.base, frame->locals.length, frame->locals.capacity, k, kl, v, {
+        (void)k;
+        (void)kl;
+        *v = (struct js_value){0};
+    });
+    frame->locals.length = 0;
+    return result;
+}
+
+void js_call_release(struct js_vm *vm, struct js_prepared_call *prepared) {
+    enforce(vm->stack.length >= prepared->stack_length);
+    _stack_pop(vm, vm->stack.length - prepared->stack_length);
+}
+
+struct js_result js_call_by_name(struct js_vm *vm, const char *name, uint32_t name_length, struct js_value *arguments, uint32_t num_arguments) {
     struct js_result result = js_get_variable(vm, name, name_length);
     if (!result.success) {
         return result;
@@ -1244,8 +1476,120 @@ struct js_result js_call_by_name(struct js_vm *vm, const char *name, uint16_t na
     return js_call(vm, result.value, arguments, num_arguments);
 }
 
-struct js_result js_call_by_name_sz(struct js_vm *vm, const char *name, struct js_value *arguments, uint16_t num_arguments) {
-    return js_call_by_name(vm, name, (uint16_t)strlen(name), arguments, num_arguments);
+struct js_result js_call_by_name_sz(struct js_vm *vm, const char *name, struct js_value *arguments, uint32_t num_arguments) {
+    return js_call_by_name(vm, name, (uint32_t)strlen(name), arguments, num_arguments);
+}
+
+static void _coroutine_mark(void *data) {
+    struct js_coroutine *co = (struct js_coroutine *)data;
+    js_mark(&(co->function));
+    js_mark(&(co->value));
+    _stack_mark(&(co->stack));
+}
+
+static void _coroutine_sweep(void *data) {
+    struct js_coroutine *co = (struct js_coroutine *)data;
+    // never running here, running one is reachable from resumer's stack
+    for (uint32_t i = 0; i < co->stack.length; i++) {
+        _stack_frame_free(co->stack.base + i);
+    }
+    _stack_free(&(co->stack));
+    free(co);
+}
+
+struct js_value js_coroutine(struct js_vm *vm, struct js_value fv) {
+    enforce(fv.type == vt_function);
+    struct js_coroutine *co = alloc(struct js_coroutine, 1);
+    enforce(co != NULL);
+    co->stack.limit = _coroutine_stack_limit;
+    co->function = fv;
+    co->value = js_null();
+    return js_c_value(&(vm->heap), co, _coroutine_mark, _coroutine_sweep);
+}
+
+bool js_is_coroutine(struct js_value *value) {
+    return value->type == vt_c_value && value->managed->c_value.mark == _coroutine_mark;
+}
+
+const char *js_coroutine_status(struct js_value *value) {
+    switch (((struct js_coroutine *)value->managed->c_value.data)->state) {
+    case _coroutine_running:
+        return "running";
+    case _coroutine_dead:
+        return "dead";
+    default:
+        return "suspended";
+    }
+}
+
+static void _coroutine_swap(struct js_vm *vm, struct js_coroutine *co) {
+    struct js_stack stack = vm->stack;
+    vm->stack = co->stack;
+    co->stack = stack;
+    uint32_t pc = vm->pc;
+    vm->pc = co->pc;
+    co->pc = pc;
+}
+
+struct js_result js_resume(struct js_vm *vm, struct js_value cv, struct js_value value) {
+    enforce(js_is_coroutine(&cv));
+    struct js_coroutine *co = (struct js_coroutine *)cv.managed->c_value.data;
+    if (co->state == _coroutine_running) {
+        js_throw(js_scripture_sz("Coroutine is running"));
+    } else if (co->state == _coroutine_dead) {
+        js_throw(js_scripture_sz("Coroutine is dead"));
+    }
+    _coroutine_swap(vm, co);
+    co->resumer = vm->coroutine;
+    vm->coroutine = co;
+    // like js_call(), budget is checked but never yields here
+    co->nesting = ++vm->nesting;
+    if (co->state == _coroutine_created) {
+        // same as js_call(), returning from this frame exits js_run()
+        _stack_push(vm, (struct js_stack_frame){.type = sf_value, .value = co->function});
+        struct js_stack_frame frame = (struct js_stack_frame){.type = sf_function, .function = co->function.managed, .egress = 0};
+        buffer_push(frame.arguments.base, frame.arguments.length, frame.arguments.capacity, value.type == vt_undefined ? js_null() : value);
+        _stack_push(vm, frame);
+        vm->pc = co->function.managed->function.ingress;
+    } else {
+        // result of yield()
+        _stack_peek(vm, 0)->value = value;
+    }
+    co->state = _coroutine_running;
+    struct js_result result = js_run(vm);
+    vm->nesting--;
+    vm->coroutine = co->resumer;
+    co->resumer = NULL;
+    if (result.success && co->yielded) {
+        co->yielded = false;
+        co->state = _coroutine_suspended;
+        result.value = co->value;
+        co->value = js_null();
+    } else {
+        // returned or thrown, release stack at once
+        co->state = _coroutine_dead;
+        _stack_pop(vm, vm->stack.length);
+        _stack_free(&(vm->stack));
+    }
+    _coroutine_swap(vm, co);
+    return result;
+}
+
+struct js_result js_yield(struct js_vm *vm, struct js_value value) {
+    struct js_coroutine *co = vm->coroutine;
+    if (co == NULL) {
+        js_throw(js_scripture_sz("Yield outside coroutine"));
+    } else if (vm->nesting != co->nesting) {
+        // js_run() to be returned is not coroutine's
+        js_throw(js_scripture_sz("Cannot yield across C function"));
+    }
+    co->yielded = true;
+    co->value = value;
+    js_return(js_null());
+}
+
+void js_interrupt(struct js_vm *vm) {
+    atomic_store_long(&(vm->interrupted), 1);
 }
 
 struct js_value js_c_function(js_c_function_pointer_type c_function) {
@@ -1253,12 +1597,597 @@ struct js_value js_c_function(js_c_function_pointer_type c_function) {
 }
 
 void js_free_vm(struct js_vm *vm) {
-    buffer_free(vm->bytecode.base, vm->bytecode.length, vm->bytecode.capacity);
-    buffer_free(vm->cross_reference.base, vm->cross_reference.length, vm->cross_reference.capacity);
+    if (vm->program) {
+        js_program_release(vm->program);
+        vm->program = NULL;
+        vm->bytecode = (struct js_bytecode){0};
+        vm->cross_reference = (struct js_cross_reference){0};
+    } else {
+        buffer_free(vm->bytecode.base, vm->bytecode.length, vm->bytecode.capacity);
+        buffer_free(vm->cross_reference.base, vm->cross_reference.length, vm->cross_reference.capacity);
+    }
     js_sweep(&(vm->heap));
     js_sweep(&(vm->heap));
     js_map_free(vm->globals.base, vm->globals.length, vm->globals.capacity);
+    js_map_free(vm->internals.base, vm->internals.length, vm->internals.capacity);
     _stack_pop(vm, vm->stack.length);
+    _stack_free(&(vm->stack));
+    if (vm->pooled) {
+        pool_release();
+        vm->pooled = false;
+    }
+}
+
+void js_use_pool(struct js_vm *vm) {
+    if (!vm->pooled) {
+        pool_acquire();
+        vm->pooled = true;
+    }
+}
+
+struct js_program *js_program_new(struct js_bytecode *bytecode, struct js_cross_reference *cross_reference) {
+    struct js_program *program = alloc(struct js_program, 1);
+    program->bytecode = *bytecode;
+    program->cross_reference = *cross_reference;
+    program->references = 1;
+    *bytecode = (struct js_bytecode){0};
+    *cross_reference = (struct js_cross_reference){0};
+    return program;
+}
+
+void js_program_retain(struct js_program *program) {
+    atomic_add_long(&(program->references), 1);
+}
+
+void js_program_release(struct js_program *program) {
+    if (atomic_add_long(&(program->references), -1) == 0) {
+        buffer_free(program->bytecode.base, program->bytecode.length, program->bytecode.capacity);
+        buffer_free(program->cross_reference.base, program->cross_reference.length, program->cross_reference.capacity);
+        free(program);
+    }
+}
+
+void js_load_program(struct js_vm *vm, struct js_program *program) {
+    enforce(vm->program == NULL && vm->bytecode.base == NULL);
+    js_program_retain(program);
+    vm->program = program;
+    // copy of descriptors only, buffers are shared
+    vm->bytecode = program->bytecode;
+    vm->cross_reference = program->cross_reference;
+}
+
+// vm image, see js_image_save(), native byte order, so only for same build on same machine
+// bytecode, then strings and typed arrays, then containers which are created empty first so that cycles are restored, then globals
+#define _image_magic "JSIMAGE\x01"
+
+struct _image {
+    char *base;
+    size_t length;
+    size_t capacity;
+    struct js_value ids; // managed value -> index in leaves or containers
+    struct js_value names; // c function -> name
+    struct {
+        struct js_value *base;
+        size_t length;
+        size_t capacity;
+    } leaves, containers;
+};
+
+#define _image_write(__arg_image, __arg_base, __arg_length) \
+    string_buffer_append((__arg_image)->base, (__arg_image)->length, (__arg_image)->capacity, (const char *)(__arg_base), (__arg_length))
+
+static void _image_write_u8(struct _image *image, uint8_t u8) {
+    _image_write(image, &u8, sizeof(u8));
+}
+
+static void _image_write_u32(struct _image *image, uint32_t u32) {
+    _image_write(image, &u32, sizeof(u32));
+}
+
+static void _image_write_u64(struct _image *image, uint64_t u64) {
+    _image_write(image, &u64, sizeof(u64));
+}
+
+static void _image_write_string(struct _image *image, const char *base, size_t length) {
+    _image_write_u64(image, length);
+    _image_write(image, base, length);
+}
+
+// gives every reachable managed value an index, strings and typed arrays have no references, so they are leaves
+static bool _image_discover(struct _image *image, struct js_value *value) {
+    struct {
+        struct js_value *base;
+        size_t length;
+        size_t capacity;
+    } pending = {0};
+    buffer_push(pending.base, pending.length, pending.capacity, *value);
+#define __visit(__arg_value) \
+    do { \
+        struct js_value *__value = (__arg_value); \
+        if (__value->type >= vt_string && __value->type != vt_c_function && js_hashmap_get(&(image->ids), *__value).type == vt_null) { \
+            buffer_push(pending.base, pending.length, pending.capacity, *__value); \
+        } \
+    } while (0)
+    while (pending.length > 0) {
+        struct js_value top = pending.base[--pending.length];
+        if (top.type < vt_string || top.type == vt_c_function || js_hashmap_get(&(image->ids), top).type != vt_null) {
+            continue;
+        }
+        struct js_managed_value *managed = top.managed;
+        switch (top.type) {
+        case vt_string:
+        case vt_typed_array:
+            js_hashmap_put(&(image->ids), top, js_number((double)image->leaves.length));
+            buffer_push(image->leaves.base, image->leaves.length, image->leaves.capacity, top);
+            break;
+        case vt_array:
+        case vt_object:
+        case vt_function:
+        case vt_hashmap:
+        case vt_hashset:
+            js_hashmap_put(&(image->ids), top, js_number((double)image->containers.length));
+            buffer_push(image->containers.base, image->containers.length, image->containers.capacity, top);
+            if (top.type == vt_array && managed->array.kind != ak_number) {
+                for (size_t i = js_array_next(&top, 0); i < managed->array.length; i = js_array_next(&top, i + 1)) {
+                    struct js_value element = js_array_get(&top, i);
+                    __visit(&element);
+                }
+            } else if (top.type == vt_object) {
+                js_map_for_each(managed->object.base, managed->object.length, managed->object.capacity, k, kl, v, {
+                    (void)k;
+                    (void)kl;
+                    __visit(v);
+                });
+            } else if (top.type == vt_function) {
+                js_map_for_each(managed->function.closure.base, managed->function.closure.length, managed->function.closure.capacity, k, kl, v, {
+                    (void)k;
+                    (void)kl;
+                    __visit(v);
+                });
+            } else if (top.type == vt_hashmap || top.type == vt_hashset) {
+                buffer_for_each(managed->hashmap.base, managed->hashmap.capacity, _, i, v, {
+                    (void)i;
+                    if (v->key.type != vt_undefined && v->value.type != vt_undefined) {
+                        __visit(&(v->key));
+                        __visit(&(v->value));
+                    }
+                });
+            }
+            break;
+        default: // c value such as file, coroutine or worker handle is bound to this process
+            buffer_free(pending.base, pending.length, pending.capacity);
+            return false;
+        }
+    }
+#undef __visit
+    buffer_free(pending.base, pending.length, pending.capacity);
+    return true;
+}
+
+// managed values are written as index, c functions as name
+static bool _image_write_value(struct _image *image, struct js_value *value) {
+    struct js_value name;
+    _image_write_u8(image, value->type);
+    switch (value->type) {
+    case vt_boolean:
+        _image_write_u8(image, value->boolean);
+        return true;
+    case vt_number:
+        _image_write(image, &(value->number), sizeof(double));
+        return true;
+    case vt_scripture:
+        _image_write_string(image, value->scripture.base, value->scripture.length);
+        return true;
+    case vt_c_function:
+        name = js_hashmap_get(&(image->names), *value);
+        if (name.type == vt_null) {
+            return false;
+        }
+        _image_write_string(image, name.scripture.base, name.scripture.length);
+        return true;
+    default:
+        if (value->type >= vt_string) {
+            _image_write_u64(image, (uint64_t)js_hashmap_get(&(image->ids), *value).number);
+        }
+        return true;
+    }
+}
+
+static bool _image_write_map(struct _image *image, struct js_kv_pair *base, size_t length, size_t capacity) {
+    _image_write_u64(image, length);
+    js_map_for_each(base, length, capacity, k, kl, v, {
+        _image_write_string(image, k, kl);
+        if (!_image_write_value(image, v)) {
+            return false;
+        }
+    });
+    return true;
+}
+
+static bool _image_write_container(struct _image *image, struct js_value *value) {
+    struct js_managed_value *managed = value->managed;
+    size_t count_offset;
+    uint64_t count = 0;
+    switch (value->type) {
+    case vt_array:
+        _image_write_u8(image, managed->array.kind);
+        _image_write_u64(image, managed->array.length);
+        if (managed->array.kind == ak_number) {
+            _image_write(image, managed->array.numbers, managed->array.length * sizeof(double));
+            return true;
+        }
+        // index-value pairs without holes, so that sparse ones stay small
+        count_offset = image->length;
+        _image_write_u64(image, 0);
+        for (size_t i = js_array_next(value, 0); i < managed->array.length; i = js_array_next(value, i + 1)) {
+            struct js_value element = js_array_get(value, i);
+            _image_write_u64(image, i);
+            if (!_image_write_value(image, &element)) {
+                return false;
+            }
+            count++;
+        }
+        memcpy(image->base + count_offset, &count, sizeof(count));
+        return true;
+    case vt_object:
+        return _image_write_map(image, managed->object.base, managed->object.length, managed->object.capacity);
+    case vt_function:
+        _image_write_u32(image, managed->function.ingress);
+        return _image_write_map(image, managed->function.closure.base, managed->function.closure.length, managed->function.closure.capacity);
+    default: // hashmap, hashset
+        _image_write_u64(image, managed->hashmap.length);
+        buffer_for_each(managed->hashmap.base, managed->hashmap.capacity, _, i, v, {
+            (void)i;
+            if (v->key.type != vt_undefined && v->value.type != vt_undefined) {
+                if (!_image_write_value(image, &(v->key)) || !_image_write_value(image, &(v->value))) {
+                    return false;
+                }
+            }
+        });
+        return true;
+    }
+}
+
+// global is skipped if it is declared by host, as c function with same name or as host's own state such as argv stdout
+static bool _image_is_native(struct js_variable_map *natives, const char *name, uint32_t name_length, struct js_value *value) {
+    struct js_value native = js_map_get(natives->base, natives->length, natives->capacity, name, name_length);
+    if (native.type == vt_c_function) {
+        return value->type == vt_c_function && value->c_function == native.c_function;
+    }
+    return native.type >= vt_string;
+}
+
+struct js_result js_image_save(struct js_vm *vm, struct js_variable_map *natives, const char *fname) {
+    // temporary tables are in heap, no garbage collection happens here
+    struct _image image = {.ids = js_hashmap(&(vm->heap)), .names = js_hashmap(&(vm->heap))};
+    struct js_result result = {.success = true, .value = js_null()};
+    js_map_for_each(natives->base, natives->length, natives->capacity, k, kl, v, {
+        (void)kl;
+        if (v->type == vt_c_function && js_hashmap_get(&(image.names), *v).type == vt_null) {
+            js_hashmap_put(&(image.names), *v, js_scripture_sz(k));
+        }
+    });
+    js_map_for_each(vm->globals.base, vm->globals.length, vm->globals.capacity, k, kl, v, {
+        if (!_image_is_native(natives, k, kl, v) && !_image_discover(&image, v)) {
+            result.success = false;
+            result.value = js_string_f(&(vm->heap), "Global \"%.*s\" contains c value such as file, coroutine or worker handle", (int)kl, k);
+            break;
+        }
+    });
+    if (result.success) {
+        _image_write(&image, _image_magic, strlen(_image_magic));
+        _image_write_string(&image, (const char *)vm->bytecode.base, vm->bytecode.length);
+        _image_write_u64(&image, image.leaves.length);
+        buffer_for_each(image.leaves.base, image.leaves.length, image.leaves.capacity, i, v, {
+            (void)i;
+            _image_write_u8(&image, v->type);
+            if (v->type == vt_string) {
+                _image_write_string(&image, v->managed->string.base, v->managed->string.length);
+            } else {
+                _image_write_u8(&image, v->managed->typed_array.kind);
+                _image_write_string(&image, v->managed->typed_array.base, v->managed->typed_array.length * (v->managed->typed_array.kind == ta_float64 ? sizeof(double) : sizeof(int32_t)));
+            }
+        });
+        _image_write_u64(&image, image.containers.length);
+        buffer_for_each(image.containers.base, image.containers.length, image.containers.capacity, i, v, {
+            (void)i;
+            _image_write_u8(&image, v->type);
+        });
+        buffer_for_each(image.containers.base, image.containers.length, image.containers.capacity, i, v, {
+            (void)i;
+            if (!_image_write_container(&image, v)) {
+                result.success = false;
+                result.value = js_scripture_sz("C function not declared by host");
+                break;
+            }
+        });
+    }
+    if (result.success) {
+        size_t count_offset = image.length;
+        uint64_t count = 0;
+        _image_write_u64(&image, 0);
+        js_map_for_each(vm->globals.base, vm->globals.length, vm->globals.capacity, k, kl, v, {
+            if (!_image_is_native(natives, k, kl, v)) {
+                _image_write_string(&image, k, kl);
+                if (!_image_write_value(&image, v)) {
+                    result.success = false;
+                    result.value = js_string_f(&(vm->heap), "Global \"%.*s\" is c function not declared by host", (int)kl, k);
+                    break;
+                }
+                count++;
+            }
+        });
+        memcpy(image.base + count_offset, &count, sizeof(count));
+    }
+    if (result.success) {
+        write_file(fname, "wb", image.base, image.length, image.capacity);
+    }
+    buffer_free(image.base, image.length, image.capacity);
+    buffer_free(image.leaves.base, image.leaves.length, image.leaves.capacity);
+    buffer_free(image.containers.base, image.containers.length, image.containers.capacity);
+    return result;
+}
+
+struct _image_reader {
+    const char *base;
+    size_t length;
+    size_t offset;
+    struct js_vm *vm;
+    struct js_value *leaves;
+    struct js_value *containers;
+    uint64_t num_leaves;
+    uint64_t num_containers;
+};
+
+static bool _image_read(struct _image_reader *reader, void *dst, size_t length) {
+    if (length > reader->length - reader->offset) {
+        return false;
+    }
+    memcpy(dst, reader->base + reader->offset, length);
+    reader->offset += length;
+    return true;
+}
+
+// points into image, length is checked
+static const char *_image_read_string(struct _image_reader *reader, size_t *length) {
+    uint64_t u64;
+    if (!_image_read(reader, &u64, sizeof(u64)) || u64 > reader->length - reader->offset) {
+        return NULL;
+    }
+    const char *ret = reader->base + reader->offset;
+    reader->offset += u64;
+    *length = (size_t)u64;
+    return ret;
+}
+
+static bool _image_read_value(struct _image_reader *reader, struct js_value *value) {
+    uint8_t type;
+    uint64_t index;
+    const char *s;
+    size_t length;
+    if (!_image_read(reader, &type, sizeof(type))) {
+        return false;
+    }
+    *value = (struct js_value){.type = type};
+    switch (type) {
+    case vt_undefined:
+    case vt_null:
+        return true;
+    case vt_boolean:
+        return _image_read(reader, &(value->boolean), sizeof(uint8_t));
+    case vt_number:
+        return _image_read(reader, &(value->number), sizeof(double));
+    case vt_scripture: // c string literal of saving process, now managed
+        if ((s = _image_read_string(reader, &length)) == NULL) {
+            return false;
+        }
+        *value = js_string(&(reader->vm->heap), s, length);
+        return true;
+    case vt_c_function:
+        if ((s = _image_read_string(reader, &length)) == NULL) {
+            return false;
+        }
+        *value = js_map_get(reader->vm->globals.base, reader->vm->globals.length, reader->vm->globals.capacity, s, (uint32_t)length);
+        return value->type == vt_c_function;
+    case vt_string:
+    case vt_typed_array:
+        if (!_image_read(reader, &index, sizeof(index)) || index >= reader->num_leaves) {
+            return false;
+        }
+        *value = reader->leaves[index];
+        return value->type == type;
+    default:
+        if (!_image_read(reader, &index, sizeof(index)) || index >= reader->num_containers) {
+            return false;
+        }
+        *value = reader->containers[index];
+        return value->type == type;
+    }
+}
+
+static bool _image_read_map(struct _image_reader *reader, struct js_value *object, struct js_variable_map *closure) {
+    uint64_t count;
+    if (!_image_read(reader, &count, sizeof(count))) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        size_t kl;
+        const char *k = _image_read_string(reader, &kl);
+        struct js_value v;
+        if (k == NULL || !_image_read_value(reader, &v)) {
+            return false;
+        }
+        if (object) {
+            js_object_put(object, k, (uint32_t)kl, v);
+        } else {
+            js_map_put(closure->base, closure->length, closure->capacity, k, (uint32_t)kl, v);
+        }
+    }
+    return true;
+}
+
+static bool _image_read_container(struct _image_reader *reader, struct js_value *value) {
+    struct js_managed_value *managed = value->managed;
+    uint8_t kind;
+    uint64_t length, count, index;
+    struct js_value key, element;
+    switch (value->type) {
+    case vt_array:
+        if (!_image_read(reader, &kind, sizeof(kind)) || !_image_read(reader, &length, sizeof(length))) {
+            return false;
+        }
+        if (kind == ak_number) {
+            if (length > (reader->length - reader->offset) / sizeof(double)) {
+                return false;
+            }
+            for (uint64_t i = 0; i < length; i++) {
+                double number;
+                _image_read(reader, &number, sizeof(number));
+                js_array_push(value, js_number(number));
+            }
+            return true;
+        }
+        if (!_image_read(reader, &count, sizeof(count))) {
+            return false;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            if (!_image_read(reader, &index, sizeof(index)) || index >= length || !_image_read_value(reader, &element)) {
+                return false;
+            }
+            js_array_put(value, (size_t)index, element);
+        }
+        // trailing holes, putting null beyond end is ignored
+        if (length > managed->array.length) {
+            js_array_put(value, (size_t)length - 1, js_boolean(false));
+            js_array_put(value, (size_t)length - 1, js_null());
+        }
+        return true;
+    case vt_object:
+        return _image_read_map(reader, value, NULL);
+    case vt_function:
+        return _image_read(reader, &(managed->function.ingress), sizeof(uint32_t)) && _image_read_map(reader, NULL, &(managed->function.closure));
+    default: // hashmap, hashset
+        if (!_image_read(reader, &count, sizeof(count))) {
+            return false;
+        }
+        for (uint64_t i = 0; i < count; i++) {
+            if (!_image_read_value(reader, &key) || !_image_read_value(reader, &element)) {
+                return false;
+            }
+            js_hashmap_put(value, key, element);
+        }
+        return true;
+    }
+}
+
+static bool _image_restore(struct _image_reader *reader) {
+    struct js_vm *vm = reader->vm;
+    struct js_heap *heap = &(vm->heap);
+    char magic[sizeof(_image_magic) - 1];
+    const char *s;
+    size_t length;
+    if (!_image_read(reader, magic, sizeof(magic)) || memcmp(magic, _image_magic, sizeof(magic)) != 0) {
+        return false;
+    }
+    if ((s = _image_read_string(reader, &length)) == NULL || length > UINT32_MAX) {
+        return false;
+    }
+    buffer_alloc(vm->bytecode.base, vm->bytecode.length, vm->bytecode.capacity, (uint32_t)length);
+    if (length > 0) {
+        memcpy(vm->bytecode.base, s, length);
+    }
+    vm->bytecode.length = (uint32_t)length;
+    // continue after prelude, so that newly compiled code is appended
+    vm->pc = vm->bytecode.length;
+    if (!_image_read(reader, &(reader->num_leaves), sizeof(uint64_t)) || reader->num_leaves > reader->length - reader->offset) {
+        return false;
+    }
+    reader->leaves = alloc(struct js_value, reader->num_leaves);
+    for (uint64_t i = 0; i < reader->num_leaves; i++) {
+        uint8_t type, kind;
+        if (!_image_read(reader, &type, sizeof(type))) {
+            return false;
+        }
+        if (type == vt_string) {
+            if ((s = _image_read_string(reader, &length)) == NULL) {
+                return false;
+            }
+            reader->leaves[i] = js_string(heap, s, length);
+        } else if (type == vt_typed_array && _image_read(reader, &kind, sizeof(kind)) && (s = _image_read_string(reader, &length)) != NULL) {
+            size_t element_size = kind == ta_float64 ? sizeof(double) : sizeof(int32_t);
+            reader->leaves[i] = js_typed_array(heap, kind, length / element_size);
+            memcpy(reader->leaves[i].managed->typed_array.base, s, length / element_size * element_size);
+        } else {
+            return false;
+        }
+    }
+    if (!_image_read(reader, &(reader->num_containers), sizeof(uint64_t)) || reader->num_containers > reader->length - reader->offset) {
+        return false;
+    }
+    reader->containers = alloc(struct js_value, reader->num_containers);
+    for (uint64_t i = 0; i < reader->num_containers; i++) {
+        uint8_t type = vt_undefined;
+        _image_read(reader, &type, sizeof(type));
+        switch (type) {
+        case vt_array:
+            reader->containers[i] = js_array(heap);
+            break;
+        case vt_object:
+            reader->containers[i] = js_object(heap);
+            break;
+        case vt_function:
+            reader->containers[i] = js_function(heap, 0);
+            break;
+        case vt_hashmap:
+            reader->containers[i] = js_hashmap(heap);
+            break;
+        case vt_hashset:
+            reader->containers[i] = js_hashset(heap);
+            break;
+        default:
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < reader->num_containers; i++) {
+        if (!_image_read_container(reader, reader->containers + i)) {
+            return false;
+        }
+    }
+    // c functions are resolved by names declared by host, so globals are put after all
+    uint64_t count;
+    if (!_image_read(reader, &count, sizeof(count))) {
+        return false;
+    }
+    struct js_kv_pair *globals = alloc(struct js_kv_pair, count < reader->length ? count : 0);
+    bool ret = count < reader->length;
+    for (uint64_t i = 0; ret && i < count; i++) {
+        globals[i].key.base = (char *)_image_read_string(reader, &length);
+        globals[i].key.length = (uint32_t)length;
+        ret = globals[i].key.base != NULL && _image_read_value(reader, &(globals[i].value));
+    }
+    for (uint64_t i = 0; ret && i < count; i++) {
+        js_map_put(vm->globals.base, vm->globals.length, vm->globals.capacity, globals[i].key.base, globals[i].key.length, globals[i].value);
+    }
+    free(globals);
+    return ret;
+}
+
+struct js_result js_image_load(struct js_vm *vm, const char *fname) {
+    enforce(vm->program == NULL && vm->bytecode.base == NULL);
+    size_t length = 0;
+    char *base = file_map(fname, &length);
+    if (base == NULL) {
+        js_throw(js_scripture_sz("Cannot map image file"));
+    }
+    struct _image_reader reader = {.base = base, .length = length, .vm = vm};
+    bool restored = _image_restore(&reader);
+    free(reader.leaves);
+    free(reader.containers);
+    file_unmap(base, length);
+    if (!restored) {
+        js_throw(js_scripture_sz("Invalid image, or it needs c functions not declared by host"));
+    }
+    js_return(js_null());
 }
 
 #ifdef DEBUG
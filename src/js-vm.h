@@ -129,13 +129,12 @@ struct js_stack_frame {
                     // if function, read ingress and closure from *function
                     // if c_function, only use arguments. egress and *function won't be filled
                     // due to arguments support spread syntax, number of them cannot be determined at compile time, so hard to put into stack
-                    // TODO: what if number of rest arguments exceeds UINT16MAX?
                     struct js_managed_value *function;
                     struct {
                         struct js_value *base;
-                        uint16_t length;
-                        uint16_t capacity;
-                        uint16_t index; // for parameter's getter operations
+                        uint32_t length;
+                        uint32_t capacity;
+                        uint32_t index; // for parameter's getter operations
                     } arguments;
                 };
             };
@@ -144,13 +143,36 @@ struct js_stack_frame {
 };
 #pragma pack(pop)
 
-// DON'T seperate bytecode and cross_reference outside this structure, because exception handling need these informations
+// frames are in reserved address space and never move while growing, so frame pointers are always valid
+// limit can be preset before first push, or default value is used
+#pragma pack(push, 1)
+struct js_stack {
+    struct js_stack_frame *base;
+    uint32_t length;
+    uint32_t capacity; // committed
+    uint32_t limit; // reserved
+};
+#pragma pack(pop)
+
+struct js_coroutine; // opaque, see js-vm.c
+
+// compiled program shared by many vms, even on different threads, vm never modifies bytecode, all mutable states are in vm
 #pragma pack(push, 1)
+struct js_program {
+    struct js_bytecode bytecode;
+    struct js_cross_reference cross_reference;
+    volatile long references;
+};
+#pragma pack(pop)
+
+// DON'T seperate bytecode and cross_reference outside this structure, because exception handling need these informations
+// not packed, so that 'interrupted' is naturally aligned for atomic access
 struct js_vm {
     struct js_bytecode bytecode;
     struct js_cross_reference cross_reference;
     struct js_heap heap;
     struct js_variable_map globals; // global variables, moved from stk_root
+    struct js_variable_map internals; // states of c modules such as event loop, invisible to script, marked by gc
     // struct {
     //     struct js_call_stack_frame *base;
     //     uint16_t length;
@@ -161,12 +183,24 @@ struct js_vm {
     //     uint16_t length;
     //     uint16_t capacity;
     // } eval_stack;
-    struct {
-        struct js_stack_frame *base;
-        uint16_t length;
-        uint16_t capacity;
-    } stack;
+    struct js_stack stack;
     uint32_t pc; // program counter, next instruction offset
+    // resource budgets for embedding, checked at backward jumps and calls, 0 means unlimited
+    uint32_t nesting; // js_run() reentrance depth by js_call(), only outermost js_run() can yield
+    uint32_t step_limit; // number of backward jumps and calls before js_run() yields
+    uint32_t steps;
+    size_t heap_limit; // number of managed values, exceeding it triggers gc, then throws if still exceeding
+    volatile long interrupted; // set by js_interrupt(), DON'T access directly
+    struct js_coroutine *coroutine; // running one, NULL if none, see js_resume()
+    struct js_program *program; // if not NULL, bytecode and cross_reference are borrowed from it, DON'T compile into them
+    bool pooled; // thread pool is acquired by js_use_pool(), released by js_free_vm()
+};
+
+// same function called repeatedly by c function, such as callbacks of map() filter() sort(), frames are pushed only once
+#pragma pack(push, 1)
+struct js_prepared_call {
+    struct js_value function;
+    uint32_t stack_length; // before prepared
 };
 #pragma pack(pop)
 
@@ -175,25 +209,48 @@ shared void js_add_instruction(struct js_bytecode *, uint8_t, uint8_t, ...);
 shared void js_add_cross_reference(struct js_cross_reference *, uint32_t, uint32_t);
 shared void js_bytecode_dump(struct js_bytecode *);
 shared struct js_result js_vm_dump(struct js_vm *);
-shared struct js_result js_declare_variable(struct js_vm *, const char *, uint16_t, struct js_value);
+shared struct js_result js_declare_variable(struct js_vm *, const char *, uint32_t, struct js_value);
 shared struct js_result js_declare_variable_sz(struct js_vm *, const char *, struct js_value);
-shared struct js_result js_delete_variable(struct js_vm *, const char *, uint16_t);
+shared struct js_result js_delete_variable(struct js_vm *, const char *, uint32_t);
 shared struct js_result js_delete_variable_sz(struct js_vm *, const char *);
-shared struct js_result js_put_variable(struct js_vm *, const char *, uint16_t, struct js_value);
+shared struct js_result js_put_variable(struct js_vm *, const char *, uint32_t, struct js_value);
 shared struct js_result js_put_variable_sz(struct js_vm *, const char *, struct js_value);
-shared struct js_result js_get_variable(struct js_vm *, const char *, uint16_t);
+shared struct js_result js_get_variable(struct js_vm *, const char *, uint32_t);
 shared struct js_result js_get_variable_sz(struct js_vm *, const char *);
+shared void js_put_internal_sz(struct js_vm *, const char *, struct js_value);
+shared struct js_value js_get_internal_sz(struct js_vm *, const char *); // vt_undefined if not found
 shared struct js_value *js_get_arguments_base(struct js_vm *);
-shared uint16_t js_get_arguments_length(struct js_vm *);
-shared struct js_value js_get_argument(struct js_vm *, uint16_t);
+shared uint32_t js_get_arguments_length(struct js_vm *);
+shared struct js_value js_get_argument(struct js_vm *, uint32_t);
 shared struct js_result js_run(struct js_vm *);
+// js_run() returns success with vt_undefined when step limit is reached or interrupted, all states are kept in vm, call js_run() again to resume
+#define js_is_yielded(__arg_result) ((__arg_result).success && (__arg_result).value.type == vt_undefined)
+shared void js_interrupt(struct js_vm *); // async signal safe, can also be called from another thread
 shared struct js_result js_collect_garbage(struct js_vm *);
-shared struct js_result js_call(struct js_vm *, struct js_value, struct js_value *, uint16_t);
-shared struct js_result js_call_by_name(struct js_vm *, const char *, uint16_t, struct js_value *, uint16_t);
-shared struct js_result js_call_by_name_sz(struct js_vm *, const char *, struct js_value *, uint16_t);
+shared struct js_result js_call(struct js_vm *, struct js_value, struct js_value *, uint32_t);
+shared struct js_result js_call_by_name(struct js_vm *, const char *, uint32_t, struct js_value *, uint32_t);
+shared struct js_result js_call_by_name_sz(struct js_vm *, const char *, struct js_value *, uint32_t);
+shared struct js_result js_call_prepare(struct js_vm *, struct js_prepared_call *, struct js_value, struct js_value); // last value is kept alive until released, such as result being built
+shared struct js_result js_call_prepared(struct js_vm *, struct js_prepared_call *, struct js_value *, uint32_t);
+shared void js_call_release(struct js_vm *, struct js_prepared_call *);
+shared struct js_value js_coroutine(struct js_vm *, struct js_value); // suspended call of script function, started by first resume
+shared bool js_is_coroutine(struct js_value *);
+shared const char *js_coroutine_status(struct js_value *); // "suspended", "running" or "dead"
+shared struct js_result js_resume(struct js_vm *, struct js_value, struct js_value); // value is argument of first run or result of yield, returns yielded or returned value
+shared struct js_result js_yield(struct js_vm *, struct js_value); // only from script function running directly in coroutine
 typedef struct js_result (*js_c_function_pointer_type)(struct js_vm *);
 shared struct js_value js_c_function(js_c_function_pointer_type); // move from js-data to clarify function type
 shared void js_free_vm(struct js_vm *);
+shared void js_use_pool(struct js_vm *); // call before pool_submit() pool_parallel_for() in c function, so that pool threads are kept until vm is freed
+shared struct js_program *js_program_new(struct js_bytecode *, struct js_cross_reference *); // takes over buffers and leaves them empty, with 1 reference
+shared void js_program_retain(struct js_program *);
+shared void js_program_release(struct js_program *); // freed when last reference is released
+shared void js_load_program(struct js_vm *, struct js_program *); // vm must have no bytecode, holds 1 reference until js_free_vm()
+// image of initialized vm, contains bytecode, and globals with all values reachable from them, including functions and their closures
+// c functions are saved by names in given variable map, usually globals of a vm with only host's declarations, and globals declared same as it are not saved
+shared struct js_result js_image_save(struct js_vm *, struct js_variable_map *, const char *);
+// vm must have no bytecode, declare host's c functions first, by whose names c functions in image are resolved, then globals of image are put over them, and newly compiled code is appended after image's bytecode
+shared struct js_result js_image_load(struct js_vm *, const char *);
 
 #ifdef DEBUG
 
@@ -0,0 +1,683 @@
+/*
+Copyright 2024-2025 ShaJunXing <shajunxing@hotmail.com>
+
+This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h> // offsetof
+#include <sys/stat.h>
+#ifndef _WIN32
+    #include <poll.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+    #ifdef __linux__
+        #include <sys/eventfd.h>
+    #endif
+#endif
+#include "js-loop.h"
+#include "js-std.h"
+#include "js-syntax.h"
+#include "js-worker.h"
+
+// compiled programs by file name, so that workers spawned from same file share one copy of bytecode
+#define _programs_internal "programs"
+// handles waiting in event loop, keyed by eventfd, so that dispatcher can find them and garbage collector won't sweep them
+#define _receivers_internal "receivers"
+// messages handled by one dispatch, rest are left to next round, so that timers and other watchers won't starve
+#define _dispatch_batch 1024
+
+struct _message {
+    struct _message *volatile next;
+    size_t length;
+    char data[]; // js_serialize() output
+};
+
+#define _message_header offsetof(struct _message, data)
+
+// single producer single consumer, unbounded and lock free, consumer only parks on condition when it is empty
+// head is a dummy node that was already consumed, so producer and consumer never touch same pointer
+struct _queue {
+    struct _message *head; // owned by consumer
+    struct _message *tail; // owned by producer
+    volatile long waiting; // consumer is parked
+    volatile long closed; // producer will never push again
+    volatile long fd; // eventfd for event loop, -1 if not created yet
+    void *mutex;
+    void *condition;
+};
+
+struct _channel {
+    struct _queue inbox; // parent to worker
+    struct _queue outbox; // worker to parent
+    volatile long references; // parent handle and worker thread
+    char *fname;
+    struct js_program *program; // 1 reference, passed to worker vm
+};
+
+struct _handle {
+    struct _channel *channel;
+    bool parent; // held by parent, or 'parent' variable of worker
+    bool hung_up;
+    struct js_value callback; // see onmessage()
+};
+
+static void _queue_init(struct _queue *queue) {
+    queue->head = queue->tail = (struct _message *)alloc(char, _message_header);
+    queue->fd = -1;
+    queue->mutex = mutex_new();
+    queue->condition = condition_new();
+}
+
+static void _queue_free(struct _queue *queue) {
+    for (struct _message *message = queue->head, *next; message; message = next) {
+        next = message->next;
+        free(message);
+    }
+#ifndef _WIN32
+    if (queue->fd != -1) {
+        close((int)queue->fd);
+    }
+#endif
+    mutex_free(queue->mutex);
+    condition_free(queue->condition);
+}
+
+static void _queue_notify(struct _queue *queue) {
+    // pairs with fence in _queue_wait(), either producer sees waiting, or consumer sees new message
+    atomic_fence();
+    if (atomic_load_long(&(queue->waiting))) {
+        mutex_lock(queue->mutex);
+        condition_broadcast(queue->condition);
+        mutex_unlock(queue->mutex);
+    }
+#ifdef __linux__
+    long fd = atomic_load_long(&(queue->fd));
+    if (fd != -1) {
+        eventfd_write((int)fd, 1);
+    }
+#endif
+}
+
+static void _queue_push(struct _queue *queue, struct _message *message) {
+    message->next = NULL;
+    atomic_store_pointer((void *volatile *)&(queue->tail->next), message);
+    queue->tail = message;
+    _queue_notify(queue);
+}
+
+static void _queue_close(struct _queue *queue) {
+    atomic_store_long(&(queue->closed), 1);
+    _queue_notify(queue);
+}
+
+// NULL if empty, returned message is valid until next pop
+static struct _message *_queue_pop(struct _queue *queue) {
+    struct _message *next = atomic_load_pointer((void *volatile *)&(queue->head->next));
+    if (next == NULL) {
+        return NULL;
+    }
+    free(queue->head);
+    queue->head = next;
+    return next;
+}
+
+// NULL if closed and empty
+static struct _message *_queue_pop_closed(struct _queue *queue, bool *closed) {
+    struct _message *message = _queue_pop(queue);
+    // closed is stored after last push, so pop again after seeing it
+    *closed = message == NULL && atomic_load_long(&(queue->closed));
+    if (*closed) {
+        message = _queue_pop(queue);
+        *closed = message == NULL;
+    }
+    return message;
+}
+
+// blocks until there is message, NULL if closed and empty
+static struct _message *_queue_wait(struct _queue *queue) {
+    for (;;) {
+        bool closed;
+        struct _message *message = _queue_pop_closed(queue, &closed);
+        if (message || closed) {
+            return message;
+        }
+        mutex_lock(queue->mutex);
+        atomic_store_long(&(queue->waiting), 1);
+        atomic_fence();
+        if (atomic_load_pointer((void *volatile *)&(queue->head->next)) == NULL && !atomic_load_long(&(queue->closed))) {
+            condition_wait(queue->condition, queue->mutex);
+        }
+        atomic_store_long(&(queue->waiting), 0);
+        mutex_unlock(queue->mutex);
+    }
+}
+
+static void _channel_release(struct _channel *channel) {
+    if (atomic_add_long(&(channel->references), -1) == 0) {
+        if (channel->program) {
+            // worker never started
+            js_program_release(channel->program);
+        }
+        _queue_free(&(channel->inbox));
+        _queue_free(&(channel->outbox));
+        free(channel->fname);
+        free(channel);
+    }
+}
+
+// queue this side sends to
+static struct _queue *_sending(struct _handle *handle) {
+    return handle->parent ? &(handle->channel->inbox) : &(handle->channel->outbox);
+}
+
+// queue this side receives from
+static struct _queue *_receiving(struct _handle *handle) {
+    return handle->parent ? &(handle->channel->outbox) : &(handle->channel->inbox);
+}
+
+static void _handle_mark(void *data) {
+    struct _handle *handle = (struct _handle *)data;
+    js_mark(&(handle->callback));
+}
+
+static void _handle_sweep(void *data) {
+    struct _handle *handle = (struct _handle *)data;
+    // worker thread closes its side by itself after vm is freed
+    if (handle->parent) {
+        _queue_close(_sending(handle));
+        _channel_release(handle->channel);
+    }
+    free(handle);
+}
+
+static struct js_value _handle_new(struct js_vm *vm, struct _channel *channel, bool parent) {
+    struct _handle *handle = alloc(struct _handle, 1);
+    handle->channel = channel;
+    handle->parent = parent;
+    handle->callback = js_null();
+    return js_c_value(&(vm->heap), handle, _handle_mark, _handle_sweep);
+}
+
+#define _handle_argument(__arg_vm, __arg_nargs, __arg_argbase, __arg_handle) \
+    uint32_t __arg_nargs = js_get_arguments_length(__arg_vm); \
+    struct js_value *__arg_argbase = js_get_arguments_base(__arg_vm); \
+    js_assert(__arg_nargs >= 1); \
+    js_assert(__arg_argbase->type == vt_c_value && __arg_argbase->managed->c_value.mark == _handle_mark); \
+    struct _handle *__arg_handle = (struct _handle *)__arg_argbase->managed->c_value.data
+
+static struct js_value _message_value(struct js_vm *vm, struct _message *message) {
+    return message ? js_deserialize(&(vm->heap), message->data, message->length) : js_null();
+}
+
+static void *_worker_main(void *argument) {
+    struct _channel *channel = (struct _channel *)argument;
+    struct js_vm vm = {0};
+    js_declare_std_functions(&vm, 1, &(channel->fname));
+    js_declare_loop_functions(&vm);
+    js_declare_worker_functions(&vm);
+    js_declare_variable_sz(&vm, "parent", _handle_new(&vm, channel, false));
+    js_load_program(&vm, channel->program);
+    js_program_release(channel->program);
+    channel->program = NULL;
+    struct js_result result = js_run(&vm);
+    if (result.success) {
+        result = js_loop_run(&vm);
+    }
+    if (!result.success) {
+        printf("Worker Runtime Error: ");
+        js_value_print(&(result.value));
+        printf("\n");
+    }
+    js_free_vm(&vm);
+    _queue_close(&(channel->outbox));
+    _channel_release(channel);
+    return NULL;
+}
+
+struct _program {
+    struct js_program *program;
+    time_t mtime; // recompiled if file is modified
+};
+
+static void _program_sweep(void *data) {
+    struct _program *program = (struct _program *)data;
+    js_program_release(program->program);
+    free(program);
+}
+
+// tables are kept in vm internals, so that script can't touch them, created on first use
+static struct js_value _internal_of(struct js_vm *vm, const char *name, struct js_value (*create)(struct js_heap *)) {
+    struct js_value table = js_get_internal_sz(vm, name);
+    if (table.type == vt_undefined) {
+        table = create(&(vm->heap));
+        js_put_internal_sz(vm, name, table);
+    }
+    return table;
+}
+
+// compiles source (*.js) or loads bytecode file, or gets cached one, error message is put in value if failed
+static bool _program_of(struct js_vm *vm, const char *fname, size_t fname_length, struct js_program **program, struct js_value *error) {
+    struct stat st;
+    if (stat(fname, &st) != 0) {
+        *error = js_string_f(&(vm->heap), "Cannot open \"%s\": %s", fname, strerror(errno));
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        *error = js_string_f(&(vm->heap), "\"%s\" is not a regular file", fname);
+        return false;
+    }
+    struct js_value programs = _internal_of(vm, _programs_internal, js_object);
+    struct js_value cached = js_object_get(&programs, fname, (uint32_t)fname_length);
+    if (cached.type == vt_c_value && ((struct _program *)cached.managed->c_value.data)->mtime == st.st_mtime) {
+        *program = ((struct _program *)cached.managed->c_value.data)->program;
+        return true;
+    }
+    struct js_bytecode bytecode = {0};
+    struct js_cross_reference cross_reference = {0};
+    bool read;
+    if (string_ends_with_sz(fname, ".js")) {
+        struct js_source source = {0};
+        struct js_token token = {0};
+        try_read_file(fname, source.base, source.length, source.capacity, read);
+        bool compiled = read && js_compile(&source, &token, &bytecode, &cross_reference);
+        buffer_free(source.base, source.length, source.capacity);
+        if (!compiled) {
+            buffer_free(bytecode.base, bytecode.length, bytecode.capacity);
+            buffer_free(cross_reference.base, cross_reference.length, cross_reference.capacity);
+            *error = read ? js_string_f(&(vm->heap), "Cannot compile \"%s\"", fname) : js_string_f(&(vm->heap), "Cannot open \"%s\": %s", fname, strerror(errno));
+            return false;
+        }
+    } else {
+        try_read_file(fname, bytecode.base, bytecode.length, bytecode.capacity, read);
+        if (!read) {
+            buffer_free(bytecode.base, bytecode.length, bytecode.capacity);
+            *error = js_string_f(&(vm->heap), "Cannot open \"%s\": %s", fname, strerror(errno));
+            return false;
+        }
+    }
+    struct _program *data = alloc(struct _program, 1);
+    data->program = js_program_new(&bytecode, &cross_reference);
+    data->mtime = st.st_mtime;
+    // replaced one is released by garbage collector, running workers still hold their references
+    js_object_put(&programs, fname, (uint32_t)fname_length, js_c_value(&(vm->heap), data, NULL, _program_sweep));
+    *program = data->program;
+    return true;
+}
+
+// hangup(handle), no more messages will be posted from this side, peer receives null after consuming rest
+struct js_result js_worker_hangup(struct js_vm *vm) {
+    _handle_argument(vm, nargs, argbase, handle);
+    js_assert(nargs == 1);
+    if (!handle->hung_up) {
+        handle->hung_up = true;
+        _queue_close(_sending(handle));
+    }
+    js_return(js_null());
+}
+
+#ifdef __linux__
+static struct js_value _receivers(struct js_vm *vm) {
+    return _internal_of(vm, _receivers_internal, js_hashmap);
+}
+
+static struct js_result _dispatch(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1 && argbase->type == vt_number);
+    struct js_value receivers = _receivers(vm);
+    struct js_value hv = js_hashmap_get(&receivers, argbase[0]);
+    if (hv.type != vt_c_value) {
+        js_return(js_null());
+    }
+    struct _handle *handle = (struct _handle *)hv.managed->c_value.data;
+    struct _queue *queue = _receiving(handle);
+    // reset counter before draining, so that message pushed meanwhile wakes loop again
+    eventfd_t count;
+    eventfd_read((int)queue->fd, &count);
+    for (size_t i = 0; i < _dispatch_batch; i++) {
+        bool closed;
+        struct _message *message = _queue_pop_closed(queue, &closed);
+        if (closed) {
+            js_hashmap_put(&receivers, argbase[0], js_null());
+            struct js_result result = js_call(vm, js_c_function(js_loop_unwatch), argbase, 1);
+            if (!result.success) {
+                return result;
+            }
+            return js_call(vm, handle->callback, (struct js_value[]){js_null()}, 1);
+        } else if (message == NULL) {
+            js_return(js_null());
+        }
+        struct js_result result = js_call(vm, handle->callback, (struct js_value[]){_message_value(vm, message)}, 1);
+        if (!result.success) {
+            return result;
+        }
+    }
+    eventfd_write((int)queue->fd, 1);
+    js_return(js_null());
+}
+#endif
+
+// onmessage(handle, callback), callback(message) is called in event loop for every message, and finally callback(null) when peer hangs up
+struct js_result js_worker_onmessage(struct js_vm *vm) {
+#ifdef __linux__
+    _handle_argument(vm, nargs, argbase, handle);
+    js_assert(nargs == 2);
+    js_assert(js_is_function(argbase + 1));
+    handle->callback = argbase[1];
+    struct _queue *queue = _receiving(handle);
+    if (queue->fd == -1) {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd == -1) {
+            js_throw(js_string_sz(&(vm->heap), (const char *)strerror(errno)));
+        }
+        atomic_store_long(&(queue->fd), fd);
+        struct js_value receivers = _receivers(vm);
+        js_hashmap_put(&receivers, js_number(fd), argbase[0]);
+        struct js_result result = js_call(vm, js_c_function(js_loop_watch), (struct js_value[]){js_number(fd), js_c_function(_dispatch)}, 2);
+        if (!result.success) {
+            return result;
+        }
+        // messages posted before fd is visible to producer
+        eventfd_write(fd, 1);
+    }
+    js_return(js_null());
+#else
+    js_throw(js_scripture_sz("Receiving messages in event loop requires epoll"));
+#endif
+}
+
+#ifndef _WIN32
+// result record in pipe: payload length (u64), status, js_serialize() payload
+enum _record_status { rs_value, rs_error };
+    #define _record_header (sizeof(uint64_t) + 1)
+    #define _pipe_chunk 65536
+
+static bool _write_all(int fd, const char *base, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, base, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+        base += n;
+        length -= n;
+    }
+    return true;
+}
+
+// false if value can't be serialized, buffer is unchanged then
+static bool _append_record(char **base, size_t *length, size_t *capacity, enum _record_status status, struct js_value *value) {
+    size_t start = *length;
+    char header[_record_header] = {0};
+    header[sizeof(uint64_t)] = (char)status;
+    string_buffer_append(*base, *length, *capacity, header, _record_header);
+    if (!js_serialize(value, base, length, capacity)) {
+        *length = start;
+        return false;
+    }
+    uint64_t payload = *length - start - _record_header;
+    memcpy(*base + start, &payload, sizeof(uint64_t));
+    return true;
+}
+
+// runs in child process, never returns
+static void _map_shard(struct js_vm *vm, struct js_value *array, struct js_value fn, size_t begin, size_t end, int fd) {
+    char *base = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    struct js_prepared_call prepared;
+    struct js_result result = js_call_prepare(vm, &prepared, fn, js_null());
+    for (size_t i = begin; result.success && i < end; i++) {
+        result = js_call_prepared(vm, &prepared, (struct js_value[]){js_array_get(array, i), js_number((double)i)}, 2);
+        if (result.success && !_append_record(&base, &length, &capacity, rs_value, &(result.value))) {
+            result = (struct js_result){.success = false, .value = js_scripture_sz("Result of parallel_map() must only contain null, boolean, number, string, array, object, typed array, hashmap or hashset")};
+        }
+        if (length >= _pipe_chunk) {
+            if (!_write_all(fd, base, length)) {
+                _exit(EXIT_FAILURE);
+            }
+            length = 0;
+        }
+    }
+    if (!result.success && !_append_record(&base, &length, &capacity, rs_error, &(result.value))) {
+        struct js_value message = js_scripture_sz("Error thrown in parallel_map() can't be passed back");
+        _append_record(&base, &length, &capacity, rs_error, &message);
+    }
+    bool written = _write_all(fd, base, length);
+    fflush(NULL);
+    _exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+struct _shard {
+    pid_t pid;
+    int fd; // -1 after end of pipe
+    char *base; // received records
+    size_t length;
+    size_t capacity;
+};
+
+// reads all pipes at same time, or children block on full pipes
+static bool _read_shards(struct _shard *shards, size_t num_shards) {
+    struct pollfd *fds = alloc(struct pollfd, num_shards);
+    for (;;) {
+        nfds_t nfds = 0;
+        for (size_t i = 0; i < num_shards; i++) {
+            if (shards[i].fd != -1) {
+                fds[nfds++] = (struct pollfd){.fd = shards[i].fd, .events = POLLIN};
+            }
+        }
+        if (nfds == 0) {
+            break;
+        }
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(fds);
+            return false;
+        }
+        for (nfds_t j = 0; j < nfds; j++) {
+            if (fds[j].revents == 0) {
+                continue;
+            }
+            for (size_t i = 0; i < num_shards; i++) {
+                struct _shard *shard = shards + i;
+                if (shard->fd != fds[j].fd) {
+                    continue;
+                }
+                buffer_alloc(shard->base, shard->length, shard->capacity, shard->length + _pipe_chunk);
+                ssize_t n = read(shard->fd, shard->base + shard->length, _pipe_chunk);
+                if (n > 0) {
+                    shard->length += n;
+                } else if (n == 0 || errno != EINTR) {
+                    close(shard->fd);
+                    shard->fd = -1;
+                }
+            }
+        }
+    }
+    free(fds);
+    return true;
+}
+#endif
+
+// parallel_map(array, callback, [nprocs]), same as map(), but array is split into nprocs (default number of processors) shards, each is mapped by callback(element, index) in a forked child process
+// children see whole heap as it was at fork time, copy on write, results are passed back by pipe with js_serialize(), so they must not contain functions
+// unlike map(), holes are passed as null, and side effects of callback are not visible to caller
+struct js_result js_worker_parallel_map(struct js_vm *vm) {
+#ifdef _WIN32
+    js_throw(js_scripture_sz("parallel_map() requires fork"));
+#else
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 2 || nargs == 3);
+    js_assert(argbase->type == vt_array);
+    js_assert(js_is_function(argbase + 1));
+    size_t num_shards = thread_processors();
+    if (nargs == 3) {
+        js_assert(argbase[2].type == vt_number && argbase[2].number >= 1);
+        num_shards = (size_t)argbase[2].number;
+    }
+    size_t length = argbase->managed->array.length;
+    num_shards = min(num_shards, length);
+    struct js_value ret = js_array(&(vm->heap));
+    if (num_shards == 0) {
+        js_return(ret);
+    }
+    struct _shard *shards = alloc(struct _shard, num_shards);
+    // or unflushed output is written by children again
+    fflush(NULL);
+    size_t num_started = 0;
+    for (; num_started < num_shards; num_started++) {
+        int fds[2];
+        if (pipe(fds) != 0) {
+            break;
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            for (size_t i = 0; i < num_started; i++) {
+                close(shards[i].fd);
+            }
+            _map_shard(vm, argbase, argbase[1], length * num_started / num_shards, length * (num_started + 1) / num_shards, fds[1]);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            break;
+        }
+        shards[num_started] = (struct _shard){.pid = pid, .fd = fds[0]};
+    }
+    bool success = num_started == num_shards;
+    if (success) {
+        success = _read_shards(shards, num_shards);
+    }
+    for (size_t i = 0; i < num_started; i++) {
+        if (shards[i].fd != -1) {
+            close(shards[i].fd);
+        }
+        int status;
+        pid_t waited;
+        while ((waited = waitpid(shards[i].pid, &status, 0)) < 0 && errno == EINTR)
+            ;
+        success = success && waited == shards[i].pid && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+    }
+    struct js_result result = {.success = success, .value = ret};
+    if (!success) {
+        result.value = js_scripture_sz("Child process of parallel_map() failed");
+    }
+    // first error in order of shards wins
+    for (size_t i = 0; i < num_started && result.success; i++) {
+        struct _shard *shard = shards + i;
+        size_t count = 0;
+        for (size_t offset = 0; result.success && offset + _record_header <= shard->length;) {
+            uint64_t payload;
+            memcpy(&payload, shard->base + offset, sizeof(uint64_t));
+            enum _record_status status = (enum _record_status)shard->base[offset + sizeof(uint64_t)];
+            offset += _record_header;
+            enforce(offset + payload <= shard->length);
+            struct js_value value = js_deserialize(&(vm->heap), shard->base + offset, (size_t)payload);
+            offset += payload;
+            if (status == rs_value) {
+                js_array_push(&ret, value);
+                count++;
+            } else {
+                result = (struct js_result){.success = false, .value = value};
+            }
+        }
+        if (result.success && count != length * (i + 1) / num_shards - length * i / num_shards) {
+            result = (struct js_result){.success = false, .value = js_scripture_sz("Child process of parallel_map() failed")};
+        }
+    }
+    for (size_t i = 0; i < num_shards; i++) {
+        buffer_free(shards[i].base, shards[i].length, shards[i].capacity);
+    }
+    free(shards);
+    return result;
+#endif
+}
+
+// post(handle, value), value is deep copied, must not contain functions, and must not be null which means hangup to peer
+struct js_result js_worker_post(struct js_vm *vm) {
+    _handle_argument(vm, nargs, argbase, handle);
+    js_assert(nargs == 2);
+    js_assert(argbase[1].type != vt_null);
+    if (handle->hung_up) {
+        js_throw(js_scripture_sz("Cannot post after hangup"));
+    }
+    // serialize right after header, so that buffer itself becomes message
+    char *base = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    buffer_alloc(base, length, capacity, _message_header);
+    length = _message_header;
+    if (!js_serialize(argbase + 1, &base, &length, &capacity)) {
+        free(base);
+        js_throw(js_scripture_sz("Message must only contain null, boolean, number, string, array, object, typed array, hashmap or hashset, without circular reference"));
+    }
+    struct _message *message = (struct _message *)base;
+    message->length = length - _message_header;
+    _queue_push(_sending(handle), message);
+    js_return(js_null());
+}
+
+// receive(handle), blocks until next message, null if peer has hung up and no message left
+struct js_result js_worker_receive(struct js_vm *vm) {
+    _handle_argument(vm, nargs, argbase, handle);
+    js_assert(nargs == 1);
+    js_return(_message_value(vm, _queue_wait(_receiving(handle))));
+}
+
+// spawn(fname), runs source (*.js) or bytecode file in new vm on new thread, which can talk back by variable 'parent', returns handle
+// file is compiled in caller's thread only once, workers of same file share it
+// worker ends after script and its event loop ends, and hangs up automatically
+struct js_result js_worker_spawn(struct js_vm *vm) {
+    uint32_t nargs = js_get_arguments_length(vm);
+    struct js_value *argbase = js_get_arguments_base(vm);
+    js_assert(nargs == 1);
+    js_assert(js_is_string(argbase));
+    char *fname = string_dupe(js_string_base(argbase), js_string_length(argbase));
+    struct js_program *program;
+    struct js_value error;
+    if (!_program_of(vm, fname, js_string_length(argbase), &program, &error)) {
+        free(fname);
+        js_throw(error);
+    }
+    struct _channel *channel = alloc(struct _channel, 1);
+    channel->fname = fname;
+    channel->program = program;
+    js_program_retain(program);
+    _queue_init(&(channel->inbox));
+    _queue_init(&(channel->outbox));
+    channel->references = 2;
+    // create handle first, so that channel is released by garbage collector if failed
+    struct js_value ret = _handle_new(vm, channel, true);
+    void *thread = thread_start(_worker_main, channel);
+    if (thread == NULL) {
+        channel->references = 1;
+        js_throw(js_scripture_sz("Cannot start worker thread"));
+    }
+    thread_detach(thread);
+    js_return(ret);
+}
+
+#define _function_list \
+    X(hangup) \
+    X(onmessage) \
+    X(parallel_map) \
+    X(post) \
+    X(receive) \
+    X(spawn)
+
+void js_declare_worker_functions(struct js_vm *vm) {
+#define X(name) js_declare_variable_sz(vm, #name, js_c_function(js_worker_##name));
+    do {
+        _function_list
+    } while (0);
+#undef X
+}
@@ -0,0 +1,24 @@
+/*
+Copyright 2024-2025 ShaJunXing <shajunxing@hotmail.com>
+
+This program is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef JS_WORKER_H
+#define JS_WORKER_H
+
+#include "js-vm.h"
+
+shared struct js_result js_worker_hangup(struct js_vm *);
+shared struct js_result js_worker_onmessage(struct js_vm *);
+shared struct js_result js_worker_parallel_map(struct js_vm *);
+shared struct js_result js_worker_post(struct js_vm *);
+shared struct js_result js_worker_receive(struct js_vm *);
+shared struct js_result js_worker_spawn(struct js_vm *);
+shared void js_declare_worker_functions(struct js_vm *); // worker vm also has std and loop functions
+
+#endif
\ No newline at end of file
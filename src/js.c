@@ -8,13 +8,24 @@ This program is distributed in the hope that it will be useful, but WITHOUT ANY
 You should have received a copy of the GNU General Public License along with this program. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <limits.h> // INT_MAX
+#include <math.h> // ceil
 #include <time.h>
 #ifndef _WIN32
     #include <readline/readline.h>
     #include <readline/history.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
 #endif
 #include "js-syntax.h"
+#include "js-loop.h"
 #include "js-std.h"
+#include "js-worker.h"
 
 static char *_make_filename(char *source_filename, const char *ext, char *binary_filename) {
     if (binary_filename) {
@@ -49,6 +60,8 @@ static int _repl(int argc, char *argv[]) {
     struct js_token token = {0};
     struct js_vm vm = {0};
     js_declare_std_functions(&vm, argc, argv);
+    js_declare_loop_functions(&vm);
+    js_declare_worker_functions(&vm);
 #ifndef _WIN32
     // disable filename completion
     rl_bind_key('\t', rl_insert);
@@ -118,6 +131,14 @@ static int _repl(int argc, char *argv[]) {
                         js_value_print(&(result.value));
                         printf("\n");
                         rollback = true;
+                    } else {
+                        // line is already done, so no rollback if callback fails
+                        result = js_loop_run(&vm);
+                        if (!result.success) {
+                            printf("Runtime Error: ");
+                            js_value_print(&(result.value));
+                            printf("\n");
+                        }
                     }
                 } else {
                     rollback = true;
@@ -157,6 +178,20 @@ static int _help(char *arg_0) {
     printf("  -b, --binary <filename>  bytecode binary filename\n");
     printf("  -s, --source <filenames> one or more source filenames\n");
     printf("  -x, --xref <filename>    cross reference filename\n");
+    printf("  --snapshot-in <filename> restore vm image before loading source files\n");
+    printf("  --snapshot-out <filename>\n");
+    printf("                           run source files as prelude, and save vm image\n");
+    printf("                           instead of running event loop\n");
+    printf("\n");
+    printf("Server options, must be first:\n");
+    printf("  --serve <socket>         keep warm vm and compiled scripts, run requests\n");
+    printf("                           in forked processes\n");
+    printf("  --connect <socket> <filename> [arguments]\n");
+    printf("                           run source or bytecode file by server\n");
+    printf("\n");
+    printf("Other options:\n");
+    printf("  -j, --jobs <number>      threads of native thread pool, default is\n");
+    printf("                           JS_THREADS environment variable or processors\n");
     printf("\n");
     printf("Relationship between actions and files:\n");
     printf("  action             file\n");
@@ -172,6 +207,28 @@ static int _help(char *arg_0) {
 
 #ifdef DEBUG
 
+static void test_serve();
+static void test_long_keys();
+static void test_array_share();
+static void test_array_packed();
+static void test_typed_array();
+static void test_bytes();
+static void test_hashmap();
+static void test_array_sparse();
+static void test_array_deque();
+static void test_array_natives();
+static void test_sort();
+static void test_sort_parallel();
+static void test_file();
+static void test_fmap();
+static void test_walk();
+static void test_copy();
+static void test_loop();
+static void test_coroutine();
+static void test_worker();
+static void test_parallel_map();
+static void test_image();
+
     #define test_function_list \
         X(test_random_sz) \
         X(test_random_double) \
@@ -184,6 +241,7 @@ static int _help(char *arg_0) {
         X(test_read_file) \
         X(test_read_line) \
         X(test_natural_compare) \
+        X(test_pool) \
         X(test_data_structure_size) \
         X(test_js_map) \
         X(test_js_map_loop) \
@@ -195,11 +253,35 @@ static int _help(char *arg_0) {
         X(test_vm_structure_size) \
         X(test_instruction_get_put) \
         X(test_vm_run) \
+        X(test_stack_overflow) \
         X(test_lexer) \
         X(test_parser) \
         X(test_c_function) \
         X(test_unescape_string) \
-        X(test_free_vm)
+        X(test_free_vm) \
+        X(test_budget) \
+        X(test_program) \
+        X(test_serve) \
+        X(test_long_keys) \
+        X(test_array_share) \
+        X(test_array_packed) \
+        X(test_typed_array) \
+        X(test_bytes) \
+        X(test_hashmap) \
+        X(test_array_sparse) \
+        X(test_array_deque) \
+        X(test_array_natives) \
+        X(test_sort) \
+        X(test_sort_parallel) \
+        X(test_file) \
+        X(test_fmap) \
+        X(test_walk) \
+        X(test_copy) \
+        X(test_loop) \
+        X(test_coroutine) \
+        X(test_worker) \
+        X(test_parallel_map) \
+        X(test_image)
 
     #define X(name) #name,
 static const char *test_function_names[] = {test_function_list};
@@ -238,6 +320,1072 @@ static int _test(char *arg_0, int argc, char *argv[]) {
 
 #endif
 
+// runs script, then event loop, exit code is decided by script's return value
+static int _run(struct js_vm *vm) {
+    struct js_result result = js_run(vm);
+    if (result.success) {
+        // timers and watchers set by script, exit code is still decided by script
+        struct js_result loop_result = js_loop_run(vm);
+        if (!loop_result.success) {
+            result = loop_result;
+        }
+    }
+    if (result.success) {
+        switch (result.value.type) {
+        case vt_number:
+            return (int)result.value.number;
+            break;
+        case vt_boolean:
+            return result.value.boolean ? EXIT_SUCCESS : EXIT_FAILURE;
+            break;
+        default:
+            return EXIT_SUCCESS;
+            break;
+        }
+    } else {
+        printf("Runtime Error: ");
+        js_value_print(&(result.value));
+        return EXIT_FAILURE;
+    }
+}
+
+#ifndef _WIN32
+
+// client sends one request with its stdin stdout stderr attached by SCM_RIGHTS, server forks a child for each, which uses them directly, then sends back exit code
+// request is length (u32) followed by zero terminated strings, first is working directory, then arguments, same as command line
+    #define _request_max 1048576
+    // milliseconds, whole request must arrive in time, so that idle client won't block others
+    #define _request_timeout 3000
+
+struct _cached_program {
+    char *path;
+    struct timespec mtime;
+    off_t size;
+    struct js_program *program;
+};
+
+static bool _write_all(int fd, const char *base, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, base, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+        base += n;
+        length -= n;
+    }
+    return true;
+}
+
+static double _monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// deadline is _monotonic_ms(), 0 means forever
+static bool _wait_readable(int fd, double deadline) {
+    for (;;) {
+        int timeout = -1;
+        if (deadline > 0) {
+            double remaining = ceil(deadline - _monotonic_ms());
+            if (remaining <= 0) {
+                return false;
+            }
+            timeout = remaining < INT_MAX ? (int)remaining : INT_MAX;
+        }
+        int n = poll(&(struct pollfd){.fd = fd, .events = POLLIN}, 1, timeout);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        return n > 0;
+    }
+}
+
+static bool _read_all(int fd, char *base, size_t length, double deadline) {
+    while (length > 0) {
+        ssize_t n = _wait_readable(fd, deadline) ? read(fd, base, length) : 0;
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            return false;
+        }
+        base += n;
+        length -= n;
+    }
+    return true;
+}
+
+// returns request, NULL if failed or not complete before deadline, fds are -1 if not received
+static char *_receive_request(int conn, double deadline, int fds[3], uint32_t *length) {
+    fds[0] = fds[1] = fds[2] = -1;
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * 3)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {.iov_base = length, .iov_len = sizeof(uint32_t)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof(control.buf)};
+    // fds come with first byte, length is sent by one sendmsg(), so it is never split
+    ssize_t n = _wait_readable(conn, deadline) ? recvmsg(conn, &msg, MSG_DONTWAIT) : -1;
+    // fds are taken even if length is incomplete, so that caller closes them
+    for (struct cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL; cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len == CMSG_LEN(sizeof(int) * 3)) {
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * 3);
+        }
+    }
+    if (n != sizeof(uint32_t) || fds[0] == -1 || *length == 0 || *length > _request_max) {
+        return NULL;
+    }
+    char *request = alloc(char, *length + 1);
+    if (!_read_all(conn, request, *length, deadline)) {
+        free(request);
+        return NULL;
+    }
+    return request;
+}
+
+// compiled in server process, so that forked children share it, recompiled if file is modified
+static struct js_program *_serve_program(struct _cached_program **cache, size_t *cache_length, size_t *cache_capacity, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        printf("Cannot open \"%s\": %s\n", path, strerror(errno));
+        return NULL;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        printf("\"%s\" is not a regular file\n", path);
+        return NULL;
+    }
+    struct _cached_program *cached = NULL;
+    for (size_t i = 0; i < *cache_length; i++) {
+        if (strcmp((*cache)[i].path, path) == 0) {
+            cached = *cache + i;
+            break;
+        }
+    }
+    // nanoseconds, script may be modified within one second
+    if (cached && cached->mtime.tv_sec == st.st_mtim.tv_sec && cached->mtime.tv_nsec == st.st_mtim.tv_nsec && cached->size == st.st_size) {
+        return cached->program;
+    }
+    struct js_bytecode bytecode = {0};
+    struct js_cross_reference cross_reference = {0};
+    // request must never bring server down, so read non-fatally
+    bool read;
+    if (string_ends_with_sz(path, ".js")) {
+        struct js_source source = {0};
+        struct js_token token = {0};
+        try_read_file(path, source.base, source.length, source.capacity, read);
+        bool compiled = read && js_compile(&source, &token, &bytecode, &cross_reference);
+        buffer_free(source.base, source.length, source.capacity);
+        if (!compiled) {
+            buffer_free(bytecode.base, bytecode.length, bytecode.capacity);
+            buffer_free(cross_reference.base, cross_reference.length, cross_reference.capacity);
+            if (!read) {
+                printf("Cannot open \"%s\": %s\n", path, strerror(errno));
+            }
+            return NULL;
+        }
+    } else {
+        try_read_file(path, bytecode.base, bytecode.length, bytecode.capacity, read);
+        if (!read) {
+            buffer_free(bytecode.base, bytecode.length, bytecode.capacity);
+            printf("Cannot open \"%s\": %s\n", path, strerror(errno));
+            return NULL;
+        }
+    }
+    if (cached == NULL) {
+        buffer_push(*cache, *cache_length, *cache_capacity, ((struct _cached_program){.path = string_dupe_sz(path)}));
+        cached = *cache + *cache_length - 1;
+    } else {
+        js_program_release(cached->program);
+    }
+    cached->mtime = st.st_mtim;
+    cached->size = st.st_size;
+    cached->program = js_program_new(&bytecode, &cross_reference);
+    return cached->program;
+}
+
+// child process, never returns
+static void _serve_child(struct js_vm *vm, struct js_program *program, int conn, char **args, size_t num_args) {
+    struct js_value arg_vector = js_array(&(vm->heap));
+    for (size_t i = 0; i < num_args; i++) {
+        js_array_push(&arg_vector, js_scripture_sz(args[i]));
+    }
+    js_declare_variable_sz(vm, "argv", arg_vector);
+    // each child needs its own epoll instance
+    js_declare_loop_functions(vm);
+    js_load_program(vm, program);
+    int32_t code = _run(vm);
+    fflush(NULL);
+    _write_all(conn, (const char *)&code, sizeof(code));
+    _exit(EXIT_SUCCESS);
+}
+
+// accepted connections wait for requests together, so that idle client won't block others
+struct _pending {
+    int conn;
+    double deadline;
+};
+
+struct _server {
+    int sock;
+    struct js_vm vm; // warm vm, forked for every request, loop functions are declared in child
+    struct {
+        struct _cached_program *base;
+        size_t length;
+        size_t capacity;
+    } cache;
+    struct {
+        struct _pending *base;
+        size_t length;
+        size_t capacity;
+    } pending;
+};
+
+// connection is readable, request must never bring server down
+static void _serve_request(struct _server *server, int conn, double deadline) {
+    int fds[3];
+    uint32_t length;
+    char *request = _receive_request(conn, deadline, fds, &length);
+    struct {
+        char **base;
+        size_t length;
+        size_t capacity;
+    } args = {0};
+    if (request) {
+        for (uint32_t offset = 0; offset < length; offset += (uint32_t)strlen(request + offset) + 1) {
+            buffer_push(args.base, args.length, args.capacity, request + offset);
+        }
+    }
+    // working directory, program name, script
+    if (args.length >= 3) {
+        char *path = args.base[2][0] == '/' ? string_dupe_sz(args.base[2]) : string_concat_sz(args.base[0], "/", args.base[2]);
+        // compiling errors go to client
+        fflush(NULL);
+        int saved_fds[] = {dup(STDOUT_FILENO), dup(STDERR_FILENO)};
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[2], STDERR_FILENO);
+        struct js_program *program = _serve_program(&(server->cache.base), &(server->cache.length), &(server->cache.capacity), path);
+        fflush(NULL);
+        for (int i = 0; i < 2; i++) {
+            dup2(saved_fds[i], i + 1);
+            close(saved_fds[i]);
+        }
+        free(path);
+        if (program == NULL) {
+            int32_t code = EXIT_FAILURE;
+            _write_all(conn, (const char *)&code, sizeof(code));
+        } else if (fork() == 0) {
+            // script runs same as without server
+            signal(SIGCHLD, SIG_DFL);
+            signal(SIGPIPE, SIG_DFL);
+            close(server->sock);
+            for (size_t i = 0; i < server->pending.length; i++) {
+                close(server->pending.base[i].conn);
+            }
+            for (int i = 0; i < 3; i++) {
+                dup2(fds[i], i);
+                close(fds[i]);
+            }
+            if (chdir(args.base[0]) != 0) {
+                _exit(EXIT_FAILURE);
+            }
+            _serve_child(&(server->vm), program, conn, args.base + 1, args.length - 1);
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (fds[i] != -1) {
+            close(fds[i]);
+        }
+    }
+    close(conn);
+    buffer_free(args.base, args.length, args.capacity);
+    free(request);
+}
+
+static int _serve(const char *socket_path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fatal("Socket path too long: %s", socket_path);
+    }
+    strcpy(addr.sun_path, socket_path);
+    struct _server server = {0};
+    int sock = server.sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socket_path);
+    if (sock == -1 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sock, SOMAXCONN) != 0) {
+        fatal("Cannot listen on %s: %s", socket_path, strerror(errno));
+    }
+    // client may go away before receiving exit code
+    // DON'T ignore SIGCHLD, which is inherited by children, then waitpid() of parallel_map() fails
+    signal(SIGPIPE, SIG_IGN);
+    js_declare_std_functions(&(server.vm), 0, NULL);
+    js_declare_worker_functions(&(server.vm));
+    printf("Serving on %s\n", socket_path);
+    fflush(stdout);
+    for (;;) {
+        // finished requests
+        while (waitpid(-1, NULL, WNOHANG) > 0)
+            ;
+        // listening socket first, then pending connections, until nearest deadline
+        size_t num_polled = server.pending.length;
+        struct pollfd *polled = alloc(struct pollfd, num_polled + 1);
+        polled[0].fd = sock;
+        polled[0].events = POLLIN;
+        double now = _monotonic_ms();
+        int timeout = -1;
+        for (size_t i = 0; i < num_polled; i++) {
+            polled[i + 1].fd = server.pending.base[i].conn;
+            polled[i + 1].events = POLLIN;
+            int remaining = (int)ceil(max(server.pending.base[i].deadline - now, 0));
+            timeout = timeout < 0 || remaining < timeout ? remaining : timeout;
+        }
+        if (poll(polled, num_polled + 1, timeout) < 0) {
+            free(polled);
+            continue;
+        }
+        now = _monotonic_ms();
+        // backward, so that last one moved here is already checked
+        for (size_t i = num_polled; i-- > 0;) {
+            struct _pending pending = server.pending.base[i];
+            if (polled[i + 1].revents == 0 && pending.deadline > now) {
+                continue;
+            }
+            server.pending.base[i] = server.pending.base[--server.pending.length];
+            if (polled[i + 1].revents == 0) {
+                close(pending.conn);
+            } else {
+                _serve_request(&server, pending.conn, pending.deadline);
+            }
+        }
+        if (polled[0].revents & POLLIN) {
+            int conn = accept(sock, NULL, NULL);
+            if (conn != -1) {
+                buffer_push(server.pending.base, server.pending.length, server.pending.capacity, ((struct _pending){.conn = conn, .deadline = now + _request_timeout}));
+            }
+        }
+        free(polled);
+    }
+    return EXIT_SUCCESS;
+}
+
+// thin client, sends arguments after socket path to server, returns exit code of script
+static int _connect(const char *socket_path, char *arg_0, int argc, char *argv[]) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fatal("Socket path too long: %s", socket_path);
+    }
+    strcpy(addr.sun_path, socket_path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fatal("Cannot connect to %s: %s", socket_path, strerror(errno));
+    }
+    struct {
+        char *base;
+        uint32_t length;
+        uint32_t capacity;
+    } request = {0};
+    char *cwd = getcwd(NULL, 0);
+    enforce(cwd != NULL);
+    // including terminating zeros
+    string_buffer_append(request.base, request.length, request.capacity, cwd, strlen(cwd) + 1);
+    string_buffer_append(request.base, request.length, request.capacity, arg_0, strlen(arg_0) + 1);
+    for (int i = 0; i < argc; i++) {
+        string_buffer_append(request.base, request.length, request.capacity, argv[i], strlen(argv[i]) + 1);
+    }
+    free(cwd);
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * 3)];
+        struct cmsghdr align;
+    } control = {0};
+    struct iovec iov = {.iov_base = &(request.length), .iov_len = sizeof(uint32_t)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control.buf, .msg_controllen = sizeof(control.buf)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+    memcpy(CMSG_DATA(cmsg), (int[]){STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO}, sizeof(int) * 3);
+    if (sendmsg(sock, &msg, 0) != sizeof(uint32_t) || !_write_all(sock, request.base, request.length)) {
+        fatal("Cannot send request: %s", strerror(errno));
+    }
+    buffer_free(request.base, request.length, request.capacity);
+    int32_t code;
+    if (!_read_all(sock, (char *)&code, sizeof(code), 0)) {
+        fatal("Server closed connection");
+    }
+    close(sock);
+    return code;
+}
+
+#endif
+
+#ifdef DEBUG
+
+// server in child process, script calls parallel_map(), which forks and waits again inside request process
+static void test_serve() {
+#ifdef _WIN32
+    printf("Server mode requires unix domain socket\n");
+#else
+    char socket_path[64];
+    char script_path[64];
+    snprintf(socket_path, sizeof(socket_path), "/tmp/js-test-serve-%d.sock", (int)getpid());
+    snprintf(script_path, sizeof(script_path), "/tmp/js-test-serve-%d.js", (int)getpid());
+    const char *src = "let r = parallel_map([1, 2, 3, 4, 5], function(x, i) { return x * 10 + i; }, 2); print(r); return r[4] == 54;";
+    write_file(script_path, "w", (char *)src, strlen(src), strlen(src));
+    fflush(NULL);
+    pid_t server = fork();
+    enforce(server != -1);
+    if (server == 0) {
+        _exit(_serve(socket_path));
+    }
+    // wait until listening
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strcpy(addr.sun_path, socket_path);
+    bool ready = false;
+    for (int i = 0; i < 100 && !ready; i++) {
+        int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        ready = connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        close(sock);
+        if (!ready) {
+            usleep(50000);
+        }
+    }
+    // idle client and bad request must not block or kill server
+    int idle = socket(AF_UNIX, SOCK_STREAM, 0);
+    ready = ready && connect(idle, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+    int bad_code = ready ? _connect(socket_path, "js", 1, (char *[]){"/tmp"}) : EXIT_SUCCESS;
+    printf("exit code of directory=%d\n", bad_code);
+    // twice, second one uses cached program
+    int codes[2] = {EXIT_FAILURE, EXIT_FAILURE};
+    for (int i = 0; ready && i < 2; i++) {
+        codes[i] = _connect(socket_path, "js", 1, (char *[]){script_path});
+        printf("exit code=%d\n", codes[i]);
+    }
+    close(idle);
+    // stop server before checking, or it is left running if failed
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(socket_path);
+    unlink(script_path);
+    enforce(ready && bad_code == EXIT_FAILURE && codes[0] == EXIT_SUCCESS && codes[1] == EXIT_SUCCESS);
+#endif
+}
+
+// runs script with all functions declared and event loop, fails if script throws or returns false
+// expect(cond, what) throws 'what' if 'cond' is false, same(a, b) compares elements, throws(f) tells whether f() throws
+// they are prepended at same line, so that line numbers are kept
+static void _test_script(const char *src) {
+    struct js_source source = {0};
+    struct js_token token = {0};
+    struct js_vm vm = {0};
+    string_buffer_append_sz(source.base, source.length, source.capacity, "function expect(cond, what) { if (!cond) { throw what; } } ");
+    string_buffer_append_sz(source.base, source.length, source.capacity, "function same(a, b) { if (length(a) != length(b)) { return false; } for (let i = 0; i < length(a); i++) { if (a[i] != b[i]) { return false; } } return true; } ");
+    string_buffer_append_sz(source.base, source.length, source.capacity, "function throws(f) { try { f(); } catch (e) { return true; } return false; } ");
+    string_buffer_append_sz(source.base, source.length, source.capacity, src);
+    bool compiled = js_compile(&source, &token, &(vm.bytecode), &(vm.cross_reference));
+    buffer_free(source.base, source.length, source.capacity);
+    enforce(compiled);
+    js_declare_std_functions(&vm, 0, NULL);
+    js_declare_loop_functions(&vm);
+    js_declare_worker_functions(&vm);
+    int code = _run(&vm);
+    js_free_vm(&vm);
+    enforce(code == EXIT_SUCCESS);
+}
+
+// keys, variables and arguments beyond 65535
+static void test_long_keys() {
+    _test_script(
+        "function str(n) { let d = [\"0\", \"1\", \"2\", \"3\", \"4\", \"5\", \"6\", \"7\", \"8\", \"9\"]; let s = d[n % 10]; n = (n - n % 10) / 10; while (n > 0) { s = d[n % 10] + s; n = (n - n % 10) / 10; } return s; }\n"
+        "let k = \"k\";\n"
+        "while (length(k) < 70000) { k = k + k; }\n"
+        "let o = {};\n"
+        "o[k] = 1;\n"
+        "expect(o[k] == 1 && length(k) == 131072, \"long key\");\n"
+        "for (let i = 0; i < 70000; i++) { o[str(i)] = i; }\n"
+        "expect(length(o) == 70001 && o[\"69999\"] == 69999, \"many keys\");\n"
+        "let args = [];\n"
+        "for (let i = 0; i < 70000; i++) { push(args, i); }\n"
+        "let count = function(...a) { return length(a); };\n"
+        "expect(count(...args) == 70000, \"many arguments\");\n"
+        "return true;\n");
+}
+
+// spread arrays share storage until either side writes
+static void test_array_share() {
+    _test_script(
+        "let a = [3, 1, 2];\n"
+        "let b = [...a];\n"
+        "let c = [...b];\n"
+        "b[0] = 9;\n"
+        "expect(same(a, [3, 1, 2]) && same(b, [9, 1, 2]) && same(c, [3, 1, 2]), \"put detaches\");\n"
+        "push(c, 4);\n"
+        "expect(same(a, [3, 1, 2]) && same(c, [3, 1, 2, 4]), \"push detaches\");\n"
+        "let d = [...a];\n"
+        "pop(d);\n"
+        "push(a, 7);\n"
+        "expect(same(a, [3, 1, 2, 7]) && same(d, [3, 1]), \"pop shortens own length only\");\n"
+        "let e = [...a];\n"
+        "sort(e);\n"
+        "reverse(a);\n"
+        "expect(same(a, [7, 2, 1, 3]) && same(e, [1, 2, 3, 7]), \"sort and reverse detach\");\n"
+        "let f = [...a];\n"
+        "shift(f);\n"
+        "unshift(a, 0);\n"
+        "splice(f, 1, 1, \"x\");\n"
+        "expect(same(a, [0, 7, 2, 1, 3]) && same(f, [2, \"x\", 3]), \"shift unshift splice detach\");\n"
+        "let g = [...a];\n"
+        "fill(g, 5);\n"
+        "expect(same(a, [0, 7, 2, 1, 3]) && same(g, [5, 5, 5, 5, 5]), \"fill detaches\");\n"
+        "let h = [...[\"s\", null, {k: 1}]];\n"
+        "a = null;\n"
+        "gc();\n"
+        "expect(same(e, [1, 2, 3, 7]) && h[0] == \"s\" && h[1] == null && h[2].k == 1, \"buffer outlives sharer\");\n"
+        "return true;\n");
+}
+
+// numbers, holes and other values mixed, packed storage must be invisible
+static void test_array_packed() {
+    _test_script(
+        "let a = [];\n"
+        "for (let i = 0; i < 1000; i++) { push(a, i * 0.5); }\n"
+        "let s = 0;\n"
+        "for (let x of a) { s += x; }\n"
+        "expect(s == 249750 && a[999] == 499.5 && a[1000] == null, \"packed numbers\");\n"
+        "a[1] = \"one\";\n"
+        "expect(a[1] == \"one\" && a[2] == 1 && length(a) == 1000, \"turns into tagged on string\");\n"
+        "let b = [1, 2, 3];\n"
+        "b[5] = 6;\n"
+        "expect(length(b) == 6 && b[3] == null && b[4] == null && b[5] == 6, \"hole\");\n"
+        "let c = [1, 2];\n"
+        "push(c, true, [3]);\n"
+        "expect(c[2] == true && c[3][0] == 3 && typeof(c) == \"array\", \"mixed\");\n"
+        "let d = [1, 2, 3];\n"
+        "d[1] = null;\n"
+        "expect(d[1] == null && length(d) == 3, \"null is hole\");\n"
+        "let m = map([1, 2, 3], function(x, i) { return x * 2; });\n"
+        "expect(same(m, [2, 4, 6]) && indexof(m, 4) == 1 && includes(m, 6), \"natives on packed\");\n"
+        "return true;\n");
+}
+
+// typed arrays behave like arrays of numbers, kernels cover tails of vectors
+static void test_typed_array() {
+    _test_script(
+        "let f = float64array(4);\n"
+        "expect(same(f, [0, 0, 0, 0]) && typeof(f) == \"array\", \"zero filled\");\n"
+        "let g = float64array([1, 2, 3, 4]);\n"
+        "expect(vsum(g) == 10 && vdot(g, g) == 30 && vmin(g) == 1 && vmax(g) == 4, \"reductions\");\n"
+        "vcopy(f, g);\n"
+        "vscale(f, 2);\n"
+        "vadd(f, g);\n"
+        "expect(same(f, [3, 6, 9, 12]) && same(g, [1, 2, 3, 4]), \"in place kernels\");\n"
+        "expect(same(vfill(float64array(3), 7), [7, 7, 7]), \"fill returns first\");\n"
+        "let big = float64array(1001);\n"
+        "vfill(big, 0.5);\n"
+        "expect(vsum(big) == 500.5, \"tail of vector kernels\");\n"
+        "let i = int32array([2147483647, -1]);\n"
+        "i[0] = i[0] + 1;\n"
+        "expect(i[0] == -2147483648 && i[1] == -1, \"int32 wraps\");\n"
+        "expect(g[4] == null && throws(function() { g[4] = 1; }) && throws(function() { g[0] = \"x\"; }), \"range and type\");\n"
+        "let s = 0;\n"
+        "for (let x of g) { s += x; }\n"
+        "expect(s == 10 && same([...g], [1, 2, 3, 4]) && same(float64array(int32array([5, 6])), [5, 6]), \"iteration, spread and copy\");\n"
+        "return true;\n");
+}
+
+// byte buffers, endianness, views and file io
+static void test_bytes() {
+    _test_script(
+        "let b = bytes(16);\n"
+        "bytesput(b, 0, \"u32le\", 305419896);\n"
+        "expect(bytesget(b, 0, \"u8\") == 120 && bytesget(b, 3, \"u8\") == 18 && bytesget(b, 0, \"u32be\") == 2018915346, \"endianness\");\n"
+        "bytesput(b, 4, \"f64be\", -1.5);\n"
+        "expect(bytesget(b, 4, \"f64be\") == -1.5 && bytesget(b, 12, \"i32le\") == 0, \"float\");\n"
+        "bytesput(b, 12, \"i16le\", -2);\n"
+        "expect(bytesget(b, 12, \"u16le\") == 65534 && bytesget(b, 12, \"i16le\") == -2, \"signed\");\n"
+        "let v = byteslice(b, 12, 14);\n"
+        "bytesput(v, 0, \"u8\", 7);\n"
+        "expect(length(v) == 2 && bytesget(b, 12, \"u8\") == 7, \"view shares memory\");\n"
+        "expect(throws(function() { bytesget(v, 1, \"u16le\"); }) && throws(function() { bytesget(b, 0, \"u16\"); }), \"bounds and type\");\n"
+        "let s = bytes(\"héllo\");\n"
+        "expect(length(s) == 6 && bytestring(byteslice(s, 1, 3)) == \"é\", \"utf-8\");\n"
+        "b = null;\n"
+        "gc();\n"
+        "expect(bytesget(v, 0, \"u8\") == 7, \"view keeps buffer\");\n"
+        "let fname = \"/tmp/js-test-bytes.bin\";\n"
+        "byteswrite(s, fname);\n"
+        "let r = bytesread(fname);\n"
+        "remove(fname);\n"
+        "expect(bytestring(r) == \"héllo\" && bytestring(bytes(r)) == \"héllo\", \"file io and copy\");\n"
+        "return true;\n");
+}
+
+// keys of hashmap and hashset are compared by value for numbers and strings, by identity for others
+static void test_hashmap() {
+    _test_script(
+        "let m = hashmap();\n"
+        "let key = [1];\n"
+        "set(m, 1, \"number\");\n"
+        "set(m, \"1\", \"string\");\n"
+        "set(m, key, \"array\");\n"
+        "set(m, 0, \"zero\");\n"
+        "expect(get(m, 1) == \"number\" && get(m, \"1\") == \"string\" && get(m, key) == \"array\" && get(m, [1]) == null, \"keys by value or identity\");\n"
+        "expect(get(m, -0) == \"zero\" && length(m) == 4, \"zero\");\n"
+        "set(m, 0 / 0, \"nan\");\n"
+        "expect(get(m, 0 / 0) == \"nan\" && m[1] == \"number\", \"nan and subscript\");\n"
+        "set(m, 1, null);\n"
+        "expect(!has(m, 1) && length(m) == 4, \"null deletes\");\n"
+        "for (let i = 0; i < 10000; i++) { set(m, i + 0.5, i); }\n"
+        "for (let i = 0; i < 10000; i = i + 2) { erase(m, i + 0.5); }\n"
+        "expect(length(m) == 5004 && get(m, 9999.5) == 9999 && get(m, 9998.5) == null, \"rehash and erase\");\n"
+        "let s = hashset(1, 2, 2, \"2\");\n"
+        "add(s, 3, 1);\n"
+        "expect(length(s) == 4 && has(s, \"2\") && has(s, 3) && !has(s, 4) && typeof(s) == \"object\", \"set\");\n"
+        "let n = 0;\n"
+        "for (let x of s) { n += 1; }\n"
+        "expect(n == 4, \"iteration\");\n"
+        "return true;\n");
+}
+
+// far index won't allocate whole range, and iteration visits existing elements only
+static void test_array_sparse() {
+    _test_script(
+        "let a = [1, 2];\n"
+        "a[10000000] = 3;\n"
+        "expect(length(a) == 10000001 && a[1] == 2 && a[5000] == null && a[10000000] == 3, \"sparse write\");\n"
+        "let n = 0;\n"
+        "for (let x of a) { n += 1; }\n"
+        "let s = 0;\n"
+        "foreach(a, function(x, i) { s += i; });\n"
+        "expect(n == 3 && s == 10000001, \"iteration skips holes\");\n"
+        "push(a, 4);\n"
+        "expect(a[10000001] == 4 && pop(a) == 4 && length(a) == 10000001, \"push and pop\");\n"
+        "let b = [];\n"
+        "b[2000] = 1;\n"
+        "for (let i = 0; i < 2000; i++) { b[i] = i; }\n"
+        "expect(length(b) == 2001 && b[1999] == 1999 && b[2000] == 1, \"dense again when filled\");\n"
+        "let c = [...a];\n"
+        "c[0] = 9;\n"
+        "expect(a[0] == 1 && c[0] == 9 && c[10000000] == 3, \"spread copy\");\n"
+        "let d = [];\n"
+        "d[100000] = \"x\";\n"
+        "unshift(d, \"y\");\n"
+        "expect(d[0] == \"y\" && d[100001] == \"x\" && length(d) == 100002, \"unshift\");\n"
+        "return true;\n");
+}
+
+// shift, unshift and splice at front keep order, same as push and pop at tail
+static void test_array_deque() {
+    _test_script(
+        "let q = [];\n"
+        "for (let i = 0; i < 100000; i++) { push(q, i); }\n"
+        "let s = 0;\n"
+        "for (let i = 0; i < 50000; i++) { s += shift(q); }\n"
+        "expect(s == 1249975000 && length(q) == 50000 && q[0] == 50000, \"shift\");\n"
+        "for (let i = 0; i < 50000; i++) { unshift(q, i); }\n"
+        "expect(length(q) == 100000 && q[0] == 49999 && q[49999] == 0 && q[50000] == 50000, \"unshift\");\n"
+        "expect(unshift(q, \"a\", \"b\") == 100002 && q[0] == \"a\" && q[1] == \"b\" && q[2] == 49999, \"unshift several, returns length\");\n"
+        "let a = [1, 2, 3, 4, 5];\n"
+        "let r = splice(a, 1, 2, \"x\", \"y\", \"z\");\n"
+        "expect(same(r, [2, 3]) && same(a, [1, \"x\", \"y\", \"z\", 4, 5]), \"splice\");\n"
+        "expect(same(splice(a, 0, 1), [1]) && same(a, [\"x\", \"y\", \"z\", 4, 5]), \"splice at front\");\n"
+        "expect(same(splice(a, 5, 0, 6), []) && same(a, [\"x\", \"y\", \"z\", 4, 5, 6]), \"splice at end\");\n"
+        "let e = [];\n"
+        "expect(throws(function() { shift(e); }) && length(e) == 0, \"shift empty throws same as pop\");\n"
+        "return true;\n");
+}
+
+// callbacks of array natives, nested and throwing
+static void test_array_natives() {
+    _test_script(
+        "let a = [1, 2, 3, 4];\n"
+        "expect(same(map(a, function(x, i) { return x * 10 + i; }), [10, 21, 32, 43]), \"map\");\n"
+        "expect(same(filter(a, function(x) { return x % 2 == 0; }), [2, 4]), \"filter\");\n"
+        "expect(reduce(a, function(acc, x) { return acc + x; }) == 10 && reduce(a, function(acc, x) { return acc + x; }, 5) == 15, \"reduce\");\n"
+        "expect(find(a, function(x) { return x > 2; }) == 3 && find(a, function(x) { return x > 9; }) == null, \"find\");\n"
+        "let h = [1];\n"
+        "h[3] = 4;\n"
+        "let visited = [];\n"
+        "foreach(h, function(x, i) { push(visited, i); });\n"
+        "expect(same(visited, [0, 3]), \"holes skipped\");\n"
+        "let nested = map([1, 2], function(x) { return reduce(map([1, 2, 3], function(y) { return x * y; }), function(s, y) { return s + y; }); });\n"
+        "expect(same(nested, [6, 12]), \"nested callbacks\");\n"
+        "expect(throws(function() { map(a, function(x) { throw \"boom\"; }); }) && throws(function() { filter(a, function(x) { return 1; }); }), \"errors propagate\");\n"
+        "let total = 0;\n"
+        "for (let round = 0; round < 1000; round++) { foreach(a, function(x) { total += x; }); }\n"
+        "expect(total == 10000, \"frames reused\");\n"
+        "return true;\n");
+}
+
+// stable with comparator, errors of comparator leave array unchanged
+static void test_sort() {
+    _test_script(
+        "let recs = [];\n"
+        "for (let i = 0; i < 200; i++) { push(recs, {k: i % 7, i: i}); }\n"
+        "sort(recs, function(a, b) { return a.k - b.k; });\n"
+        "let stable = true;\n"
+        "for (let i = 1; i < 200; i++) { stable = stable && (recs[i - 1].k < recs[i].k || (recs[i - 1].k == recs[i].k && recs[i - 1].i < recs[i].i)); }\n"
+        "expect(stable, \"stable\");\n"
+        "let calls = 0;\n"
+        "let n = [3, null, 1, null, 2];\n"
+        "sort(n, function(a, b) { calls += 1; expect(a != null && b != null, \"null compared\"); return a - b; });\n"
+        "expect(same(n, [1, 2, 3, null, null]) && calls > 0, \"nulls last\");\n"
+        "let f = [0.3, 0.1, 0.2];\n"
+        "sort(f, function(a, b) { return a - b; });\n"
+        "expect(same(f, [0.1, 0.2, 0.3]), \"sign of fraction\");\n"
+        "let u = [5, 4, 3, 2, 1];\n"
+        "expect(throws(function() { sort(u, function(a, b) { if (a == 2 || b == 2) { throw \"stop\"; } return a - b; }); }) && same(u, [5, 4, 3, 2, 1]), \"throwing comparator keeps array\");\n"
+        "expect(throws(function() { sort(u, function(a, b) { return \"x\"; }); }) && same(u, [5, 4, 3, 2, 1]), \"non number result keeps array\");\n"
+        "let nums = [3, -1, 0.5, -2.5, 1e300, -1e300, 0];\n"
+        "sort(nums);\n"
+        "expect(same(nums, [-1e300, -2.5, -1, 0, 0.5, 3, 1e300]), \"radix sort of doubles\");\n"
+        "let strs = [\"b\", \"ab\", \"a\", \"\", \"ba\"];\n"
+        "sort(strs);\n"
+        "expect(same(strs, [\"\", \"a\", \"ab\", \"b\", \"ba\"]), \"strings by bytes\");\n"
+        "expect(throws(function() { sort([1, \"a\"]); }), \"mixed without comparator\");\n"
+        "return true;\n");
+}
+
+// large arrays are sorted in chunks by pool, then merged, threads are configured so that chunks are used even on single processor
+static void test_sort_parallel() {
+    pool_configure(4);
+    _test_script(
+        "let n = [];\n"
+        "let seed = 1;\n"
+        "for (let i = 0; i < 200000; i++) { seed = (seed * 1103515245 + 12345) % 2147483648; push(n, seed % 1000 - 500.5); }\n"
+        "let total = reduce(n, function(s, x) { return s + x; });\n"
+        "sort(n);\n"
+        "let ordered = true;\n"
+        "for (let i = 1; i < 200000; i++) { ordered = ordered && n[i - 1] <= n[i]; }\n"
+        "expect(ordered && reduce(n, function(s, x) { return s + x; }) == total, \"numbers\");\n"
+        "let words = [\"delta\", \"alpha\", \"charlie\", \"bravo\", \"echo\", \"alphabet\", \"al\"];\n"
+        "let s = [];\n"
+        "for (let i = 0; i < 100000; i++) { push(s, words[i % 7]); }\n"
+        "sort(s);\n"
+        "ordered = true;\n"
+        "for (let i = 1; i < 100000; i++) { ordered = ordered && s[i - 1] <= s[i]; }\n"
+        "expect(ordered && s[0] == \"al\" && s[99999] == \"echo\" && s[14284] == \"al\" && s[14285] == \"alpha\", \"strings\");\n"
+        "return true;\n");
+    pool_configure(0);
+}
+
+// file handles read, readline, write, append and errors
+static void test_file() {
+    _test_script(
+        "let fname = \"/tmp/js-test-file.txt\";\n"
+        "let f = open(fname, \"w\");\n"
+        "write(f, \"line 1\\n\", \"line 2\\r\\n\", bytes(\"tail\"));\n"
+        "close(f);\n"
+        "f = open(fname);\n"
+        "expect(readline(f) == \"line 1\" && readline(f) == \"line 2\\r\" && readline(f) == \"tail\" && readline(f) == null, \"readline excludes only newline\");\n"
+        "close(f);\n"
+        "f = open(fname, \"rb\");\n"
+        "expect(read(f, 4) == \"line\" && read(f) == \" 1\\nline 2\\r\\ntail\" && read(f) == null, \"read\");\n"
+        "close(f);\n"
+        "f = open(fname, \"a\");\n"
+        "write(f, \"!\");\n"
+        "flush(f);\n"
+        "expect(fread(fname) == \"line 1\\nline 2\\r\\ntail!\", \"append and flush\");\n"
+        "f = null;\n"
+        "gc();\n"
+        "expect(throws(function() { open(\"/tmp/js-test-no-such-dir/x\"); }) && throws(function() { open(fname, \"bad mode\"); }), \"open errors\");\n"
+        "f = open(fname);\n"
+        "close(f);\n"
+        "expect(throws(function() { read(f); }), \"closed handle\");\n"
+        "remove(fname);\n"
+        "return true;\n");
+}
+
+// mapped file is ordinary string for script, and is unmapped by gc
+static void test_fmap() {
+    _test_script(
+        "let fname = \"/tmp/js-test-fmap.txt\";\n"
+        "let f = open(fname, \"w\");\n"
+        "let line = \"0123456789abcdef\";\n"
+        "for (let i = 0; i < 1000; i++) { write(f, line); }\n"
+        "close(f);\n"
+        "let m = fmap(fname);\n"
+        "expect(length(m) == 16000 && startswith(m, \"0123\") && endswith(m, \"cdef\") && m == fread(fname), \"mapped string\");\n"
+        "let parts = split(m, \"f\");\n"
+        "expect(length(parts) == 1001 && parts[999] == \"0123456789abcde\" && parts[1000] == \"\", \"string functions\");\n"
+        "expect(m + \"!\" == fread(fname) + \"!\", \"concatenation\");\n"
+        "m = null;\n"
+        "parts = null;\n"
+        "gc();\n"
+        "let e = open(fname, \"w\");\n"
+        "close(e);\n"
+        "expect(fmap(fname) == \"\", \"empty falls back\");\n"
+        "remove(fname);\n"
+        "expect(throws(function() { fmap(fname); }), \"missing file\");\n"
+        "return true;\n");
+}
+
+// tree with symbolic link loop, which must not be followed
+static void test_walk() {
+#ifdef _WIN32
+    printf("Symbolic links require posix\n");
+#else
+    // script can't create symbolic links
+    enforce(mkdir("/tmp/js-test-walk", 0755) == 0 && symlink("/tmp/js-test-walk", "/tmp/js-test-walk/loop") == 0);
+    _test_script(
+        "let root = \"/tmp/js-test-walk\";\n"
+        "mkdir(root + \"/sub\");\n"
+        "mkdir(root + \"/sub/deep\");\n"
+        "foreach([\"/a.txt\", \"/b.js\", \"/sub/c.txt\", \"/sub/deep/d.js\"], function(name) { let f = open(root + name, \"w\"); write(f, name); close(f); });\n"
+        "let r = walk(root);\n"
+        "sort(r, function(a, b) { return a.path < b.path ? -1 : 1; });\n"
+        "let types = map(r, function(e) { return e.type; });\n"
+        "expect(same(map(r, function(e) { return e.path; }), [root + \"/a.txt\", root + \"/b.js\", root + \"/loop\", root + \"/sub\", root + \"/sub/c.txt\", root + \"/sub/deep\", root + \"/sub/deep/d.js\"]), \"paths\");\n"
+        "expect(same(types, [\"file\", \"file\", \"link\", \"dir\", \"file\", \"dir\", \"file\"]) && r[0].size == 6 && r[0].mtime > 0, \"types, link not followed\");\n"
+        "expect(length(walk(root, {ext: \"js\"})) == 2 && length(walk(root, {ext: [\".txt\", \"js\"]})) == 4 && length(walk(root, {glob: \"[ab].*\"})) == 2, \"filters\");\n"
+        "let batches = 0;\n"
+        "expect(walk(root, {batch: 1, threads: 2}, function(b) { batches += length(b); return true; }) == null && batches == 7, \"callback\");\n"
+        "batches = 0;\n"
+        "walk(root, {batch: 1}, function(b) { batches += 1; return false; });\n"
+        "expect(batches == 1, \"stopped by callback\");\n"
+        "expect(throws(function() { walk(root + \"/none\"); }), \"missing root\");\n"
+        "foreach([\"/a.txt\", \"/b.js\", \"/sub/c.txt\", \"/sub/deep/d.js\", \"/loop\"], function(name) { remove(root + name); });\n"
+        "rmdir(root + \"/sub/deep\");\n"
+        "rmdir(root + \"/sub\");\n"
+        "rmdir(root);\n"
+        "return true;\n");
+#endif
+}
+
+// binary copy, copy to itself, copytree and move
+static void test_copy() {
+    _test_script(
+        "let root = \"/tmp/js-test-copy\";\n"
+        "foreach([\"\", \"/src\", \"/src/sub\"], function(d) { mkdir(root + d); });\n"
+        "let data = bytes(300000);\n"
+        "for (let i = 0; i < 300000; i = i + 997) { bytesput(data, i, \"u8\", i % 251); }\n"
+        "byteswrite(data, root + \"/src/big.bin\");\n"
+        "let f = open(root + \"/src/sub/small.txt\", \"w\");\n"
+        "write(f, \"small\");\n"
+        "close(f);\n"
+        "copy(root + \"/src/big.bin\", root + \"/copy.bin\");\n"
+        "let c = bytesread(root + \"/copy.bin\");\n"
+        "expect(length(c) == 300000 && bytesget(c, 997 * 3, \"u8\") == 997 * 3 % 251 && bytestring(c) == bytestring(data), \"binary copy\");\n"
+        "expect(throws(function() { copy(root + \"/copy.bin\", root + \"/copy.bin\"); }) && length(bytesread(root + \"/copy.bin\")) == 300000, \"copy to itself keeps content\");\n"
+        "expect(throws(function() { copy(root + \"/none\", root + \"/x\"); }) && !exists(root + \"/x\"), \"missing source\");\n"
+        "copytree(root + \"/src\", root + \"/tree\");\n"
+        "expect(fread(root + \"/tree/sub/small.txt\") == \"small\" && length(bytesread(root + \"/tree/big.bin\")) == 300000, \"copytree\");\n"
+        "expect(throws(function() { copytree(root + \"/src\", root + \"/tree\"); }), \"copytree target exists\");\n"
+        "move(root + \"/tree\", root + \"/moved\");\n"
+        "expect(!exists(root + \"/tree\") && fread(root + \"/moved/sub/small.txt\") == \"small\", \"move directory\");\n"
+        "move(root + \"/copy.bin\", root + \"/moved.bin\");\n"
+        "expect(!exists(root + \"/copy.bin\") && length(bytesread(root + \"/moved.bin\")) == 300000, \"move file\");\n"
+        "foreach(walk(root), function(e) { if (e.type == \"file\") { remove(e.path); } });\n"
+        "foreach([\"/moved/sub\", \"/moved\", \"/src/sub\", \"/src\", \"\"], function(d) { rmdir(root + d); });\n"
+        "return true;\n");
+}
+
+// timers, intervals and pipe watcher in order, shadowing old global name of loop is harmless
+static void test_loop() {
+    _test_script(
+        "let __loop__ = null;\n"
+        "let order = [];\n"
+        "settimeout(function() { push(order, \"b\"); }, 20);\n"
+        "settimeout(function() { push(order, \"a\"); }, 10);\n"
+        "settimeout(function() { push(order, \"c\"); }, 20);\n"
+        "let ticks = 0;\n"
+        "let iv = setinterval(function() { ticks += 1; if (ticks == 3) { cleartimer(iv); } }, 5);\n"
+        "let never = settimeout(function() { push(order, \"never\"); }, 3000000000);\n"
+        "cleartimer(never);\n"
+        "let p = pipe();\n"
+        "let received = \"\";\n"
+        "watch(p[0], function(fd) {\n"
+        "    let s = fdread(fd);\n"
+        "    if (s == null) { push(order, \"eof\"); fdclose(fd); } else { received = received + s; }\n"
+        "});\n"
+        "settimeout(function() { expect(fdwrite(p[1], \"hello \") == 6, \"write\"); }, 1);\n"
+        "settimeout(function() { fdwrite(p[1], \"world\"); fdclose(p[1]); }, 2);\n"
+        "settimeout(function() {\n"
+        "    expect(same(order, [\"eof\", \"a\", \"b\", \"c\"]), \"order of timers and watcher\");\n"
+        "    expect(ticks == 3 && received == \"hello world\", \"interval and pipe\");\n"
+        "    expect(throws(function() { fdread(p[1]); }), \"closed fd\");\n"
+        "}, 100);\n"
+        "return true;\n");
+}
+
+// resume and yield pass values both ways, at any depth of script calls, errors reach resumer
+static void test_coroutine() {
+    _test_script(
+        "function deep(n) { if (n == 0) { return yield(\"deep\"); } return deep(n - 1); }\n"
+        "let co = coroutine(function(first) {\n"
+        "    let second = yield(first + 1);\n"
+        "    let third = deep(50);\n"
+        "    return second + third;\n"
+        "});\n"
+        "expect(status(co) == \"suspended\" && resume(co, 1) == 2, \"first resume passes argument\");\n"
+        "expect(resume(co, 10) == \"deep\" && status(co) == \"suspended\", \"yield at depth\");\n"
+        "expect(resume(co, 5) == 15 && status(co) == \"dead\", \"returned value\");\n"
+        "expect(throws(function() { resume(co); }), \"resume dead\");\n"
+        "let gen = coroutine(function() { for (let i = 0; i < 5; i++) { yield(i * i); } return \"end\"; });\n"
+        "let squares = [];\n"
+        "for (let x of gen) { push(squares, x); }\n"
+        "expect(same(squares, [0, 1, 4, 9, 16]), \"for of excludes returned value\");\n"
+        "let bad = coroutine(function() { yield(1); throw \"inside\"; });\n"
+        "resume(bad);\n"
+        "let caught = null;\n"
+        "try { resume(bad); } catch (e) { caught = e; }\n"
+        "expect(caught.message.message == \"inside\" && status(bad) == \"dead\", \"error propagates to resumer, wrapped like errors through other c functions\");\n"
+        "expect(throws(function() { yield(1); }), \"yield outside coroutine\");\n"
+        "let cb = coroutine(function() { map([1], function(x) { yield(x); }); });\n"
+        "expect(throws(function() { resume(cb); }), \"yield inside callback of c function\");\n"
+        "let outer = coroutine(function() {\n"
+        "    let inner = coroutine(function() { yield(\"inner\"); return \"inner done\"; });\n"
+        "    yield(resume(inner));\n"
+        "    expect(status(inner) == \"suspended\", \"inner kept\");\n"
+        "    return resume(inner);\n"
+        "});\n"
+        "expect(resume(outer) == \"inner\" && resume(outer) == \"inner done\" && status(outer) == \"dead\", \"nested\");\n"
+        "return true;\n");
+}
+
+// messages are deep copied both ways, hangup ends them, shadowing old global names of tables is harmless
+static void test_worker() {
+    _test_script(
+        "let __programs__ = null;\n"
+        "let __receivers__ = null;\n"
+        "let fname = \"/tmp/js-test-worker.js\";\n"
+        "let f = open(fname, \"w\");\n"
+        "write(f, \"let m = receive(parent); while (m != null) { post(parent, m); m = receive(parent); } post(parent, \\\"bye\\\");\");\n"
+        "close(f);\n"
+        "let w = spawn(fname);\n"
+        "let hm = hashmap();\n"
+        "set(hm, 1, \"one\");\n"
+        "post(w, [1, \"two\", {three: [3]}, null, true]);\n"
+        "post(w, float64array([1.5, 2.5]));\n"
+        "post(w, hm);\n"
+        "let r = receive(w);\n"
+        "expect(length(r) == 5 && r[1] == \"two\" && r[2].three[0] == 3 && r[3] == null && r[4] == true, \"deep copy\");\n"
+        "expect(same(receive(w), [1.5, 2.5]) && get(receive(w), 1) == \"one\", \"typed array and hashmap\");\n"
+        "let cyclic = [];\n"
+        "push(cyclic, cyclic);\n"
+        "expect(throws(function() { post(w, cyclic); }) && throws(function() { post(w, function() {}); }), \"cycles and functions\");\n"
+        "hangup(w);\n"
+        "expect(receive(w) == \"bye\" && receive(w) == null, \"hangup\");\n"
+        "expect(throws(function() { spawn(\"/tmp\"); }) && throws(function() { spawn(\"/tmp/js-test-no-such-worker.js\"); }), \"spawn errors\");\n"
+        "let w2 = spawn(fname);\n"
+        "let got = [];\n"
+        "onmessage(w2, function(m) {\n"
+        "    push(got, m);\n"
+        "    if (m == null) { expect(same(got, [\"x\", \"y\", \"bye\", null]), \"onmessage\"); }\n"
+        "});\n"
+        "post(w2, \"x\");\n"
+        "post(w2, \"y\");\n"
+        "hangup(w2);\n"
+        "remove(fname);\n"
+        "return true;\n");
+}
+
+// results come back in order, first error of children is thrown again
+static void test_parallel_map() {
+    _test_script(
+        "let a = [];\n"
+        "for (let i = 0; i < 1000; i++) { push(a, i); }\n"
+        "let seen = 0;\n"
+        "let r = parallel_map(a, function(x, i) { seen += 1; return [x * 2, i]; }, 4);\n"
+        "let ok = length(r) == 1000;\n"
+        "for (let i = 0; i < 1000; i++) { ok = ok && r[i][0] == i * 2 && r[i][1] == i; }\n"
+        "expect(ok && seen == 0, \"order kept, side effects stay in children\");\n"
+        "let h = [1];\n"
+        "h[3] = 4;\n"
+        "expect(same(parallel_map(h, function(x) { return x; }, 8), [1, null, null, 4]), \"holes and more processes than elements\");\n"
+        "expect(length(parallel_map([], function(x) { return x; })) == 0, \"empty\");\n"
+        "let caught = null;\n"
+        "try { parallel_map(a, function(x) { if (x == 700) { throw \"bad element\"; } return x; }, 3); } catch (e) { caught = e; }\n"
+        "expect(caught.message.message == \"bad element\", \"error of child rethrown\");\n"
+        "expect(throws(function() { parallel_map([1, 2], function(x) { return function() {}; }, 2); }), \"result can't be function\");\n"
+        "expect(same(parallel_map([1, 2, 3], function(x) { return x + 1; }, 2), [2, 3, 4]), \"usable after errors\");\n"
+        "return true;\n");
+}
+
+
+// vm of image is declared same as js.c does
+static struct js_result _test_image_load(struct js_vm *vm, const char *fname) {
+    js_declare_std_functions(vm, 0, NULL);
+    js_declare_loop_functions(vm);
+    js_declare_worker_functions(vm);
+    return js_image_load(vm, fname);
+}
+
+// image keeps cycles, shared references, closures and c functions, and corrupt images are rejected without crash
+static void test_image() {
+    const char *fname = "/tmp/js-test-image.img";
+    const char *prelude = "let shared = {name: \"shared\"};\n"
+                          "let ring = [1, shared];\n"
+                          "push(ring, ring);\n"
+                          "shared.ring = ring;\n"
+                          "let counter = function() { let n = 0; return function() { n += 1; return n; }; }();\n"
+                          "counter();\n"
+                          "let table = float64array([1.5, 2.5]);\n"
+                          "let hm = hashmap();\n"
+                          "set(hm, \"k\", shared);\n"
+                          "let hs = hashset(1, \"two\");\n"
+                          "let sparse = [];\n"
+                          "sparse[100000] = \"far\";\n"
+                          "let sorter = sort;\n";
+    const char *checks = "function expect(cond, what) { if (!cond) { throw what; } }\n"
+                         "expect(ring[2] == ring && ring[1] == shared && shared.ring == ring && shared.name == \"shared\", \"cycles and shared\");\n"
+                         "expect(counter() == 2 && counter() == 3, \"closure state\");\n"
+                         "expect(table[1] == 2.5 && get(hm, \"k\") == shared && has(hs, \"two\") && sparse[100000] == \"far\" && length(sparse) == 100001, \"values\");\n"
+                         "let s = [3, 1, 2];\n"
+                         "sorter(s);\n"
+                         "expect(s[0] == 1 && s[2] == 3, \"c function by name\");\n"
+                         "return true;\n";
+    struct js_source source = {0};
+    struct js_token token = {0};
+    struct js_vm vm = {0};
+    string_buffer_append_sz(source.base, source.length, source.capacity, prelude);
+    enforce(js_compile(&source, &token, &(vm.bytecode), &(vm.cross_reference)));
+    buffer_free(source.base, source.length, source.capacity);
+    js_declare_std_functions(&vm, 0, NULL);
+    js_declare_loop_functions(&vm);
+    js_declare_worker_functions(&vm);
+    struct js_vm natives = {0};
+    js_declare_std_functions(&natives, 0, NULL);
+    js_declare_loop_functions(&natives);
+    js_declare_worker_functions(&natives);
+    enforce(js_run(&vm).success && js_image_save(&vm, &(natives.globals), fname).success);
+    js_free_vm(&natives);
+    js_free_vm(&vm);
+    // restored, then code is appended after image
+    vm = (struct js_vm){0};
+    enforce(_test_image_load(&vm, fname).success);
+    token = (struct js_token){0};
+    string_buffer_append_sz(source.base, source.length, source.capacity, checks);
+    enforce(js_compile(&source, &token, &(vm.bytecode), &(vm.cross_reference)));
+    buffer_free(source.base, source.length, source.capacity);
+    enforce(_run(&vm) == EXIT_SUCCESS);
+    js_free_vm(&vm);
+    // every truncation and flipped magic must fail, other flipped bytes may load but never crash
+    uint8_t *image = NULL;
+    size_t length = 0;
+    size_t capacity = 0;
+    read_binary_file(fname, image, length, capacity);
+    size_t rejected = 0;
+    for (size_t i = 0; i < length * 2; i++) {
+        size_t cut = i < length ? i : length;
+        uint8_t saved = image[i % length];
+        if (i >= length) {
+            image[i % length] ^= (uint8_t)(1 << (i % 8));
+        }
+        write_file(fname, "wb", image, cut, capacity);
+        image[i % length] = saved;
+        vm = (struct js_vm){0};
+        struct js_result result = _test_image_load(&vm, fname);
+        js_free_vm(&vm);
+        enforce(!result.success || i >= length + 8);
+        rejected += !result.success;
+    }
+    printf("image of %zu bytes, %zu of %zu corrupt ones rejected\n", length, rejected, length * 2);
+    buffer_free(image, length, capacity);
+    unlink(fname);
+}
+
+#endif
+
 // #ifdef _WIN32
 //     #include <windows.h>
 // #endif
@@ -249,6 +1397,17 @@ int main(int argc, char *argv[]) {
     if (argc == 1) { // no arguments, enter repl
         return _repl(argc, argv);
     }
+    // rest arguments belong to script, so check them first
+    if (strcmp(argv[1], "--serve") == 0 || strcmp(argv[1], "--connect") == 0) {
+#ifdef _WIN32
+        fatal("Server mode requires unix domain socket");
+#else
+        if (argc < 3) {
+            fatal("Require socket filename");
+        }
+        return argv[1][2] == 's' ? _serve(argv[2]) : _connect(argv[2], argv[0], argc - 3, argv + 3);
+#endif
+    }
     enum { t_bytecode,
         t_source,
         t_xref
@@ -260,6 +1419,8 @@ int main(int argc, char *argv[]) {
     } source_filenames = {0};
     char *bytecode_filename = NULL;
     char *xref_filename = NULL;
+    char *image_in_filename = NULL;
+    char *image_out_filename = NULL;
     enum { a_compile,
         a_run,
         a_unassemble
@@ -277,12 +1438,18 @@ int main(int argc, char *argv[]) {
                 file_type = t_xref;
             } else if (__arg_eq("-c") || __arg_eq("--compile")) {
                 action = a_compile;
+            } else if ((__arg_eq("-j") || __arg_eq("--jobs")) && i + 1 < argc) {
+                pool_configure((size_t)atol(argv[++i]));
             } else if (__arg_eq("-h") || __arg_eq("--help")) {
                 return _help(argv[0]);
             } else if (__arg_eq("-o") || __arg_eq("--optimize")) {
                 optimize = true;
             } else if (__arg_eq("-r") || __arg_eq("--run")) {
                 action = a_run;
+            } else if (__arg_eq("--snapshot-in") && i + 1 < argc) {
+                image_in_filename = argv[++i];
+            } else if (__arg_eq("--snapshot-out") && i + 1 < argc) {
+                image_out_filename = argv[++i];
 #ifdef DEBUG
             } else if (__arg_eq("-t") || __arg_eq("--test")) {
                 return _test(argv[0], argc - i - 1, argv + i + 1);
@@ -310,6 +1477,20 @@ int main(int argc, char *argv[]) {
     struct js_token token = {0};
     struct js_vm vm = {0};
     js_declare_std_functions(&vm, argc, argv);
+    js_declare_loop_functions(&vm);
+    js_declare_worker_functions(&vm);
+    if (image_in_filename != NULL) {
+        // instead of compiling and running prelude again, source files are appended after it
+        if (source_filenames.base == NULL) {
+            fatal("Require source files after image");
+        }
+        struct js_result result = js_image_load(&vm, image_in_filename);
+        if (!result.success) {
+            printf("Image Error: ");
+            js_value_print(&(result.value));
+            return EXIT_FAILURE;
+        }
+    }
     if (source_filenames.base != NULL) {
         for (size_t i = 0; i < source_filenames.length; i++) {
             read_text_file(source_filenames.base[i], source.base, source.length, source.capacity);
@@ -320,6 +1501,27 @@ int main(int argc, char *argv[]) {
             return EXIT_FAILURE;
         }
     }
+    if (image_out_filename != NULL) {
+        if (source_filenames.base == NULL) {
+            fatal("Require source files");
+        }
+        struct js_result result = js_run(&vm);
+        if (result.success) {
+            // c functions are saved by names, and host's own globals are declared again when loading
+            struct js_vm natives = {0};
+            js_declare_std_functions(&natives, argc, argv);
+            js_declare_loop_functions(&natives);
+            js_declare_worker_functions(&natives);
+            result = js_image_save(&vm, &(natives.globals), image_out_filename);
+            js_free_vm(&natives);
+        }
+        if (!result.success) {
+            printf("Runtime Error: ");
+            js_value_print(&(result.value));
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
     if (action == a_compile) {
         if (source_filenames.base == NULL) {
             fatal("Require source files");
@@ -338,24 +1540,7 @@ int main(int argc, char *argv[]) {
             }
         }
         if (action == a_run) {
-            struct js_result result = js_run(&vm);
-            if (result.success) {
-                switch (result.value.type) {
-                case vt_number:
-                    return (int)result.value.number;
-                    break;
-                case vt_boolean:
-                    return result.value.boolean ? EXIT_SUCCESS : EXIT_FAILURE;
-                    break;
-                default:
-                    return EXIT_SUCCESS;
-                    break;
-                }
-            } else {
-                printf("Runtime Error: ");
-                js_value_print(&(result.value));
-                return EXIT_FAILURE;
-            }
+            return _run(&vm);
         } else if (action == a_unassemble) {
             js_bytecode_dump(&(vm.bytecode));
         }